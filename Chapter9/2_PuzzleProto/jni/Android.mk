@@ -59,11 +59,11 @@ LOCAL_SRC_FILES += Wrappers.cpp WrappersJNI.c
 LOCAL_SRC_FILES += ../main.cpp
 LOCAL_SRC_FILES += ../../Engine/Engine.cpp
 LOCAL_SRC_FILES += ../../Engine/LGL/LGL.cpp ../../Engine/LGL/GLClasses.cpp
-LOCAL_SRC_FILES += ../../Engine/core/iIntrusivePtr.cpp ../../Engine/core/VecMath.cpp
-LOCAL_SRC_FILES += ../../Engine/fs/FileSystem.cpp ../../Engine/fs/libcompress.c ../../Engine/fs/Archive.cpp
-LOCAL_SRC_FILES += ../../Engine/graphics/Geometry.cpp  ../../Engine/graphics/Canvas.cpp ../../Engine/graphics/Gestures.cpp ../../Engine/graphics/Multitouch.cpp ../../Engine/graphics/TextRenderer.cpp ../../Engine/graphics/ft_load.cpp ../../Engine/graphics/Bitmap.cpp ../../Engine/graphics/FI_Utils.cpp ../../Engine/graphics/GUI.cpp
+LOCAL_SRC_FILES += ../../Engine/core/VecMath.cpp ../../Engine/core/ObjectPool.cpp ../../Engine/core/Profiler.cpp
+LOCAL_SRC_FILES += ../../Engine/fs/FileSystem.cpp ../../Engine/fs/libcompress.c ../../Engine/fs/Archive.cpp ../../Engine/fs/Bundle.cpp
+LOCAL_SRC_FILES += ../../Engine/graphics/Geometry.cpp  ../../Engine/graphics/Canvas.cpp ../../Engine/graphics/ProfilerOverlay.cpp ../../Engine/graphics/Gestures.cpp ../../Engine/graphics/Multitouch.cpp ../../Engine/graphics/TextRenderer.cpp ../../Engine/graphics/ft_load.cpp ../../Engine/graphics/Bitmap.cpp ../../Engine/graphics/FI_Utils.cpp ../../Engine/graphics/GUI.cpp
 LOCAL_SRC_FILES += ../../Engine/sound/Decoders.cpp ../../Engine/sound/LAL.cpp ../../Engine/sound/Audio.cpp
-LOCAL_SRC_FILES += ../../Engine/threading/Event.cpp ../../Engine/threading/Thread.cpp ../../Engine/threading/tinythread.cpp ../../Engine/threading/WorkerThread.cpp
+LOCAL_SRC_FILES += ../../Engine/threading/Event.cpp ../../Engine/threading/Thread.cpp ../../Engine/threading/Sync.cpp ../../Engine/threading/tinythread.cpp ../../Engine/threading/WorkerThread.cpp ../../Engine/threading/ThreadPool.cpp ../../Engine/threading/TaskGraph.cpp
 LOCAL_SRC_FILES += ../src/game/Game.cpp
 
 LOCAL_ARM_MODE := arm
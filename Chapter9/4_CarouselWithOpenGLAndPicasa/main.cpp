@@ -50,7 +50,8 @@ clPtr<clGallery> g_Gallery;
 clAudioThread g_Audio;
 clPtr<clCanvas> Canvas;
 
-clPtr<clWorkerThread> g_Loader;
+clPtr<clThreadPool> g_Loader;
+clPtr<clTaskGraph> g_Jobs;
 
 sLGLAPI* LGL3 = NULL;
 
@@ -165,9 +166,11 @@ void OnStart( const std::string& RootPath )
 
 	g_Responder = &Responder;
 
-	g_Loader = new clWorkerThread();
+	g_Loader = new clThreadPool();
 	g_Loader->Start( iThread::Priority_Normal );
 
+	g_Jobs = new clTaskGraph( g_Loader );
+
 	// Initialize the network and events queue
 	Curl_Load();
 
@@ -188,8 +191,8 @@ void OnDrawFrame()
 
 void OnTimer( float Delta )
 {
-	// dispatch events here
-	g_Events->DemultiplexEvents();
+	// dispatch events here, a burst of completions is spread over several frames
+	g_Events->DemultiplexEvents( 0, 0.004 );
 
 	g_Flow->FFlinger->Update( Delta );
 }
@@ -37,10 +37,13 @@
 #include "Downloader.h"
 #include "FileSystem.h"
 #include "Event.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
 
 extern clPtr<clDownloader> g_Downloader;
 extern clPtr<iAsyncQueue> g_Events;
 
-extern clPtr<clWorkerThread> g_Loader;
+extern clPtr<clThreadPool> g_Loader;
+extern clPtr<clTaskGraph> g_Jobs;
 
 extern clPtr<clFileSystem> g_FS;
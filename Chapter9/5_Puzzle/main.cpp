@@ -66,7 +66,8 @@ bool g_InGallery;
 clAudioThread g_Audio;
 clPtr<clCanvas> g_Canvas;
 
-clPtr<clWorkerThread> g_Loader;
+clPtr<clThreadPool> g_Loader;
+clPtr<clTaskGraph> g_Jobs;
 
 sLGLAPI* LGL3 = NULL;
 
@@ -75,6 +76,10 @@ clPtr<clFlowUI> g_Flow;
 clPtr<clTextRenderer> g_TextRenderer;
 int g_Font;
 
+/// Set to true to record the profiler zones and show the frame time overlay
+bool g_ShowProfiler = false;
+clPtr<clProfilerOverlay> g_ProfilerOverlay;
+
 clPtr<clGLSLShaderProgram> BackShader;
 clPtr<clGLTexture> g_Texture;
 clPtr<clGUI> g_GUI;
@@ -274,10 +279,15 @@ void InitGUI()
 
 	g_TextRenderer = new clTextRenderer();
 	g_Font = g_TextRenderer->GetFontHandle( "default.ttf" );
+
+	g_ProfilerOverlay = new clProfilerOverlay( g_TextRenderer, g_Font );
 }
 
 void OnStart( const std::string& RootPath )
 {
+	Profiler_Get().SetEnabled( g_ShowProfiler );
+	Profiler_Get().SetThreadName( "Main" );
+
 	g_FS = new clFileSystem();
 	g_FS->Mount( "." );
 #if defined(ANDROID)
@@ -293,9 +303,11 @@ void OnStart( const std::string& RootPath )
 
 	g_Responder = &Responder;
 
-	g_Loader = new clWorkerThread();
+	g_Loader = new clThreadPool();
 	g_Loader->Start( iThread::Priority_Normal );
 
+	g_Jobs = new clTaskGraph( g_Loader );
+
 	// init gui
 	InitGUI();
 
@@ -322,12 +334,14 @@ void OnStart( const std::string& RootPath )
 void OnDrawFrame()
 {
 	g_GUI->Render();
+
+	if ( g_ShowProfiler ) { g_ProfilerOverlay->Render( g_Canvas, 0.0f, 0.0f, 0.5f, 0.4f ); }
 }
 
 void OnTimer( float Delta )
 {
-	// dispatch events here
-	g_Events->DemultiplexEvents();
+	// dispatch events here, a burst of completions is spread over several frames
+	g_Events->DemultiplexEvents( 0, 0.004 );
 
 	g_GUI->Update( Delta );
 }
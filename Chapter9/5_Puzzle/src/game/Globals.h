@@ -40,6 +40,8 @@
 #include "Downloader.h"
 #include "FileSystem.h"
 #include "Event.h"
+#include "ThreadPool.h"
+#include "TaskGraph.h"
 
 #include "GalleryTable.h"
 #include "FlowUI.h"
@@ -64,7 +66,8 @@ extern clPtr<clGUI> g_GUI;
 
 extern clPtr<clGallery> g_Gallery;
 
-extern clPtr<clWorkerThread> g_Loader;
+extern clPtr<clThreadPool> g_Loader;
+extern clPtr<clTaskGraph> g_Jobs;
 
 extern clPtr<clFileSystem> g_FS;
 
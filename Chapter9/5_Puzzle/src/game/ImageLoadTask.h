@@ -58,6 +58,7 @@ public:
 
 class clImageLoadTask: public iTask
 {
+	L_POOLED_OBJECT( clImageLoadTask )
 public:
 	clImageLoadTask( const clPtr<clBlob>& B, size_t TaskID, const clPtr<clImageLoadingCompleteCallback>& CB, iAsyncQueue* CallbackQueue )
 		: FSource( B ), FSourceStream( NULL ), FCallback( CB ), FCallbackQueue( CallbackQueue )
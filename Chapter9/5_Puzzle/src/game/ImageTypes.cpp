@@ -51,22 +51,27 @@ public:
 	clPtr<sImageDescriptor> FDesc;
 };
 
-class clImageLoadingComplete: public clImageLoadingCompleteCallback
+/// Runs on the rendering thread after the decoding task has completed
+class clTextureUploadTask: public iTask
 {
 public:
-	explicit clImageLoadingComplete( const clPtr<sImageDescriptor>& d ): FDesc( d ) {}
+	clTextureUploadTask( const clPtr<sImageDescriptor>& D, const clPtr<clImageLoadTask>& Decode, bool Placeholder )
+		: FDesc( D ), FDecode( Decode ), FPlaceholder( Placeholder ) {}
 
-	virtual void Invoke()
+	virtual void Run()
 	{
-		FDesc->FNewBitmap = FResult;
+		// the pool may decode the placeholder and the downloaded image in any order, the placeholder must never replace the real image
+		if ( FPlaceholder && FDesc->FState == L_LOADED ) { return; }
+
+		FDesc->FNewBitmap = FDecode->GetResult();
 
 		// update texture
 		FDesc->UpdateTexture();
-
-		FDesc = NULL;
 	}
 
 	clPtr<sImageDescriptor> FDesc;
+	clPtr<clImageLoadTask>  FDecode;
+	bool                    FPlaceholder;
 };
 
 void sImageDescriptor::StartDownload( bool AsFullSize )
@@ -76,11 +81,11 @@ void sImageDescriptor::StartDownload( bool AsFullSize )
 	FState = L_LOADING;
 
 	clPtr<iIStream> In = g_FS->CreateReader( "NoImageAvailable.png" );
-	clPtr<clImageLoadingCompleteCallback> CB = new clImageLoadingComplete ( this );
 
-	clPtr<iTask> LoadTask = new clImageLoadTask( In, 0, CB, g_Events.GetInternalPtr() );
+	// decode on the pool, then upload on the rendering thread
+	clPtr<clImageLoadTask> LoadTask = new clImageLoadTask( In, 0, NULL, NULL );
 
-	g_Loader->AddTask( LoadTask );
+	g_Jobs->Add( LoadTask )->Then( new clTextureUploadTask( this, LoadTask, true ), g_Events.GetInternalPtr() );
 
 	// task ID should be unique
 	g_Downloader->CancelLoad( ( size_t )this );
@@ -95,10 +100,9 @@ void sImageDescriptor::ImageDownloaded( clPtr<clBlob> B )
 		return;
 	}
 
-	clPtr<clImageLoadingCompleteCallback> CB = new clImageLoadingComplete( this );
-	clPtr<clImageLoadTask> LoadTask = new clImageLoadTask( B, 0, CB, g_Events.GetInternalPtr() );
+	clPtr<clImageLoadTask> LoadTask = new clImageLoadTask( B, 0, NULL, NULL );
 
-	g_Loader->AddTask( LoadTask );
+	g_Jobs->Add( LoadTask )->Then( new clTextureUploadTask( this, LoadTask, false ), g_Events.GetInternalPtr() );
 }
 
 void sImageDescriptor::UpdateTexture()
@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "BenchResults.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#  include <direct.h>
+#else
+#  include <sys/stat.h>
+#endif
+
+static std::vector<sBenchResult> g_Results;
+
+static std::string g_FixtureDir;
+
+static bool Bench_IsThroughput( const std::string& Units )
+{
+	return Units.length() >= 2 && Units.compare( Units.length() - 2, 2, "/s" ) == 0;
+}
+
+void Bench_Report( const char* Name, double Value, const char* Units )
+{
+	printf( "%-48s %14.3f %s\n", Name, Value, Units );
+
+	for ( size_t i = 0; i != g_Results.size(); i++ )
+	{
+		sBenchResult& R = g_Results[i];
+
+		if ( R.FName != Name ) { continue; }
+
+		R.FValue = R.FHigherIsBetter ? std::max( R.FValue, Value ) : std::min( R.FValue, Value );
+
+		return;
+	}
+
+	sBenchResult R;
+	R.FName  = Name;
+	R.FValue = Value;
+	R.FUnits = Units;
+	R.FHigherIsBetter = Bench_IsThroughput( Units );
+
+	g_Results.push_back( R );
+}
+
+const std::vector<sBenchResult>& Bench_GetResults()
+{
+	return g_Results;
+}
+
+void Bench_SetFixtureDir( const std::string& Dir )
+{
+	g_FixtureDir = Dir;
+}
+
+std::string Bench_GetFixturePath( const std::string& FileName )
+{
+	if ( g_FixtureDir.empty() )
+	{
+#ifdef _WIN32
+		char Temp[ MAX_PATH ];
+		GetTempPathA( MAX_PATH, Temp );
+		g_FixtureDir = std::string( Temp ) + "EngineBench";
+#else
+		const char* Temp = getenv( "TMPDIR" );
+		g_FixtureDir = std::string( Temp ? Temp : "/tmp" ) + "/EngineBench";
+#endif
+	}
+
+#ifdef _WIN32
+	_mkdir( g_FixtureDir.c_str() );
+	return g_FixtureDir + "\\" + FileName;
+#else
+	mkdir( g_FixtureDir.c_str(), 0755 );
+	return g_FixtureDir + "/" + FileName;
+#endif
+}
+
+bool Bench_SaveResults( const std::string& FileName, const std::vector<sBenchResult>& Results )
+{
+	FILE* F = fopen( FileName.c_str(), "wt" );
+
+	if ( !F ) { return false; }
+
+	fprintf( F, "{\"seed\":%u,\"results\":[\n", BENCH_SEED );
+
+	for ( size_t i = 0; i != Results.size(); i++ )
+	{
+		const sBenchResult& R = Results[i];
+
+		fprintf( F, "%s{\"name\":\"%s\",\"value\":%.9g,\"units\":\"%s\",\"higher_is_better\":%s}", i ? ",\n" : "",
+		         Trace_EscapeJSON( R.FName ).c_str(), R.FValue, Trace_EscapeJSON( R.FUnits ).c_str(), R.FHigherIsBetter ? "true" : "false" );
+	}
+
+	fprintf( F, "\n]}\n" );
+
+	return fclose( F ) == 0;
+}
+
+/// Value of the string field Key in the JSON object starting at Obj
+static bool Bench_ParseString( const std::string& JSON, size_t Obj, size_t End, const char* Key, std::string* Value )
+{
+	std::string Pattern = std::string( "\"" ) + Key + "\":\"";
+
+	size_t Pos = JSON.find( Pattern, Obj );
+
+	if ( Pos == std::string::npos || Pos > End ) { return false; }
+
+	Value->clear();
+
+	for ( Pos += Pattern.length(); Pos < End && JSON[Pos] != '"'; Pos++ )
+	{
+		if ( JSON[Pos] == '\\' ) { Pos++; }
+
+		Value->push_back( JSON[Pos] );
+	}
+
+	return true;
+}
+
+static bool Bench_ParseToken( const std::string& JSON, size_t Obj, size_t End, const char* Key, std::string* Value )
+{
+	std::string Pattern = std::string( "\"" ) + Key + "\":";
+
+	size_t Pos = JSON.find( Pattern, Obj );
+
+	if ( Pos == std::string::npos || Pos > End ) { return false; }
+
+	Pos += Pattern.length();
+
+	size_t Last = JSON.find_first_of( ",}", Pos );
+
+	*Value = JSON.substr( Pos, Last - Pos );
+
+	return true;
+}
+
+bool Bench_LoadResults( const std::string& FileName, std::vector<sBenchResult>* Results )
+{
+	FILE* F = fopen( FileName.c_str(), "rt" );
+
+	if ( !F ) { return false; }
+
+	std::string JSON;
+
+	char Buf[4096];
+
+	for ( size_t Size; ( Size = fread( Buf, 1, sizeof( Buf ), F ) ) > 0; ) { JSON.append( Buf, Size ); }
+
+	fclose( F );
+
+	Results->clear();
+
+	// only the files written by Bench_SaveResults() are supported: one flat object per result
+	for ( size_t Obj = JSON.find( "{\"name\":" ); Obj != std::string::npos; Obj = JSON.find( "{\"name\":", Obj + 1 ) )
+	{
+		size_t End = JSON.find( '}', Obj );
+
+		if ( End == std::string::npos ) { return false; }
+
+		sBenchResult R;
+		std::string Value, Better;
+
+		if ( !Bench_ParseString( JSON, Obj, End, "name", &R.FName ) ||
+		     !Bench_ParseToken( JSON, Obj, End, "value", &Value ) ||
+		     !Bench_ParseString( JSON, Obj, End, "units", &R.FUnits ) ||
+		     !Bench_ParseToken( JSON, Obj, End, "higher_is_better", &Better ) ) { return false; }
+
+		R.FValue = atof( Value.c_str() );
+		R.FHigherIsBetter = ( Better == "true" );
+
+		Results->push_back( R );
+	}
+
+	return true;
+}
+
+size_t Bench_CompareResults( const std::vector<sBenchResult>& Baseline, const std::vector<sBenchResult>& Results, double Threshold )
+{
+	size_t Regressions = 0;
+
+	printf( "\n%-48s %14s %14s %9s\n", "Comparison", "baseline", "current", "change" );
+
+	for ( size_t i = 0; i != Results.size(); i++ )
+	{
+		const sBenchResult& R = Results[i];
+
+		const sBenchResult* B = NULL;
+
+		for ( size_t j = 0; j != Baseline.size(); j++ )
+		{
+			if ( Baseline[j].FName == R.FName ) { B = &Baseline[j]; break; }
+		}
+
+		if ( !B || B->FUnits != R.FUnits )
+		{
+			printf( "%-48s %14s %14.3f %9s\n", R.FName.c_str(), "-", R.FValue, "new" );
+			continue;
+		}
+
+		// positive is an improvement
+		double Change = ( B->FValue != 0.0 ) ? ( R.FValue - B->FValue ) / fabs( B->FValue ) * 100.0 : 0.0;
+
+		if ( !R.FHigherIsBetter ) { Change = -Change; }
+
+		bool Regressed = Change < -Threshold;
+
+		if ( Regressed ) { Regressions++; }
+
+		printf( "%-48s %14.3f %14.3f %+8.1f%%%s\n", R.FName.c_str(), B->FValue, R.FValue, Change, Regressed ? "  REGRESSION" : "" );
+	}
+
+	return Regressions;
+}
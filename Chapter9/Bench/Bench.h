@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <string>
+
+#include "Trace.h"
+
+/// Wall clock time in seconds for the benchmarks
+inline double Bench_GetSeconds()
+{
+	return static_cast<double>( Trace_GetNanoseconds() ) * 1e-9;
+}
+
+/// Seed of all the generated fixtures, so every run measures the same data
+const unsigned int BENCH_SEED = 12345;
+
+/// Deterministic pseudo-random numbers for the fixtures, unlike rand() the sequence is the same on every platform
+class clBenchRandom
+{
+public:
+	explicit clBenchRandom( unsigned int Seed = BENCH_SEED ): FState( Seed ) {}
+
+	unsigned int Next()
+	{
+		FState = FState * 1664525u + 1013904223u;
+		return FState >> 8;
+	}
+
+	/// [0..1)
+	float NextFloat() { return static_cast<float>( Next() & 0xFFFF ) / 65536.0f; }
+
+private:
+	unsigned int FState;
+};
+
+/**
+   Record a single measurement. Units ending with "/s" are throughput (higher is better), everything else is time (lower is better).
+   When the suite is repeated, the best value of every measurement is kept
+*/
+void Bench_Report( const char* Name, double Value, const char* Units );
+
+/// Full name of a generated fixture file in the temporary directory
+std::string Bench_GetFixturePath( const std::string& FileName );
+
+void Bench_Blob();
+void Bench_TaskQueue();
+void Bench_RefCount();
+void Bench_ObjectPool();
+void Bench_Files();
+void Bench_Bitmap();
+void Bench_VecMath();
+void Bench_Sync();
+void Bench_Physics();
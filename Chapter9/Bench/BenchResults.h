@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/// Single measurement of the suite, as saved to and loaded from the JSON results
+struct sBenchResult
+{
+	std::string FName;
+	double      FValue;
+	std::string FUnits;
+	bool        FHigherIsBetter;
+};
+
+/// Everything reported so far, in the order of reporting
+const std::vector<sBenchResult>& Bench_GetResults();
+
+/// Directory for the generated fixtures, the system temporary directory by default
+void Bench_SetFixtureDir( const std::string& Dir );
+
+bool Bench_SaveResults( const std::string& FileName, const std::vector<sBenchResult>& Results );
+bool Bench_LoadResults( const std::string& FileName, std::vector<sBenchResult>* Results );
+
+/**
+   Print the results side by side with the baseline and return the number of regressions:
+   measurements which got worse by more than Threshold percent. Measurements missing from the baseline are never regressions
+*/
+size_t Bench_CompareResults( const std::vector<sBenchResult>& Baseline, const std::vector<sBenchResult>& Results, double Threshold );
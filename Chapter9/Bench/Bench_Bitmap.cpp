@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "Bitmap.h"
+
+/// A typical Picasa thumbnail is much smaller, a full-screen background is about this size
+const int BENCH_BITMAP_SIZE = 1024;
+
+const int BENCH_BITMAP_ROUNDS = 32;
+
+static void Bench_ConvertRGBtoBGR( LBitmapFormat Format, const char* Name )
+{
+	clPtr<clBitmap> Bitmap = new clBitmap( BENCH_BITMAP_SIZE, BENCH_BITMAP_SIZE, Format );
+
+	clBenchRandom Random;
+
+	const int Size = Bitmap->FBitmapParams.GetStorageSize();
+
+	for ( int i = 0; i != Size; i++ ) { Bitmap->FBitmapData[i] = static_cast<ubyte>( Random.Next() ); }
+
+	double T = Bench_GetSeconds();
+
+	for ( int Round = 0; Round != BENCH_BITMAP_ROUNDS; Round++ ) { Bitmap->ConvertRGBtoBGR(); }
+
+	T = Bench_GetSeconds() - T;
+
+	Bench_Report( Name, static_cast<double>( BENCH_BITMAP_SIZE ) * BENCH_BITMAP_SIZE * BENCH_BITMAP_ROUNDS / T / 1e6, "M pixels/s" );
+}
+
+void Bench_Bitmap()
+{
+	Bench_ConvertRGBtoBGR( L_BITMAP_BGR8,  "bitmap_rgb_to_bgr_24" );
+	Bench_ConvertRGBtoBGR( L_BITMAP_BGRA8, "bitmap_rgb_to_bgr_32" );
+}
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "Blob.h"
+
+/// Number of appended chunks, a typical curl download delivers ~16 Kb per callback
+const size_t BENCH_BLOB_APPENDS = 4096;
+
+/// The old clBlob::AppendBytes() policy: grow to exactly the required size
+static size_t AppendExact( ubyte*& Data, size_t& Size, size_t& Allocated, const void* Src, size_t Num )
+{
+	if ( Size + Num > Allocated )
+	{
+		Allocated = std::max( Size + Num, static_cast<size_t>( 8192 ) );
+		Data = ( ubyte* )realloc( Data, Allocated );
+	}
+
+	memcpy( Data + Size, Src, Num );
+	Size += Num;
+
+	return Size;
+}
+
+static void Bench_BlobAppend( size_t ChunkSize )
+{
+	std::vector<ubyte> Chunk( ChunkSize, 0xAB );
+
+	const size_t Total = BENCH_BLOB_APPENDS * ChunkSize;
+
+	char Name[128];
+
+	// before: exact-fit growth
+	{
+		ubyte* Data = NULL;
+		size_t Size = 0, Allocated = 0;
+
+		double T = Bench_GetSeconds();
+
+		for ( size_t i = 0; i != BENCH_BLOB_APPENDS; i++ ) { AppendExact( Data, Size, Allocated, &Chunk[0], ChunkSize ); }
+
+		T = Bench_GetSeconds() - T;
+
+		free( Data );
+
+		sprintf( Name, "blob_append_%u_exact", ( unsigned int )ChunkSize );
+		Bench_Report( Name, Total / T / ( 1024.0 * 1024.0 ), "Mb/s" );
+	}
+
+	// after: clBlob with geometric growth
+	{
+		double T = Bench_GetSeconds();
+
+		clPtr<clBlob> B = new clBlob();
+
+		for ( size_t i = 0; i != BENCH_BLOB_APPENDS; i++ ) { B->AppendBytes( &Chunk[0], ChunkSize ); }
+
+		T = Bench_GetSeconds() - T;
+
+		sprintf( Name, "blob_append_%u_geometric", ( unsigned int )ChunkSize );
+		Bench_Report( Name, Total / T / ( 1024.0 * 1024.0 ), "Mb/s" );
+	}
+}
+
+/// Lots of tiny short-lived blobs: inline storage against malloc, and arena-backed blobs
+static void Bench_BlobSmall()
+{
+	const size_t NumBlobs = 200000;
+
+	ubyte Data[24] = { 0 };
+
+	double T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != NumBlobs; i++ )
+	{
+		clPtr<clBlob> B = new clBlob();
+		B->CopyMemoryBlock( Data, sizeof( Data ) );
+	}
+
+	T = Bench_GetSeconds() - T;
+
+	Bench_Report( "blob_small_inline", NumBlobs / T / 1e6, "M blobs/s" );
+
+	clBlobArena Arena;
+
+	T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != NumBlobs; i++ )
+	{
+		clPtr<clBlob> B = new clBlob( &Arena );
+		B->CopyMemoryBlock( Data, sizeof( Data ) );
+		B->AppendBytes( Data, sizeof( Data ) );
+
+		if ( ( i & 1023 ) == 0 ) { Arena.Reset(); }
+	}
+
+	T = Bench_GetSeconds() - T;
+
+	Bench_Report( "blob_small_arena", NumBlobs / T / 1e6, "M blobs/s" );
+}
+
+void Bench_Blob()
+{
+	Bench_BlobAppend( 256 );
+	Bench_BlobAppend( 16384 );
+	Bench_BlobSmall();
+}
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "Files.h"
+#include "Archive.h"
+#include "libcompress.h"
+
+/// Size of the file read through FileMapper
+const size_t BENCH_FILE_SIZE = 32 * 1024 * 1024;
+
+/// Files of the extraction archive, half of them are stored and half deflated
+const size_t BENCH_ARCHIVE_FILES = 256;
+const size_t BENCH_ARCHIVE_FILE_SIZE = 64 * 1024;
+
+/// Entries of the archive used to time the mounting
+const size_t BENCH_ARCHIVE_MOUNT_ENTRIES = 20000;
+
+const int BENCH_ARCHIVE_ROUNDS = 4;
+
+/// Half random bytes, half repeated words, so deflate has something to do
+static void Bench_FillData( std::vector<ubyte>* Data, clBenchRandom* Random )
+{
+	static const char* Words[] = { "engine ", "texture ", "shader ", "archive ", "thread ", "puzzle ", "gallery ", "picasa " };
+
+	for ( size_t i = 0; i < Data->size(); )
+	{
+		if ( Random->Next() & 1 )
+		{
+			( *Data )[i++] = static_cast<ubyte>( Random->Next() );
+			continue;
+		}
+
+		for ( const char* W = Words[ Random->Next() & 7 ]; *W && i < Data->size(); W++ ) { ( *Data )[i++] = static_cast<ubyte>( *W ); }
+	}
+}
+
+static bool Bench_WriteFile( const std::string& FileName, const std::vector<ubyte>& Data )
+{
+	FILE* F = fopen( FileName.c_str(), "wb" );
+
+	if ( !F ) { return false; }
+
+	bool Result = fwrite( &Data[0], 1, Data.size(), F ) == Data.size();
+
+	return ( fclose( F ) == 0 ) && Result;
+}
+
+/// libcompress has no default file functions, the archive writer gets plain stdio ones
+static voidpf ZCALLBACK Bench_ZipOpen( voidpf /*opaque*/, const void* filename, int mode )
+{
+	return fopen( ( const char* )filename, ( mode & ZLIB_FILEFUNC_MODE_CREATE ) ? "wb" : "r+b" );
+}
+
+static uLong ZCALLBACK Bench_ZipRead( voidpf /*opaque*/, voidpf stream, void* buf, uLong size )
+{
+	return ( uLong )fread( buf, 1, size, ( FILE* )stream );
+}
+
+static uLong ZCALLBACK Bench_ZipWrite( voidpf /*opaque*/, voidpf stream, const void* buf, uLong size )
+{
+	return ( uLong )fwrite( buf, 1, size, ( FILE* )stream );
+}
+
+static ZPOS64_T ZCALLBACK Bench_ZipTell( voidpf /*opaque*/, voidpf stream )
+{
+	return ( ZPOS64_T )ftell( ( FILE* )stream );
+}
+
+static long ZCALLBACK Bench_ZipSeek( voidpf /*opaque*/, voidpf stream, ZPOS64_T offset, int origin )
+{
+	int Origin = ( origin == ZLIB_FILEFUNC_SEEK_CUR ) ? SEEK_CUR : ( origin == ZLIB_FILEFUNC_SEEK_END ) ? SEEK_END : SEEK_SET;
+
+	return fseek( ( FILE* )stream, ( long )offset, Origin );
+}
+
+static int ZCALLBACK Bench_ZipClose( voidpf /*opaque*/, voidpf stream ) { return fclose( ( FILE* )stream ); }
+static int ZCALLBACK Bench_ZipError( voidpf /*opaque*/, voidpf stream ) { return ferror( ( FILE* )stream ); }
+
+/// Every file gets the same pseudo-random contents on every run
+static bool Bench_WriteArchive( const std::string& FileName, size_t NumFiles, size_t FileSize, bool Mixed )
+{
+	zlib_filefunc64_def Functions;
+	Functions.zopen64_file = Bench_ZipOpen;
+	Functions.zread_file   = Bench_ZipRead;
+	Functions.zwrite_file  = Bench_ZipWrite;
+	Functions.ztell64_file = Bench_ZipTell;
+	Functions.zseek64_file = Bench_ZipSeek;
+	Functions.zclose_file  = Bench_ZipClose;
+	Functions.zerror_file  = Bench_ZipError;
+	Functions.opaque       = NULL;
+
+	zipFile Zip = zipOpen2_64( FileName.c_str(), APPEND_STATUS_CREATE, NULL, &Functions );
+
+	if ( !Zip ) { return false; }
+
+	clBenchRandom Random;
+
+	std::vector<ubyte> Data( FileSize );
+
+	char Name[64];
+
+	for ( size_t i = 0; i != NumFiles; i++ )
+	{
+		Bench_FillData( &Data, &Random );
+
+		bool Stored = Mixed ? ( i & 1 ) == 0 : true;
+
+		sprintf( Name, "%s/file%05u.dat", Stored ? "stored" : "deflated", ( unsigned int )i );
+
+		zip_fileinfo Info;
+		memset( &Info, 0, sizeof( Info ) );
+
+		if ( zipOpenNewFileInZip( Zip, Name, &Info, NULL, 0, NULL, 0, NULL, Stored ? 0 : Z_DEFLATED, Z_DEFAULT_COMPRESSION ) != ZIP_OK ) { break; }
+
+		zipWriteInFileInZip( Zip, &Data[0], static_cast<unsigned int>( Data.size() ) );
+		zipCloseFileInZip( Zip );
+	}
+
+	return zipClose( Zip, NULL ) == ZIP_OK;
+}
+
+static clPtr<iIStream> Bench_OpenFile( const std::string& FileName )
+{
+	clPtr<RawFile> File = new RawFile();
+
+	if ( !File->Open( FileName, FileName ) ) { return NULL; }
+
+	return new FileMapper( File );
+}
+
+static void Bench_FileMapperRead( const std::string& FileName )
+{
+	clPtr<iIStream> Stream = Bench_OpenFile( FileName );
+
+	if ( !Stream ) { return; }
+
+	std::vector<ubyte> Buf( 64 * 1024 );
+
+	const size_t ChunkSizes[] = { 4096, 65536 };
+
+	for ( size_t c = 0; c != 2; c++ )
+	{
+		volatile ubyte Sum = 0;
+
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != 4; Round++ )
+		{
+			Stream->Seek( 0 );
+
+			while ( !Stream->Eof() ) { Sum += Buf[ Stream->Read( &Buf[0], ChunkSizes[c] ) - 1 ]; }
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		char Name[128];
+		sprintf( Name, "filemapper_read_%u", ( unsigned int )ChunkSizes[c] );
+		Bench_Report( Name, 4.0 * Stream->GetSize() / T / ( 1024.0 * 1024.0 ), "Mb/s" );
+	}
+
+	// random 4 Kb reads at the same offsets on every run
+	{
+		const size_t NumReads = 100000;
+
+		clBenchRandom Random;
+
+		volatile ubyte Sum = 0;
+
+		double T = Bench_GetSeconds();
+
+		for ( size_t i = 0; i != NumReads; i++ )
+		{
+			Stream->Seek( ( static_cast<uint64>( Random.Next() ) * 4096 ) % ( Stream->GetSize() - 4096 ) );
+			Sum += Buf[ Stream->Read( &Buf[0], 4096 ) - 1 ];
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		Bench_Report( "filemapper_read_random_4096", NumReads / T / 1e6, "M reads/s" );
+	}
+}
+
+static void Bench_ArchiveExtract( const std::string& FileName )
+{
+	clPtr<ArchiveReader> Reader = new ArchiveReader();
+
+	if ( !Reader->OpenArchive( Bench_OpenFile( FileName ) ) ) { return; }
+
+	// every request should go to the archive
+	Reader->SetCacheBudget( 0 );
+
+	const char* Kinds[] = { "stored", "deflated" };
+
+	for ( int k = 0; k != 2; k++ )
+	{
+		std::vector<std::string> Names;
+
+		for ( size_t i = 0; i != Reader->GetNumFiles(); i++ )
+		{
+			if ( Reader->GetFileName( ( int )i ).find( Kinds[k] ) == 0 ) { Names.push_back( Reader->GetFileName( ( int )i ) ); }
+		}
+
+		uint64 Bytes = 0;
+
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != BENCH_ARCHIVE_ROUNDS; Round++ )
+		{
+			for ( size_t i = 0; i != Names.size(); i++ )
+			{
+				clPtr<clBlob> Data = Reader->GetFileData( Names[i] );
+
+				if ( Data ) { Bytes += Data->GetSize(); }
+			}
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		// stored files are not copied, the blobs point into the mapping of the archive
+		if ( k == 0 )
+		{
+			Bench_Report( "archive_get_stored", BENCH_ARCHIVE_ROUNDS * Names.size() / T / 1e6, "M files/s" );
+		}
+		else
+		{
+			Bench_Report( "archive_extract_deflated", Bytes / T / ( 1024.0 * 1024.0 ), "Mb/s" );
+		}
+	}
+}
+
+static void Bench_ArchiveMount( const std::string& FileName )
+{
+	const std::string IndexFileName = Bench_GetFixturePath( "mount.idx" );
+
+	remove( IndexFileName.c_str() );
+
+	// the index is validated by the archive modification time, any fixed value will do
+	const uint64 SourceTime = 1;
+
+	const char* Names[] = { "archive_mount_directory", "archive_mount_index" };
+
+	for ( int Indexed = 0; Indexed != 2; Indexed++ )
+	{
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != BENCH_ARCHIVE_ROUNDS; Round++ )
+		{
+			clPtr<ArchiveReader> Reader = new ArchiveReader();
+
+			// the first pass scans the central directory, the second maps the index saved by the first
+			Reader->OpenArchive( Bench_OpenFile( FileName ), Indexed ? IndexFileName : std::string(), SourceTime );
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		if ( !Indexed )
+		{
+			clPtr<ArchiveReader> Reader = new ArchiveReader();
+			Reader->OpenArchive( Bench_OpenFile( FileName ), IndexFileName, SourceTime );
+		}
+
+		Bench_Report( Names[ Indexed ], T / BENCH_ARCHIVE_ROUNDS * 1000.0, "ms" );
+	}
+}
+
+void Bench_Files()
+{
+	const std::string DataFile    = Bench_GetFixturePath( "data.bin" );
+	const std::string ArchiveFile = Bench_GetFixturePath( "files.zip" );
+	const std::string MountFile   = Bench_GetFixturePath( "mount.zip" );
+
+	clBenchRandom Random;
+
+	std::vector<ubyte> Data( BENCH_FILE_SIZE );
+	Bench_FillData( &Data, &Random );
+
+	if ( !Bench_WriteFile( DataFile, Data ) ||
+	     !Bench_WriteArchive( ArchiveFile, BENCH_ARCHIVE_FILES, BENCH_ARCHIVE_FILE_SIZE, true ) ||
+	     !Bench_WriteArchive( MountFile, BENCH_ARCHIVE_MOUNT_ENTRIES, 16, false ) )
+	{
+		printf( "Unable to create the fixtures in %s\n", Bench_GetFixturePath( "" ).c_str() );
+		return;
+	}
+
+	Bench_FileMapperRead( DataFile );
+	Bench_ArchiveExtract( ArchiveFile );
+	Bench_ArchiveMount( MountFile );
+}
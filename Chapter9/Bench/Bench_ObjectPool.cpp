@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "ObjectPool.h"
+#include "Event.h"
+#include "tinythread.h"
+
+const size_t BENCH_POOL_BATCH = 1000;
+const size_t BENCH_POOL_ROUNDS = 2000;
+
+/// Events posted by every producer thread
+const size_t BENCH_POOL_EVENTS = 250000;
+const size_t BENCH_POOL_PRODUCERS = 4;
+
+class clBenchCapsule: public iAsyncCapsule
+{
+public:
+	virtual void Invoke() { FValue[0]++; }
+
+	int FValue[4];
+};
+
+class clBenchPooledCapsule: public iAsyncCapsule
+{
+	L_POOLED_OBJECT( clBenchPooledCapsule )
+public:
+	virtual void Invoke() { FValue[0]++; }
+
+	int FValue[4];
+};
+
+/// Allocate a batch, free it, repeat
+template <class T> static double Bench_AllocFree()
+{
+	std::vector<T*> Objects( BENCH_POOL_BATCH );
+
+	double Time = Bench_GetSeconds();
+
+	for ( size_t Round = 0; Round != BENCH_POOL_ROUNDS; Round++ )
+	{
+		for ( size_t i = 0; i != Objects.size(); i++ ) { Objects[i] = new T(); }
+
+		for ( size_t i = 0; i != Objects.size(); i++ ) { delete( Objects[i] ); }
+	}
+
+	return BENCH_POOL_BATCH * BENCH_POOL_ROUNDS / ( Bench_GetSeconds() - Time );
+}
+
+template <class T> static void Bench_Producer( void* Queue )
+{
+	for ( size_t i = 0; i != BENCH_POOL_EVENTS; i++ )
+	{
+		static_cast<iAsyncQueue*>( Queue )->EnqueueCapsule( new T() );
+	}
+}
+
+/// Worker threads allocate capsules, the main thread invokes and frees them
+template <class T> static double Bench_Capsules()
+{
+	clPtr<iAsyncQueue> Queue = new iAsyncQueue();
+
+	const size_t Total = BENCH_POOL_EVENTS * BENCH_POOL_PRODUCERS;
+
+	double Time = Bench_GetSeconds();
+
+	std::vector<tthread::thread*> Producers;
+
+	for ( size_t i = 0; i != BENCH_POOL_PRODUCERS; i++ )
+	{
+		Producers.push_back( new tthread::thread( &Bench_Producer<T>, Queue.GetInternalPtr() ) );
+	}
+
+	for ( size_t Count = 0; Count < Total; ) { Count += Queue->DemultiplexEvents(); }
+
+	for ( size_t i = 0; i != Producers.size(); i++ )
+	{
+		Producers[i]->join();
+		delete( Producers[i] );
+	}
+
+	return Total / ( Bench_GetSeconds() - Time );
+}
+
+struct sBenchTransient
+{
+	float FRect[4];
+	int   FColor;
+};
+
+static double Bench_Arena()
+{
+	clLinearArena Arena;
+
+	double Time = Bench_GetSeconds();
+
+	for ( size_t Round = 0; Round != BENCH_POOL_ROUNDS; Round++ )
+	{
+		for ( size_t i = 0; i != BENCH_POOL_BATCH; i++ ) { Arena.New<sBenchTransient>(); }
+
+		Arena.Reset();
+	}
+
+	return BENCH_POOL_BATCH * BENCH_POOL_ROUNDS / ( Bench_GetSeconds() - Time );
+}
+
+void Bench_ObjectPool()
+{
+	Bench_Report( "pool_alloc_free_new",    Bench_AllocFree<clBenchCapsule>() / 1e6,       "M objects/s" );
+	Bench_Report( "pool_alloc_free_pooled", Bench_AllocFree<clBenchPooledCapsule>() / 1e6, "M objects/s" );
+	Bench_Report( "pool_alloc_free_arena",  Bench_Arena() / 1e6,                           "M objects/s" );
+
+	Bench_Report( "pool_capsules_new",      Bench_Capsules<clBenchCapsule>() / 1e6,       "M events/s" );
+	Bench_Report( "pool_capsules_pooled",   Bench_Capsules<clBenchPooledCapsule>() / 1e6, "M events/s" );
+
+	Bench_Report( "pool_capsules_reserved", clBenchPooledCapsule::GetObjectPool()->GetStats().FReservedBytes / 1024.0, "Kb" );
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "BoxLite.h"
+
+#include <vector>
+
+using namespace Box2D;
+
+/// Rows of the box pyramid, 20 rows make 210 boxes resting on each other
+const int BENCH_PYRAMID_ROWS = 20;
+
+/// Boxes falling through the empty space, the broad phase checks every pair of them
+const int BENCH_FALLING_BOXES = 300;
+
+const int BENCH_PHYSICS_STEPS = 300;
+
+const float BENCH_PHYSICS_DT = 1.0f / 60.0f;
+
+static Body* Bench_AddBox( World* W, std::vector<Body*>* Bodies, const Vec2& Pos, const Vec2& Size, float Mass )
+{
+	Body* B = new Body();
+	B->Set( Size, Mass );
+	B->position = Pos;
+	B->friction = 0.2f;
+
+	W->Add( B );
+	Bodies->push_back( B );
+
+	return B;
+}
+
+/// Step the world and return the number of steps per second
+static double Bench_Step( World* W )
+{
+	double T = Bench_GetSeconds();
+
+	for ( int i = 0; i != BENCH_PHYSICS_STEPS; i++ ) { W->Step( BENCH_PHYSICS_DT ); }
+
+	return BENCH_PHYSICS_STEPS / ( Bench_GetSeconds() - T );
+}
+
+void Bench_Physics()
+{
+	// a settled stack: most of the time goes to the contact arbiters and the solver iterations
+	{
+		World W( Vec2( 0.0f, -10.0f ), 10 );
+
+		std::vector<Body*> Bodies;
+
+		Bench_AddBox( &W, &Bodies, Vec2( 0.0f, -0.5f ), Vec2( 100.0f, 1.0f ), FLT_MAX );
+
+		for ( int Row = 0; Row != BENCH_PYRAMID_ROWS; Row++ )
+		{
+			for ( int i = 0; i != BENCH_PYRAMID_ROWS - Row; i++ )
+			{
+				Vec2 Pos( ( float )i * 1.125f + ( float )Row * 0.5625f - 11.0f, ( float )Row * 1.0f + 0.5f );
+
+				Bench_AddBox( &W, &Bodies, Pos, Vec2( 1.0f, 1.0f ), 1.0f );
+			}
+		}
+
+		Bench_Report( "box2d_step_pyramid", Bench_Step( &W ), "steps/s" );
+
+		for ( size_t i = 0; i != Bodies.size(); i++ ) { delete( Bodies[i] ); }
+	}
+
+	// scattered boxes in free fall: few contacts, the O(n^2) broad phase dominates
+	{
+		clBenchRandom Random;
+
+		World W( Vec2( 0.0f, -10.0f ), 10 );
+
+		std::vector<Body*> Bodies;
+
+		for ( int i = 0; i != BENCH_FALLING_BOXES; i++ )
+		{
+			Vec2 Pos( Random.NextFloat() * 200.0f - 100.0f, Random.NextFloat() * 200.0f + 10.0f );
+
+			Bench_AddBox( &W, &Bodies, Pos, Vec2( 0.5f, 0.5f ), 1.0f );
+		}
+
+		Bench_Report( "box2d_step_falling", Bench_Step( &W ), "steps/s" );
+
+		for ( size_t i = 0; i != Bodies.size(); i++ ) { delete( Bodies[i] ); }
+	}
+}
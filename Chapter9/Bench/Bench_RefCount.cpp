@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "iIntrusivePtr.h"
+
+#include <algorithm>
+#include <vector>
+
+/// Number of objects touched in a "frame", roughly the GUI geometry and text of a busy screen
+const size_t BENCH_FRAME_OBJECTS = 2000;
+const size_t BENCH_FRAMES = 500;
+
+class clBenchShared: public iObject
+{
+public:
+	clBenchShared(): FValue( 1 ) {}
+
+	int FValue;
+};
+
+class clBenchConfined: public iSingleThreadObject
+{
+public:
+	clBenchConfined(): FValue( 1 ) {}
+
+	int FValue;
+};
+
+#if defined( _MSC_VER )
+#  define BENCH_NOINLINE __declspec( noinline )
+#else
+#  define BENCH_NOINLINE __attribute__( ( noinline ) )
+#endif
+
+/// The old scheme: out-of-line calls ending in a full-barrier atomic
+BENCH_NOINLINE static void Bench_LegacyIncRef( long* Counter ) { Atomic::Inc( Counter ); }
+BENCH_NOINLINE static long Bench_LegacyDecRef( long* Counter ) { return Atomic::Dec( Counter ); }
+
+class clBenchLegacy
+{
+public:
+	clBenchLegacy(): FRefCounter( 0 ), FValue( 1 ) {}
+
+	long FRefCounter;
+	int  FValue;
+};
+
+/// clPtr as it was: no move support, every copy goes through Bench_LegacyIncRef()/Bench_LegacyDecRef()
+template <class T> class clLegacyPtr
+{
+public:
+	clLegacyPtr(): FObject( NULL ) {}
+	clLegacyPtr( T* Object ): FObject( Object ) { if ( FObject ) { Bench_LegacyIncRef( &FObject->FRefCounter ); } }
+	clLegacyPtr( const clLegacyPtr& Ptr ): FObject( Ptr.FObject ) { if ( FObject ) { Bench_LegacyIncRef( &FObject->FRefCounter ); } }
+	~clLegacyPtr() { Release(); }
+
+	clLegacyPtr& operator = ( const clLegacyPtr& Ptr )
+	{
+		if ( Ptr.FObject ) { Bench_LegacyIncRef( &Ptr.FObject->FRefCounter ); }
+
+		Release();
+		FObject = Ptr.FObject;
+
+		return *this;
+	}
+
+	T* operator -> () const { return FObject; }
+
+private:
+	void Release() { if ( FObject && Bench_LegacyDecRef( &FObject->FRefCounter ) == 0 ) { delete FObject; } }
+
+	T* FObject;
+};
+
+template <class Ptr> static int Bench_ByValue( Ptr P ) { return P->FValue; }
+
+/// A frame: pass every object by value and rebuild the draw list
+template <class Ptr> static double Bench_Frames( const std::vector<Ptr>& Objects )
+{
+	volatile int Sum = 0;
+
+	double Time = Bench_GetSeconds();
+
+	for ( size_t Frame = 0; Frame != BENCH_FRAMES; Frame++ )
+	{
+		for ( size_t i = 0; i != Objects.size(); i++ ) { Sum += Bench_ByValue( Objects[i] ); }
+
+		// no reserve(), the growth copies or moves the references
+		std::vector<Ptr> DrawList;
+
+		for ( size_t i = 0; i != Objects.size(); i++ ) { DrawList.push_back( Objects[i] ); }
+
+		std::reverse( DrawList.begin(), DrawList.end() );
+	}
+
+	return ( Bench_GetSeconds() - Time ) / BENCH_FRAMES;
+}
+
+template <class T, class Ptr> static void Bench_RefCountFrames( const char* Name )
+{
+	std::vector<Ptr> Objects;
+
+	for ( size_t i = 0; i != BENCH_FRAME_OBJECTS; i++ ) { Objects.push_back( Ptr( new T() ) ); }
+
+	Bench_Report( Name, Bench_Frames( Objects ) * 1e6, "us/frame" );
+}
+
+void Bench_RefCount()
+{
+	Bench_RefCountFrames< clBenchLegacy,   clLegacyPtr<clBenchLegacy> >( "refcount_frame_legacy" );
+	Bench_RefCountFrames< clBenchShared,   clPtr<clBenchShared>       >( "refcount_frame_atomic" );
+	Bench_RefCountFrames< clBenchConfined, clPtr<clBenchConfined>     >( "refcount_frame_single_thread" );
+}
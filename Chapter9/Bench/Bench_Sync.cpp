@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "Sync.h"
+#include "tinythread.h"
+
+const int BENCH_ROUND_TRIPS = 20000;
+const int BENCH_HANDOFFS    = 200000;
+
+struct sBenchEventPair
+{
+	sBenchEventPair(): FPing( false ), FPong( false ) {}
+
+	clEvent FPing;
+	clEvent FPong;
+};
+
+static void Bench_EventPong( void* Param )
+{
+	sBenchEventPair* Pair = reinterpret_cast<sBenchEventPair*>( Param );
+
+	for ( int i = 0; i != BENCH_ROUND_TRIPS; i++ )
+	{
+		Pair->FPing.Wait();
+		Pair->FPong.Signal();
+	}
+}
+
+/// The way the worker threads wake each other: a flag guarded by a mutex and a condition variable
+struct sBenchConditionPair
+{
+	sBenchConditionPair(): FTurn( 0 ) {}
+
+	tthread::mutex              FMutex;
+	tthread::condition_variable FCondition;
+	int                         FTurn;
+
+	void Pass( int From, int To )
+	{
+		tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+		while ( FTurn != From ) { FCondition.wait( FMutex ); }
+
+		FTurn = To;
+		FCondition.notify_all();
+	}
+};
+
+static void Bench_ConditionPong( void* Param )
+{
+	sBenchConditionPair* Pair = reinterpret_cast<sBenchConditionPair*>( Param );
+
+	for ( int i = 0; i != BENCH_ROUND_TRIPS; i++ ) { Pair->Pass( 1, 0 ); }
+}
+
+static void Bench_SemaphoreConsumer( void* Param )
+{
+	clSemaphore* Semaphore = reinterpret_cast<clSemaphore*>( Param );
+
+	for ( int i = 0; i != BENCH_HANDOFFS; i++ ) { Semaphore->Wait(); }
+}
+
+void Bench_Sync()
+{
+	{
+		sBenchEventPair Pair;
+
+		tthread::thread Pong( &Bench_EventPong, &Pair );
+
+		double T = Bench_GetSeconds();
+
+		for ( int i = 0; i != BENCH_ROUND_TRIPS; i++ )
+		{
+			Pair.FPing.Signal();
+			Pair.FPong.Wait();
+		}
+
+		// a round trip is two wake-ups
+		Bench_Report( "sync_wake_latency_event", ( Bench_GetSeconds() - T ) / ( 2 * BENCH_ROUND_TRIPS ) * 1e6, "us" );
+
+		Pong.join();
+	}
+
+	{
+		sBenchConditionPair Pair;
+
+		tthread::thread Pong( &Bench_ConditionPong, &Pair );
+
+		double T = Bench_GetSeconds();
+
+		for ( int i = 0; i != BENCH_ROUND_TRIPS; i++ ) { Pair.Pass( 0, 1 ); }
+
+		Bench_Report( "sync_wake_latency_condition", ( Bench_GetSeconds() - T ) / ( 2 * BENCH_ROUND_TRIPS ) * 1e6, "us" );
+
+		Pong.join();
+	}
+
+	{
+		clSemaphore Semaphore;
+
+		tthread::thread Consumer( &Bench_SemaphoreConsumer, &Semaphore );
+
+		double T = Bench_GetSeconds();
+
+		for ( int i = 0; i != BENCH_HANDOFFS; i++ ) { Semaphore.Post(); }
+
+		Consumer.join();
+
+		Bench_Report( "sync_semaphore_handoff", BENCH_HANDOFFS / ( Bench_GetSeconds() - T ) / 1e6, "M ops/s" );
+	}
+}
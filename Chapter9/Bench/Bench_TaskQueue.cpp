@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "WorkerThread.h"
+#include "ThreadPool.h"
+
+#include <list>
+#include <stdlib.h>
+
+const size_t BENCH_TASKS = 100000;
+
+/// Number of cancel, re-prioritize and extract operations measured on the linear queue
+const size_t BENCH_TASK_OPS = 1000;
+
+class clBenchTask: public iTask
+{
+public:
+	explicit clBenchTask( volatile long* Counter ): FCounter( Counter ) {}
+
+	virtual void Run() { Atomic::Inc( FCounter ); }
+
+private:
+	volatile long* FCounter;
+};
+
+static std::vector< clPtr<iTask> > Bench_MakeTasks( volatile long* Counter )
+{
+	std::vector< clPtr<iTask> > Tasks( BENCH_TASKS );
+
+	clBenchRandom Random;
+
+	for ( size_t i = 0; i != BENCH_TASKS; i++ )
+	{
+		Tasks[i] = new clBenchTask( Counter );
+		Tasks[i]->SetTaskID( i + 1 );
+		Tasks[i]->SetPriority( Random.Next() % 16 );
+	}
+
+	return Tasks;
+}
+
+/// The old clWorkerThread policy: a list scanned on every extraction, cancellation and priority change
+static void Bench_TaskQueueLinear( const std::vector< clPtr<iTask> >& Tasks )
+{
+	std::list< clPtr<iTask> > Queue;
+
+	double T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != Tasks.size(); i++ ) { Queue.push_back( Tasks[i] ); }
+
+	Bench_Report( "task_queue_linear_push", Tasks.size() / ( Bench_GetSeconds() - T ) / 1e6, "M ops/s" );
+
+	T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != BENCH_TASK_OPS; i++ )
+	{
+		size_t ID = ( i * 97 ) % Tasks.size() + 1;
+
+		for ( std::list< clPtr<iTask> >::iterator j = Queue.begin(); j != Queue.end(); ++j )
+		{
+			if ( ( *j )->GetTaskID() == ID ) { Queue.erase( j ); break; }
+		}
+	}
+
+	Bench_Report( "task_queue_linear_cancel", BENCH_TASK_OPS / ( Bench_GetSeconds() - T ) / 1e3, "K ops/s" );
+
+	T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != BENCH_TASK_OPS; i++ )
+	{
+		std::list< clPtr<iTask> >::iterator Best = Queue.begin();
+
+		for ( std::list< clPtr<iTask> >::iterator j = Queue.begin(); j != Queue.end(); ++j )
+		{
+			if ( ( *j )->GetPriority() > ( *Best )->GetPriority() ) { Best = j; }
+		}
+
+		Queue.erase( Best );
+	}
+
+	Bench_Report( "task_queue_linear_extract", BENCH_TASK_OPS / ( Bench_GetSeconds() - T ) / 1e3, "K ops/s" );
+}
+
+static void Bench_TaskQueueHeap( const std::vector< clPtr<iTask> >& Tasks )
+{
+	clTaskQueue Queue;
+
+	double T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != Tasks.size(); i++ ) { Queue.Push( Tasks[i] ); }
+
+	Bench_Report( "task_queue_heap_push", Tasks.size() / ( Bench_GetSeconds() - T ) / 1e6, "M ops/s" );
+
+	T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != BENCH_TASK_OPS; i++ ) { Queue.Cancel( ( i * 97 ) % Tasks.size() + 1 ); }
+
+	Bench_Report( "task_queue_heap_cancel", BENCH_TASK_OPS / ( Bench_GetSeconds() - T ) / 1e3, "K ops/s" );
+
+	T = Bench_GetSeconds();
+
+	for ( size_t i = 0; i != BENCH_TASK_OPS; i++ ) { Queue.SetPriority( ( i * 89 ) % Tasks.size() + 1, 16 + i % 4 ); }
+
+	Bench_Report( "task_queue_heap_reprioritize", BENCH_TASK_OPS / ( Bench_GetSeconds() - T ) / 1e3, "K ops/s" );
+
+	size_t Count = Queue.GetSize();
+
+	T = Bench_GetSeconds();
+
+	while ( !Queue.IsEmpty() ) { Queue.Pop(); }
+
+	Bench_Report( "task_queue_heap_extract", Count / ( Bench_GetSeconds() - T ) / 1e3, "K ops/s" );
+}
+
+/// Wait until all tasks have been run
+static void Bench_WaitForTasks( volatile long* Counter, long Expected )
+{
+	while ( *Counter < Expected ) { tthread::this_thread::sleep_for( tthread::chrono::milliseconds( 1 ) ); }
+}
+
+/// 100k empty tasks through the real schedulers, this measures the queue and lock overhead per task
+static void Bench_TaskThroughput()
+{
+	volatile long Counter = 0;
+
+	{
+		std::vector< clPtr<iTask> > Tasks = Bench_MakeTasks( &Counter );
+
+		clPtr<clWorkerThread> Worker = new clWorkerThread();
+		Worker->Start( iThread::Priority_Normal );
+
+		double T = Bench_GetSeconds();
+
+		for ( size_t i = 0; i != Tasks.size(); i++ ) { Worker->AddTask( Tasks[i] ); }
+
+		Bench_WaitForTasks( &Counter, BENCH_TASKS );
+
+		Bench_Report( "task_worker_thread_throughput", BENCH_TASKS / ( Bench_GetSeconds() - T ) / 1e3, "K tasks/s" );
+
+		Worker->Exit( true );
+	}
+
+	Counter = 0;
+
+	{
+		std::vector< clPtr<iTask> > Tasks = Bench_MakeTasks( &Counter );
+
+		clPtr<clThreadPool> Pool = new clThreadPool();
+		Pool->Start( iThread::Priority_Normal );
+
+		double T = Bench_GetSeconds();
+
+		for ( size_t i = 0; i != Tasks.size(); i++ ) { Pool->AddTask( Tasks[i] ); }
+
+		Bench_WaitForTasks( &Counter, BENCH_TASKS );
+
+		Bench_Report( "task_thread_pool_throughput", BENCH_TASKS / ( Bench_GetSeconds() - T ) / 1e3, "K tasks/s" );
+
+		Pool->Exit( true );
+	}
+}
+
+void Bench_TaskQueue()
+{
+	volatile long Counter = 0;
+
+	std::vector< clPtr<iTask> > Tasks = Bench_MakeTasks( &Counter );
+
+	Bench_TaskQueueLinear( Tasks );
+	Bench_TaskQueueHeap( Tasks );
+	Bench_TaskThroughput();
+}
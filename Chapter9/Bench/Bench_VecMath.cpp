@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "VecMath.h"
+
+#include <vector>
+
+/// Enough matrices to stay in L1, like the transforms of a scene
+const size_t BENCH_MATRICES = 256;
+
+const int BENCH_MATRIX_ROUNDS = 4000;
+
+static LMatrix4 Bench_RandomMatrix( clBenchRandom* Random )
+{
+	LMatrix4 M;
+
+	float* F = M.ToFloatPtr();
+
+	for ( int i = 0; i != 16; i++ ) { F[i] = Random->NextFloat() * 2.0f - 1.0f; }
+
+	return M;
+}
+
+void Bench_VecMath()
+{
+	clBenchRandom Random;
+
+	std::vector<LMatrix4> Matrices( BENCH_MATRICES );
+
+	for ( size_t i = 0; i != Matrices.size(); i++ ) { Matrices[i] = Bench_RandomMatrix( &Random ); }
+
+	// chained products, each depends on the previous one like a transform hierarchy
+	{
+		LMatrix4 Result = LMatrix4::Identity();
+
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != BENCH_MATRIX_ROUNDS; Round++ )
+		{
+			for ( size_t i = 0; i != Matrices.size(); i++ )
+			{
+				Result = Result * Matrices[i];
+
+				// keep the values finite
+				if ( ( i & 15 ) == 15 ) { Result = Matrices[i]; }
+			}
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		volatile float Sink = Result[0][0];
+		( void )Sink;
+
+		Bench_Report( "matrix4_multiply_chain", static_cast<double>( BENCH_MATRIX_ROUNDS ) * BENCH_MATRICES / T / 1e6, "M mul/s" );
+	}
+
+	// independent products, like MV * Proj for every object
+	{
+		std::vector<LMatrix4> Results( BENCH_MATRICES );
+
+		const LMatrix4 Proj = Bench_RandomMatrix( &Random );
+
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != BENCH_MATRIX_ROUNDS; Round++ )
+		{
+			for ( size_t i = 0; i != Matrices.size(); i++ ) { Results[i] = Matrices[i] * Proj; }
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		volatile float Sink = Results[ BENCH_MATRICES - 1 ][0][0];
+		( void )Sink;
+
+		Bench_Report( "matrix4_multiply_batch", static_cast<double>( BENCH_MATRIX_ROUNDS ) * BENCH_MATRICES / T / 1e6, "M mul/s" );
+	}
+
+	// transforming vertices
+	{
+		std::vector<LVector4> Vertices( 4096 );
+
+		for ( size_t i = 0; i != Vertices.size(); i++ ) { Vertices[i] = LVector4( Random.NextFloat(), Random.NextFloat(), Random.NextFloat(), 1.0f ); }
+
+		const LMatrix4 MVP = Bench_RandomMatrix( &Random );
+
+		LVector4 Sum( 0.0f );
+
+		double T = Bench_GetSeconds();
+
+		for ( int Round = 0; Round != BENCH_MATRIX_ROUNDS / 16; Round++ )
+		{
+			for ( size_t i = 0; i != Vertices.size(); i++ ) { Sum += MVP * Vertices[i]; }
+		}
+
+		T = Bench_GetSeconds() - T;
+
+		volatile float Sink = Sum.x;
+		( void )Sink;
+
+		Bench_Report( "matrix4_transform_vec4", static_cast<double>( BENCH_MATRIX_ROUNDS / 16 ) * Vertices.size() / T / 1e6, "M vertices/s" );
+	}
+}
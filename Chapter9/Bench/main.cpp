@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bench.h"
+#include "BenchResults.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct sBenchSuite
+{
+	const char* FName;
+	void ( *FRun )();
+};
+
+static const sBenchSuite g_Suites[] =
+{
+	{ "blob",       &Bench_Blob       },
+	{ "taskqueue",  &Bench_TaskQueue  },
+	{ "refcount",   &Bench_RefCount   },
+	{ "objectpool", &Bench_ObjectPool },
+	{ "files",      &Bench_Files      },
+	{ "bitmap",     &Bench_Bitmap     },
+	{ "vecmath",    &Bench_VecMath    },
+	{ "sync",       &Bench_Sync       },
+	{ "physics",    &Bench_Physics    },
+};
+
+/// Default regression threshold for --compare, percent
+const double BENCH_DEFAULT_THRESHOLD = 10.0;
+
+static void PrintUsage()
+{
+	printf( "Usage: bench [options] [suite...]\n\n" );
+	printf( "  --json FILE         save the results in JSON\n" );
+	printf( "  --compare FILE      compare with the results saved by --json, the exit code is 1 if anything regressed\n" );
+	printf( "  --threshold PERCENT allowed slowdown for --compare (default %.0f)\n", BENCH_DEFAULT_THRESHOLD );
+	printf( "  --repeat N          run every suite N times and keep the best values\n" );
+	printf( "  --fixtures DIR      directory for the generated test files\n" );
+	printf( "  --list              list the suites\n\n" );
+	printf( "All the suites are run if none is given\n" );
+}
+
+int main( int argc, char** argv )
+{
+	std::string JSONFileName;
+	std::string BaselineFileName;
+	double Threshold = BENCH_DEFAULT_THRESHOLD;
+	int Repeat = 1;
+
+	std::vector<std::string> Selected;
+
+	for ( int i = 1; i < argc; i++ )
+	{
+		bool HasValue = ( i + 1 < argc );
+
+		if ( !strcmp( argv[i], "--json" ) && HasValue )
+		{
+			JSONFileName = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "--compare" ) && HasValue )
+		{
+			BaselineFileName = argv[++i];
+		}
+		else if ( !strcmp( argv[i], "--threshold" ) && HasValue )
+		{
+			Threshold = atof( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "--repeat" ) && HasValue )
+		{
+			Repeat = std::max( atoi( argv[++i] ), 1 );
+		}
+		else if ( !strcmp( argv[i], "--fixtures" ) && HasValue )
+		{
+			Bench_SetFixtureDir( argv[++i] );
+		}
+		else if ( !strcmp( argv[i], "--list" ) )
+		{
+			for ( size_t j = 0; j != sizeof( g_Suites ) / sizeof( g_Suites[0] ); j++ ) { printf( "%s\n", g_Suites[j].FName ); }
+
+			return 0;
+		}
+		else if ( argv[i][0] == '-' )
+		{
+			PrintUsage();
+			return 2;
+		}
+		else
+		{
+			Selected.push_back( argv[i] );
+		}
+	}
+
+	// load the baseline before spending time on the benchmarks
+	std::vector<sBenchResult> Baseline;
+
+	if ( !BaselineFileName.empty() && !Bench_LoadResults( BaselineFileName, &Baseline ) )
+	{
+		printf( "Unable to load the baseline %s\n", BaselineFileName.c_str() );
+		return 2;
+	}
+
+	printf( "Engine benchmarks\n\n" );
+
+	for ( int Pass = 0; Pass != Repeat; Pass++ )
+	{
+		for ( size_t i = 0; i != sizeof( g_Suites ) / sizeof( g_Suites[0] ); i++ )
+		{
+			if ( !Selected.empty() && std::find( Selected.begin(), Selected.end(), g_Suites[i].FName ) == Selected.end() ) { continue; }
+
+			g_Suites[i].FRun();
+		}
+	}
+
+	if ( !JSONFileName.empty() && !Bench_SaveResults( JSONFileName, Bench_GetResults() ) )
+	{
+		printf( "Unable to save the results to %s\n", JSONFileName.c_str() );
+		return 2;
+	}
+
+	if ( !BaselineFileName.empty() && Bench_CompareResults( Baseline, Bench_GetResults(), Threshold ) > 0 ) { return 1; }
+
+	return 0;
+}
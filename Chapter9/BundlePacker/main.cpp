@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bundle.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined( _WIN32 )
+#  include <windows.h>
+#else
+#  include <dirent.h>
+#  include <sys/stat.h>
+#endif
+
+// the packer does not link Archive.cpp, but libcompress still needs the bzip2 error handler
+extern "C" void bz_internal_error( int e_code ) { ( void )e_code; }
+
+static bool IsDirectory( const std::string& Path )
+{
+#if defined( _WIN32 )
+	DWORD Attr = GetFileAttributesA( Path.c_str() );
+	return ( Attr != INVALID_FILE_ATTRIBUTES ) && ( Attr & FILE_ATTRIBUTE_DIRECTORY );
+#else
+	struct stat buf;
+	return ( stat( Path.c_str(), &buf ) == 0 ) && S_ISDIR( buf.st_mode );
+#endif
+}
+
+/// Collect all files under Path. Names are relative to the root of the walk
+static void CollectFiles( const std::string& Path, const std::string& Prefix, std::vector<std::string>* Names )
+{
+	if ( !IsDirectory( Path ) )
+	{
+		Names->push_back( Prefix );
+		return;
+	}
+
+	std::vector<std::string> Items;
+
+#if defined( _WIN32 )
+	WIN32_FIND_DATAA FD;
+	HANDLE H = FindFirstFileA( ( Path + "\\*" ).c_str(), &FD );
+
+	if ( H == INVALID_HANDLE_VALUE ) { return; }
+
+	do { Items.push_back( FD.cFileName ); }
+	while ( FindNextFileA( H, &FD ) );
+
+	FindClose( H );
+#else
+	DIR* D = opendir( Path.c_str() );
+
+	if ( !D ) { return; }
+
+	while ( struct dirent* E = readdir( D ) ) { Items.push_back( E->d_name ); }
+
+	closedir( D );
+#endif
+
+	for ( size_t i = 0; i != Items.size(); i++ )
+	{
+		if ( Items[i] == "." || Items[i] == ".." ) { continue; }
+
+		CollectFiles( Path + "/" + Items[i], Prefix.empty() ? Items[i] : Prefix + "/" + Items[i], Names );
+	}
+}
+
+static clPtr<clBlob> LoadFile( const std::string& FileName )
+{
+	FILE* F = fopen( FileName.c_str(), "rb" );
+
+	if ( !F ) { return NULL; }
+
+	fseek( F, 0, SEEK_END );
+	long Size = ftell( F );
+	fseek( F, 0, SEEK_SET );
+
+	clPtr<clBlob> Blob = new clBlob();
+	Blob->SetSize( static_cast<size_t>( Size ) );
+
+	bool Ok = Size == 0 || fread( Blob->GetData(), static_cast<size_t>( Size ), 1, F ) == 1;
+
+	fclose( F );
+
+	return Ok ? Blob : NULL;
+}
+
+static bool ParseCompression( const char* Name, LBundleCompression* Out )
+{
+	if ( !strcmp( Name, "none"    ) ) { *Out = BundleCompression_None;    return true; }
+	if ( !strcmp( Name, "lz4"     ) ) { *Out = BundleCompression_LZ4;     return true; }
+	if ( !strcmp( Name, "deflate" ) ) { *Out = BundleCompression_Deflate; return true; }
+
+	return false;
+}
+
+int main( int argc, char** argv )
+{
+	if ( argc < 3 )
+	{
+		printf( "Usage: BundlePacker <out.bundle> [-c none|lz4|deflate] <file or folder> ...\n" );
+		printf( "Folders are packed recursively, names are stored relative to the folder\n" );
+		return 1;
+	}
+
+	clBundleWriter Writer;
+
+	size_t NumFiles = 0;
+	uint64 TotalSize = 0;
+
+	for ( int i = 2; i < argc; i++ )
+	{
+		if ( !strcmp( argv[i], "-c" ) && i + 1 < argc )
+		{
+			LBundleCompression C;
+
+			if ( !ParseCompression( argv[++i], &C ) )
+			{
+				printf( "Unknown compression: %s\n", argv[i] );
+				return 1;
+			}
+
+			Writer.SetDefaultCompression( C );
+			continue;
+		}
+
+		std::string Root( argv[i] );
+
+		std::vector<std::string> Names;
+		CollectFiles( Root, IsDirectory( Root ) ? "" : Root, &Names );
+
+		for ( size_t j = 0; j != Names.size(); j++ )
+		{
+			std::string Path = IsDirectory( Root ) ? Root + "/" + Names[j] : Root;
+
+			clPtr<clBlob> Data = LoadFile( Path );
+
+			if ( !Data )
+			{
+				printf( "Unable to read %s\n", Path.c_str() );
+				return 1;
+			}
+
+			Writer.AddFile( Names[j], Data );
+
+			NumFiles++;
+			TotalSize += Data->GetSize();
+		}
+	}
+
+	if ( !Writer.Save( argv[1] ) )
+	{
+		printf( "Unable to write %s\n", argv[1] );
+		return 1;
+	}
+
+	printf( "Packed %u files (%llu bytes) into %s\n", ( unsigned int )NumFiles, ( unsigned long long )TotalSize, argv[1] );
+
+	return 0;
+}
@@ -72,6 +72,7 @@ static const int BUFFER = 255;
 
 #include "Bitmap.h"
 #include "FI_Utils.h"
+#include "Profiler.h"
 
 const unsigned usec_per_sec = 1000000;
 
@@ -147,11 +148,19 @@ void GenerateTicks()
 
 	while ( ExecutionTime > TIME_QUANTUM )
 	{
+		L_PROFILE_ZONE( "OnTimer" );
+
 		ExecutionTime -= TIME_QUANTUM;
 		OnTimer( TIME_QUANTUM );
 	}
 
-	OnDrawFrame();
+	{
+		L_PROFILE_ZONE( "OnDrawFrame" );
+
+		OnDrawFrame();
+	}
+
+	if ( Profiler_Get().IsEnabled() ) { Profiler_Get().EndFrame(); }
 }
 
 void Str_AddTrailingChar( std::string* Str, char Ch )
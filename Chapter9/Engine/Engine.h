@@ -57,6 +57,9 @@
 #include "Gestures.h"
 #include "TextRenderer.h"
 #include "GUI.h"
+#include "Profiler.h"
+#include "ProfilerOverlay.h"
+#include "ObjectPool.h"
 #include "iIntrusivePtr.h"
 
 #include <string>
@@ -0,0 +1,490 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ObjectPool.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+#if defined( ANDROID )
+#  include "Wrapper_Android.h"
+#else
+#  include <stdio.h>
+#  define LOGI(...) printf(__VA_ARGS__)
+#endif
+
+/// Number of blocks moved between a thread cache and the shared stack at once
+const size_t OBJECT_POOL_BATCH = 32;
+
+/// Memory requested from the system at once, at least OBJECT_POOL_BATCH blocks
+const size_t OBJECT_POOL_CHUNK_SIZE = 64 * 1024;
+
+/// Free blocks (in chunks) which can pile up in the shared stack before the empty chunks are released
+const size_t OBJECT_POOL_TRIM_CHUNKS = 4;
+
+static clMutex* ObjectPool_RegistryMutex()
+{
+	// never destroyed, the pools outlive the static objects
+	static clMutex* Mutex = new clMutex();
+	return Mutex;
+}
+
+static std::vector<clObjectPool*>& ObjectPool_Registry()
+{
+	static std::vector<clObjectPool*>* Pools = new std::vector<clObjectPool*>();
+	return *Pools;
+}
+
+static inline void*& NextBlock( void* Block ) { return *static_cast<void**>( Block ); }
+
+/// Valid in the first block of a chain sitting in the shared stack
+static inline void*&  NextChain( void* Block )   { return static_cast<void**>( Block )[1]; }
+static inline size_t& ChainLength( void* Block ) { return *reinterpret_cast<size_t*>( static_cast<void**>( Block ) + 2 ); }
+
+#if defined( _WIN32 )
+static VOID WINAPI ObjectPool_FlsCallback( PVOID Cache )
+{
+	if ( Cache ) { clObjectPool::ThreadExit( Cache ); }
+}
+#endif
+
+clObjectPool* clObjectPool::Create( const char* Name, size_t BlockSize )
+{
+	clObjectPool* Pool = new clObjectPool( Name, BlockSize );
+
+	LMutex Lock( ObjectPool_RegistryMutex() );
+
+	ObjectPool_Registry().push_back( Pool );
+
+	return Pool;
+}
+
+clObjectPool::clObjectPool( const char* Name, size_t BlockSize )
+	: FName( Name )
+	, FBlockSize( ( std::max( BlockSize, 3 * sizeof( void* ) ) + 15 ) & ~static_cast<size_t>( 15 ) )
+	, FSharedChains( NULL )
+	, FSharedBlocks( 0 )
+	, FRetiredAllocated( 0 )
+	, FRetiredFreed( 0 )
+	, FRefills( 0 )
+	, FFallbackAllocated( 0 )
+	, FFallbackFreed( 0 )
+{
+	FBlocksPerChunk = std::max( OBJECT_POOL_CHUNK_SIZE / FBlockSize, OBJECT_POOL_BATCH );
+	FTrimThreshold  = OBJECT_POOL_TRIM_CHUNKS * FBlocksPerChunk;
+
+#if defined( _WIN32 )
+	// unlike TLS, fiber-local storage calls back when a thread exits
+	FTLSIndex = FlsAlloc( &ObjectPool_FlsCallback );
+#else
+	pthread_key_create( &FTLSKey, &ThreadExit );
+#endif
+}
+
+clObjectPool::sThreadCache* clObjectPool::GetThreadCache()
+{
+#if defined( _WIN32 )
+	sThreadCache* Cache = static_cast<sThreadCache*>( FlsGetValue( FTLSIndex ) );
+#else
+	sThreadCache* Cache = static_cast<sThreadCache*>( pthread_getspecific( FTLSKey ) );
+#endif
+
+	if ( Cache ) { return Cache; }
+
+	Cache = new sThreadCache();
+	Cache->FPool      = this;
+	Cache->FFree      = NULL;
+	Cache->FCount     = 0;
+	Cache->FAllocated = 0;
+	Cache->FFreed     = 0;
+
+	{
+		LMutex Lock( &FMutex );
+
+		FCaches.push_back( Cache );
+	}
+
+#if defined( _WIN32 )
+	FlsSetValue( FTLSIndex, Cache );
+#else
+	pthread_setspecific( FTLSKey, Cache );
+#endif
+
+	return Cache;
+}
+
+void* clObjectPool::Alloc( size_t Size )
+{
+	if ( Size > FBlockSize )
+	{
+		Atomic::Add( &FFallbackAllocated, 1 );
+
+		return ::operator new( Size );
+	}
+
+	sThreadCache* Cache = GetThreadCache();
+
+	if ( !Cache->FFree ) { Refill( Cache ); }
+
+	void* Block = Cache->FFree;
+
+	Cache->FFree = NextBlock( Block );
+	Cache->FCount--;
+	Cache->FAllocated++;
+
+	return Block;
+}
+
+void clObjectPool::Free( void* Ptr, size_t Size )
+{
+	if ( !Ptr ) { return; }
+
+	if ( Size > FBlockSize )
+	{
+		Atomic::Add( &FFallbackFreed, 1 );
+
+		::operator delete( Ptr );
+		return;
+	}
+
+	sThreadCache* Cache = GetThreadCache();
+
+	NextBlock( Ptr ) = Cache->FFree;
+
+	Cache->FFree = Ptr;
+	Cache->FCount++;
+	Cache->FFreed++;
+
+	// a thread which only frees (e.g. the consumer of the events) would hoard the blocks otherwise
+	if ( Cache->FCount > 2 * OBJECT_POOL_BATCH ) { Drain( Cache, OBJECT_POOL_BATCH ); }
+}
+
+void clObjectPool::Refill( sThreadCache* Cache )
+{
+	LMutex Lock( &FMutex );
+
+	FRefills++;
+
+	if ( !FSharedChains ) { AddChunkLocked(); }
+
+	void* Chain = FSharedChains;
+
+	FSharedChains  = NextChain( Chain );
+	FSharedBlocks -= ChainLength( Chain );
+
+	// the thread cache is empty, the chain becomes its free list
+	Cache->FFree  = Chain;
+	Cache->FCount = ChainLength( Chain );
+}
+
+void clObjectPool::Drain( sThreadCache* Cache, size_t Keep )
+{
+	if ( Cache->FCount <= Keep ) { return; }
+
+	size_t Count = Cache->FCount - Keep;
+
+	// detach the chain before taking the lock
+	void* Chain = Cache->FFree;
+	void* Last  = Chain;
+
+	for ( size_t i = 1; i != Count; i++ ) { Last = NextBlock( Last ); }
+
+	Cache->FFree  = NextBlock( Last );
+	Cache->FCount = Keep;
+
+	NextBlock( Last ) = NULL;
+
+	LMutex Lock( &FMutex );
+
+	PushChainLocked( Chain, Count );
+
+	// when almost every block is back, e.g. after a burst, trim right away instead of waiting for the threshold
+	bool Idle = FChunks.size() > OBJECT_POOL_TRIM_CHUNKS &&
+	            FSharedBlocks + 2 * OBJECT_POOL_BATCH * FCaches.size() >= FChunks.size() * FBlocksPerChunk;
+
+	if ( Idle || FSharedBlocks > FTrimThreshold ) { TrimLocked(); }
+}
+
+void clObjectPool::PushChainLocked( void* Chain, size_t Count )
+{
+	NextChain( Chain )   = FSharedChains;
+	ChainLength( Chain ) = Count;
+
+	FSharedChains  = Chain;
+	FSharedBlocks += Count;
+}
+
+void clObjectPool::AddChunkLocked()
+{
+	ubyte* Chunk = static_cast<ubyte*>( ::malloc( FBlocksPerChunk * FBlockSize ) );
+
+	if ( !Chunk ) { throw std::bad_alloc(); }
+
+	FChunks.insert( std::upper_bound( FChunks.begin(), FChunks.end(), static_cast<void*>( Chunk ) ), Chunk );
+
+	for ( size_t First = 0; First < FBlocksPerChunk; First += OBJECT_POOL_BATCH )
+	{
+		size_t Count = std::min( OBJECT_POOL_BATCH, FBlocksPerChunk - First );
+
+		for ( size_t i = 0; i != Count; i++ )
+		{
+			NextBlock( Chunk + ( First + i ) * FBlockSize ) = ( i + 1 != Count ) ? Chunk + ( First + i + 1 ) * FBlockSize : NULL;
+		}
+
+		PushChainLocked( Chunk + First * FBlockSize, Count );
+	}
+}
+
+void clObjectPool::TrimLocked()
+{
+	// chunk of every free block
+	std::vector< std::pair<void*, size_t> > Blocks;
+	Blocks.reserve( FSharedBlocks );
+
+	std::vector<size_t> FreeBlocks( FChunks.size(), 0 );
+
+	for ( void* Chain = FSharedChains; Chain; Chain = NextChain( Chain ) )
+	{
+		for ( void* Block = Chain; Block; Block = NextBlock( Block ) )
+		{
+			size_t Chunk = ( std::upper_bound( FChunks.begin(), FChunks.end(), Block ) - FChunks.begin() ) - 1;
+
+			FreeBlocks[ Chunk ]++;
+			Blocks.push_back( std::make_pair( Block, Chunk ) );
+		}
+	}
+
+	FSharedChains = NULL;
+	FSharedBlocks = 0;
+
+	void*  Chain = NULL;
+	size_t Count = 0;
+
+	for ( size_t i = 0; i != Blocks.size(); i++ )
+	{
+		if ( FreeBlocks[ Blocks[i].second ] == FBlocksPerChunk ) { continue; }
+
+		NextBlock( Blocks[i].first ) = Chain;
+		Chain = Blocks[i].first;
+
+		if ( ++Count == OBJECT_POOL_BATCH )
+		{
+			PushChainLocked( Chain, Count );
+			Chain = NULL;
+			Count = 0;
+		}
+	}
+
+	if ( Chain ) { PushChainLocked( Chain, Count ); }
+
+	std::vector<void*> Chunks;
+
+	for ( size_t i = 0; i != FChunks.size(); i++ )
+	{
+		if ( FreeBlocks[i] == FBlocksPerChunk ) { ::free( FChunks[i] ); }
+		else { Chunks.push_back( FChunks[i] ); }
+	}
+
+	FChunks.swap( Chunks );
+
+	// the blocks which stay are in use somewhere, do not rescan them until the stack has grown enough
+	FTrimThreshold = std::max( 2 * FSharedBlocks, OBJECT_POOL_TRIM_CHUNKS * FBlocksPerChunk );
+}
+
+void clObjectPool::RetireCache( sThreadCache* Cache )
+{
+	Drain( Cache, 0 );
+
+	LMutex Lock( &FMutex );
+
+	FRetiredAllocated += Cache->FAllocated;
+	FRetiredFreed     += Cache->FFreed;
+
+	FCaches.erase( std::remove( FCaches.begin(), FCaches.end(), Cache ), FCaches.end() );
+
+	delete( Cache );
+}
+
+void clObjectPool::ThreadExit( void* Cache )
+{
+	sThreadCache* C = static_cast<sThreadCache*>( Cache );
+
+	C->FPool->RetireCache( C );
+}
+
+sObjectPoolStats clObjectPool::GetStats() const
+{
+	LMutex Lock( &FMutex );
+
+	sObjectPoolStats Stats;
+
+	Stats.FName      = FName;
+	Stats.FBlockSize = FBlockSize;
+	Stats.FAllocated = FRetiredAllocated;
+	Stats.FFreed     = FRetiredFreed;
+
+	// the counters of the running threads are read without synchronization, good enough for statistics
+	for ( size_t i = 0; i != FCaches.size(); i++ )
+	{
+		Stats.FAllocated += FCaches[i]->FAllocated;
+		Stats.FFreed     += FCaches[i]->FFreed;
+	}
+
+	Stats.FFallbackAllocated = FFallbackAllocated;
+	Stats.FAllocated += FFallbackAllocated;
+	Stats.FFreed     += FFallbackFreed;
+	Stats.FLive       = Stats.FAllocated - Stats.FFreed;
+	Stats.FRefills    = FRefills;
+	Stats.FReservedBytes = FChunks.size() * FBlocksPerChunk * FBlockSize;
+
+	return Stats;
+}
+
+void clObjectPool::GetAllStats( std::vector<sObjectPoolStats>* Stats )
+{
+	LMutex Lock( ObjectPool_RegistryMutex() );
+
+	const std::vector<clObjectPool*>& Pools = ObjectPool_Registry();
+
+	Stats->resize( Pools.size() );
+
+	for ( size_t i = 0; i != Pools.size(); i++ ) { ( *Stats )[i] = Pools[i]->GetStats(); }
+}
+
+size_t clObjectPool::ReportLeaks()
+{
+	std::vector<sObjectPoolStats> Stats;
+
+	GetAllStats( &Stats );
+
+	size_t Live = 0;
+
+	for ( size_t i = 0; i != Stats.size(); i++ )
+	{
+		const sObjectPoolStats& S = Stats[i];
+
+		if ( S.FLive == 0 ) { continue; }
+
+		LOGI( "WARNING: %lld objects of %s are still alive (%lld allocated, %u Kb reserved)\n", ( long long )S.FLive, S.FName, ( long long )S.FAllocated, ( unsigned int )( S.FReservedBytes / 1024 ) );
+
+		Live += static_cast<size_t>( S.FLive );
+	}
+
+	return Live;
+}
+
+/// Zero-initialized before any constructor runs, the reporters are created and destroyed on the main thread
+static int ObjectPool_NumLeakReporters;
+
+void clObjectPool::AddLeakReporter()
+{
+	ObjectPool_NumLeakReporters++;
+}
+
+void clObjectPool::RemoveLeakReporter()
+{
+	if ( --ObjectPool_NumLeakReporters == 0 ) { ReportLeaks(); }
+}
+
+clLinearArena::clLinearArena( size_t ChunkSize )
+	: FChunkSize( ChunkSize )
+	, FCurrentChunk( 0 )
+	, FUsedBytes( 0 )
+	, FPeakUsedBytes( 0 )
+	, FDestructors( NULL )
+{
+}
+
+clLinearArena::~clLinearArena()
+{
+	Reset();
+
+	for ( size_t i = 0; i != FChunks.size(); i++ ) { ::free( FChunks[i].FMemory ); }
+}
+
+void* clLinearArena::Alloc( size_t Size )
+{
+	Size = ( Size + 15 ) & ~static_cast<size_t>( 15 );
+
+	FUsedBytes += Size;
+
+	// the chunks before FCurrentChunk are full
+	for ( ; FCurrentChunk < FChunks.size(); FCurrentChunk++ )
+	{
+		sChunk& C = FChunks[FCurrentChunk];
+
+		if ( C.FSize - C.FUsed >= Size )
+		{
+			void* Ptr = C.FMemory + C.FUsed;
+			C.FUsed += Size;
+			return Ptr;
+		}
+	}
+
+	sChunk C;
+	C.FSize   = std::max( Size, FChunkSize );
+	C.FUsed   = Size;
+	C.FMemory = static_cast<ubyte*>( ::malloc( C.FSize ) );
+
+	if ( !C.FMemory ) { throw std::bad_alloc(); }
+
+	FChunks.push_back( C );
+	FCurrentChunk = FChunks.size() - 1;
+
+	return C.FMemory;
+}
+
+void clLinearArena::Reset()
+{
+	// the list is in reverse order of construction
+	for ( sDestructor* D = FDestructors; D; D = D->FNext ) { D->FDestroy( D->FObject ); }
+
+	FDestructors = NULL;
+
+	for ( size_t i = 0; i != FChunks.size(); i++ ) { FChunks[i].FUsed = 0; }
+
+	FCurrentChunk = 0;
+
+	FPeakUsedBytes = std::max( FPeakUsedBytes, FUsedBytes );
+	FUsedBytes = 0;
+}
+
+size_t clLinearArena::GetReservedSize() const
+{
+	size_t Total = 0;
+
+	for ( size_t i = 0; i != FChunks.size(); i++ ) { Total += FChunks[i].FSize; }
+
+	return Total;
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+#include "iObject.h"
+#include "Mutex.h"
+
+struct sObjectPoolStats
+{
+	const char* FName;
+	size_t      FBlockSize;
+	/// objects allocated and freed over the lifetime of the pool
+	int64       FAllocated;
+	int64       FFreed;
+	int64       FLive;
+	/// derived classes which do not fit into a block are allocated with ::operator new
+	int64       FFallbackAllocated;
+	/// trips to the shared free list
+	int64       FRefills;
+	size_t      FReservedBytes;
+};
+
+/**
+   \brief Fixed-size block allocator with per-thread caches
+
+   Every thread allocates and frees blocks through its own free list, only whole chains of blocks move through
+   the shared stack under the mutex. Blocks freed by another thread simply migrate to that thread's cache.
+   The chunks whose blocks have all returned to the shared stack are given back to the system.
+   Pools are created once and never destroyed, so objects can still be released during static destruction.
+*/
+class clObjectPool
+{
+public:
+	static clObjectPool* Create( const char* Name, size_t BlockSize );
+
+	void* Alloc( size_t Size );
+	void  Free( void* Ptr, size_t Size );
+
+	sObjectPoolStats GetStats() const;
+
+	static void   GetAllStats( std::vector<sObjectPoolStats>* Stats );
+	/// Log every pool which still has live objects, returns the total number of live objects
+	static size_t ReportLeaks();
+
+	/// Used by sObjectPoolLeakReporter, the last one to go calls ReportLeaks()
+	static void   AddLeakReporter();
+	static void   RemoveLeakReporter();
+
+	/// Return the blocks cached by an exiting thread, called by the thread-local storage destructor
+	static void   ThreadExit( void* Cache );
+
+private:
+	clObjectPool( const char* Name, size_t BlockSize );
+
+	struct sThreadCache
+	{
+		clObjectPool* FPool;
+		void*         FFree;
+		size_t        FCount;
+		int64         FAllocated;
+		int64         FFreed;
+	};
+
+	sThreadCache* GetThreadCache();
+	void          Refill( sThreadCache* Cache );
+	/// Move all but Keep blocks to the shared stack
+	void          Drain( sThreadCache* Cache, size_t Keep );
+	void          RetireCache( sThreadCache* Cache );
+
+	/// the callers hold FMutex
+	void          PushChainLocked( void* Chain, size_t Count );
+	void          AddChunkLocked();
+	/// Free the chunks which have no blocks outside of the shared stack
+	void          TrimLocked();
+
+private:
+	const char*    FName;
+	size_t         FBlockSize;
+	size_t         FBlocksPerChunk;
+
+#if defined( _WIN32 )
+	unsigned long  FTLSIndex;
+#else
+	pthread_key_t  FTLSKey;
+#endif
+
+	/// everything below is guarded by FMutex
+	clMutex        FMutex;
+	/// stack of block chains, the first block of a chain keeps the link to the next chain and the length
+	void*          FSharedChains;
+	size_t         FSharedBlocks;
+	/// TrimLocked() runs when FSharedBlocks exceeds this
+	size_t         FTrimThreshold;
+	/// sorted by address
+	std::vector<void*>         FChunks;
+	std::vector<sThreadCache*> FCaches;
+	/// counters of the threads which have exited
+	int64          FRetiredAllocated;
+	int64          FRetiredFreed;
+	int64          FRefills;
+
+	volatile int64 FFallbackAllocated;
+	volatile int64 FFallbackFreed;
+};
+
+#if !defined( NDEBUG )
+/**
+   Nifty counter: every translation unit which includes this header constructs a reporter before its own globals
+   and destroys it after them, so the leaks are reported once all of those globals are torn down on exit.
+*/
+static struct sObjectPoolLeakReporter
+{
+	sObjectPoolLeakReporter()  { clObjectPool::AddLeakReporter(); }
+	~sObjectPoolLeakReporter() { clObjectPool::RemoveLeakReporter(); }
+} ObjectPool_LeakReporter;
+#endif
+
+/**
+   Opt-in class-level allocator, put it into the class declaration:
+
+      class clDownloadTask: public iTask
+      {
+         L_POOLED_OBJECT( clDownloadTask )
+      public:
+         ...
+
+   Derived classes inherit the allocator, those which are larger than the class fall back to ::operator new.
+   Pool the objects which are mostly released on the thread that created them. An object created on a worker
+   and released on another thread (e.g. an iAsyncCapsule) makes both threads pay for the migration of its block,
+   plain new is faster there.
+*/
+#define L_POOLED_OBJECT( Class ) \
+	public: \
+		static void* operator new( size_t Size ) { return Class::GetObjectPool()->Alloc( Size ); } \
+		static void  operator delete( void* Ptr, size_t Size ) { Class::GetObjectPool()->Free( Ptr, Size ); } \
+		static clObjectPool* GetObjectPool() \
+		{ \
+			static clObjectPool* Pool = clObjectPool::Create( #Class, sizeof( Class ) ); \
+			return Pool; \
+		} \
+	private:
+
+/**
+   \brief Linear allocator for transient objects, e.g. everything that lives for a single frame
+
+   Allocation is a pointer bump, Reset() destroys the objects created by New() in reverse order and rewinds
+   the arena. Objects from the arena must not be reference-counted by clPtr. Not thread-safe: use one arena per thread.
+*/
+class clLinearArena
+{
+public:
+	explicit clLinearArena( size_t ChunkSize = 64 * 1024 );
+	~clLinearArena();
+
+	void* Alloc( size_t Size );
+
+	template <class T> T* New()
+	{
+		return RegisterObject( ::new( Alloc( sizeof( T ) ) ) T() );
+	}
+	template <class T, class A1> T* New( const A1& Arg1 )
+	{
+		return RegisterObject( ::new( Alloc( sizeof( T ) ) ) T( Arg1 ) );
+	}
+	template <class T, class A1, class A2> T* New( const A1& Arg1, const A2& Arg2 )
+	{
+		return RegisterObject( ::new( Alloc( sizeof( T ) ) ) T( Arg1, Arg2 ) );
+	}
+
+	/// Destroy all objects and release all blocks
+	void   Reset();
+
+	size_t GetUsedSize() const { return FUsedBytes; }
+	/// The largest GetUsedSize() seen by Reset()
+	size_t GetPeakUsedSize() const { return FPeakUsedBytes; }
+	size_t GetReservedSize() const;
+
+private:
+	struct sDestructor
+	{
+		void ( *FDestroy )( void* );
+		void*        FObject;
+		sDestructor* FNext;
+	};
+
+	template <class T> static void Destroy( void* Object ) { static_cast<T*>( Object )->~T(); }
+
+	template <class T> T* RegisterObject( T* Object )
+	{
+		return RegisterObject( Object, std::is_trivially_destructible<T>() );
+	}
+
+	/// Nothing to run in Reset() for the trivially destructible types
+	template <class T> T* RegisterObject( T* Object, std::true_type ) { return Object; }
+
+	template <class T> T* RegisterObject( T* Object, std::false_type )
+	{
+		sDestructor* D = static_cast<sDestructor*>( Alloc( sizeof( sDestructor ) ) );
+
+		D->FDestroy = &Destroy<T>;
+		D->FObject  = Object;
+		D->FNext    = FDestructors;
+
+		FDestructors = D;
+
+		return Object;
+	}
+
+	struct sChunk
+	{
+		ubyte* FMemory;
+		size_t FSize;
+		size_t FUsed;
+	};
+
+	std::vector<sChunk> FChunks;
+	size_t       FChunkSize;
+	size_t       FCurrentChunk;
+	size_t       FUsedBytes;
+	size_t       FPeakUsedBytes;
+	sDestructor* FDestructors;
+};
@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+
+/// Weight of the last frame in the smoothed zone times
+const double PROFILER_SMOOTHING = 0.1;
+
+clProfiler::clProfiler()
+	: FEnabled( false )
+	, FDroppedRetired( 0 )
+	, FFrameStart( Trace_GetNanoseconds() )
+	, FFrameIndex( 0 )
+	, FCapturing( false )
+{
+#if defined( _WIN32 )
+	FTLSIndex = TlsAlloc();
+#else
+	pthread_key_create( &FTLSKey, &ThreadExit );
+#endif
+}
+
+clProfiler::sThreadBuffer* clProfiler::GetThreadBuffer()
+{
+#if defined( _WIN32 )
+	sThreadBuffer* Buffer = static_cast<sThreadBuffer*>( TlsGetValue( FTLSIndex ) );
+#else
+	sThreadBuffer* Buffer = static_cast<sThreadBuffer*>( pthread_getspecific( FTLSKey ) );
+#endif
+
+	if ( Buffer ) { return Buffer; }
+
+	Buffer = new sThreadBuffer();
+	Buffer->FThread  = Trace_GetThreadID();
+	Buffer->FDepth   = 0;
+	Buffer->FHead    = 0;
+	Buffer->FTail    = 0;
+	Buffer->FDropped = 0;
+	Buffer->FRetired = false;
+	Buffer->FEvents.resize( PROFILER_THREAD_BUFFER_SIZE );
+
+	{
+		LMutex Lock( &FMutex );
+
+		FBuffers.push_back( Buffer );
+	}
+
+#if defined( _WIN32 )
+	// there is no thread exit notification for TLS on Windows, the buffer of an exited thread stays registered
+	TlsSetValue( FTLSIndex, Buffer );
+#else
+	pthread_setspecific( FTLSKey, Buffer );
+#endif
+
+	return Buffer;
+}
+
+void clProfiler::ThreadExit( void* Buffer )
+{
+	Atomic::Barrier();
+
+	static_cast<sThreadBuffer*>( Buffer )->FRetired = true;
+}
+
+void clProfiler::SetThreadName( const char* Name )
+{
+	LMutex Lock( &FMutex );
+
+	FThreadNames[ Trace_GetThreadID() ] = Name;
+}
+
+clProfiler::sZone& clProfiler::GetZone( const char* Name )
+{
+	std::map<const char*, size_t>::const_iterator i = FZoneByPtr.find( Name );
+
+	if ( i != FZoneByPtr.end() ) { return FZones[ i->second ]; }
+
+	std::map<std::string, size_t>::const_iterator j = FZoneByName.find( Name );
+
+	size_t Index = ( j != FZoneByName.end() ) ? j->second : FZones.size();
+
+	if ( Index == FZones.size() )
+	{
+		sZone Z;
+		Z.FStats.FName        = Name;
+		Z.FStats.FCalls       = 0;
+		Z.FStats.FTime        = 0.0;
+		Z.FStats.FMaxTime     = 0.0;
+		Z.FStats.FAverageTime = 0.0;
+		Z.FCalls   = 0;
+		Z.FTime    = 0;
+		Z.FMaxTime = 0;
+
+		FZones.push_back( Z );
+		FZoneByName[ Name ] = Index;
+	}
+
+	FZoneByPtr[ Name ] = Index;
+
+	return FZones[ Index ];
+}
+
+void clProfiler::Collect( sThreadBuffer* Buffer )
+{
+	int64 Head = Buffer->FHead;
+
+	// the events below Head are complete
+	Atomic::Barrier();
+
+	for ( int64 Seq = Buffer->FTail; Seq != Head; Seq++ )
+	{
+		const sProfilerEvent& E = Buffer->FEvents[ static_cast<size_t>( Seq ) & ( PROFILER_THREAD_BUFFER_SIZE - 1 ) ];
+
+		sZone& Z = GetZone( E.FName );
+
+		int64 Duration = E.FEnd - E.FStart;
+
+		Z.FCalls++;
+		Z.FTime += Duration;
+		Z.FMaxTime = std::max( Z.FMaxTime, Duration );
+
+		if ( FCapturing && FCaptured.size() < PROFILER_MAX_CAPTURED_EVENTS ) { FCaptured.push_back( E ); }
+	}
+
+	// the slots are copied before the owner thread can reuse them
+	Atomic::Barrier();
+
+	Buffer->FTail = Head;
+}
+
+void clProfiler::EndFrame()
+{
+	int64 Now = Trace_GetNanoseconds();
+
+	LMutex Lock( &FMutex );
+
+	for ( size_t i = 0; i != FBuffers.size(); )
+	{
+		sThreadBuffer* Buffer = FBuffers[i];
+
+		bool Retired = Buffer->FRetired;
+
+		Collect( Buffer );
+
+		if ( Retired )
+		{
+			FDroppedRetired += Buffer->FDropped;
+			FBuffers.erase( FBuffers.begin() + i );
+			delete( Buffer );
+			continue;
+		}
+
+		i++;
+	}
+
+	for ( size_t i = 0; i != FZones.size(); i++ )
+	{
+		sZone& Z = FZones[i];
+
+		Z.FStats.FCalls       = Z.FCalls;
+		Z.FStats.FTime        = static_cast<double>( Z.FTime ) * 1e-6;
+		Z.FStats.FMaxTime     = static_cast<double>( Z.FMaxTime ) * 1e-6;
+		Z.FStats.FAverageTime += ( Z.FStats.FTime - Z.FStats.FAverageTime ) * PROFILER_SMOOTHING;
+
+		Z.FCalls   = 0;
+		Z.FTime    = 0;
+		Z.FMaxTime = 0;
+	}
+
+	if ( FCapturing && FCaptured.size() < PROFILER_MAX_CAPTURED_EVENTS )
+	{
+		// the frames go into the trace as zones of the thread running the frame loop
+		sProfilerEvent E;
+		E.FName   = "Frame";
+		E.FStart  = FFrameStart;
+		E.FEnd    = Now;
+		E.FDepth  = -1;
+		E.FThread = Trace_GetThreadID();
+
+		FCaptured.push_back( E );
+	}
+
+	if ( FFrameTimes.size() == PROFILER_FRAME_HISTORY ) { FFrameTimes.erase( FFrameTimes.begin() ); }
+
+	FFrameTimes.push_back( static_cast<float>( static_cast<double>( Now - FFrameStart ) * 1e-6 ) );
+
+	FFrameStart = Now;
+	FFrameIndex++;
+}
+
+void clProfiler::GetFrameTimes( std::vector<float>* Times ) const
+{
+	LMutex Lock( &FMutex );
+
+	*Times = FFrameTimes;
+}
+
+static bool Profiler_CompareZones( const sProfilerZoneStats& Z1, const sProfilerZoneStats& Z2 )
+{
+	return Z1.FAverageTime > Z2.FAverageTime;
+}
+
+void clProfiler::GetZoneStats( std::vector<sProfilerZoneStats>* Stats ) const
+{
+	LMutex Lock( &FMutex );
+
+	Stats->clear();
+	Stats->reserve( FZones.size() );
+
+	for ( size_t i = 0; i != FZones.size(); i++ ) { Stats->push_back( FZones[i].FStats ); }
+
+	std::sort( Stats->begin(), Stats->end(), &Profiler_CompareZones );
+}
+
+int64 clProfiler::GetNumDroppedEvents() const
+{
+	LMutex Lock( &FMutex );
+
+	int64 Dropped = FDroppedRetired;
+
+	for ( size_t i = 0; i != FBuffers.size(); i++ ) { Dropped += FBuffers[i]->FDropped; }
+
+	return Dropped;
+}
+
+void clProfiler::StartCapture()
+{
+	LMutex Lock( &FMutex );
+
+	FCaptured.clear();
+	FCapturedExternal.clear();
+	FCapturing = true;
+}
+
+void clProfiler::StopCapture()
+{
+	LMutex Lock( &FMutex );
+
+	FCapturing = false;
+}
+
+void clProfiler::AddExternalEvent( const char* Category, const std::string& Name, int64 Start, int64 End, int64 Bytes )
+{
+	LMutex Lock( &FMutex );
+
+	if ( !FCapturing || FCaptured.size() + FCapturedExternal.size() >= PROFILER_MAX_CAPTURED_EVENTS ) { return; }
+
+	sProfilerExternalEvent E;
+	E.FName     = Name;
+	E.FCategory = Category;
+	E.FStart    = Start;
+	E.FEnd      = End;
+	E.FThread   = Trace_GetThreadID();
+	E.FBytes    = Bytes;
+
+	FCapturedExternal.push_back( E );
+}
+
+bool clProfiler::SaveChromeTrace( const std::string& FileName ) const
+{
+	LMutex Lock( &FMutex );
+
+	// the timestamps are written relative to the earliest event
+	int64 Origin = std::numeric_limits<int64>::max();
+
+	for ( size_t i = 0; i != FCaptured.size(); i++ ) { Origin = std::min( Origin, FCaptured[i].FStart ); }
+
+	for ( size_t i = 0; i != FCapturedExternal.size(); i++ ) { Origin = std::min( Origin, FCapturedExternal[i].FStart ); }
+
+	clChromeTraceWriter Writer;
+
+	if ( !Writer.Open( FileName, Origin ) ) { return false; }
+
+	for ( std::map<uint64, std::string>::const_iterator i = FThreadNames.begin(); i != FThreadNames.end(); ++i )
+	{
+		Writer.AddThreadName( i->first, i->second );
+	}
+
+	for ( size_t i = 0; i != FCaptured.size(); i++ )
+	{
+		const sProfilerEvent& E = FCaptured[i];
+
+		Writer.AddEvent( E.FName, ( E.FDepth < 0 ) ? "frame" : "zone", E.FThread, E.FStart, E.FEnd );
+	}
+
+	for ( size_t i = 0; i != FCapturedExternal.size(); i++ )
+	{
+		const sProfilerExternalEvent& E = FCapturedExternal[i];
+
+		char Args[64] = "";
+
+		if ( E.FBytes >= 0 ) { sprintf( Args, "\"bytes\":%lld", ( long long )E.FBytes ); }
+
+		Writer.AddEvent( E.FName, E.FCategory, E.FThread, E.FStart, E.FEnd, Args );
+	}
+
+	int64 Dropped = FDroppedRetired;
+
+	for ( size_t i = 0; i != FBuffers.size(); i++ ) { Dropped += FBuffers[i]->FDropped; }
+
+	char OtherData[128];
+
+	sprintf( OtherData, "\"frames\":%lld,\"dropped_events\":%lld", ( long long )FFrameIndex, ( long long )Dropped );
+
+	return Writer.Close( OtherData );
+}
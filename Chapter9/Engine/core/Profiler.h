@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <map>
+
+#include "iObject.h"
+#include "Mutex.h"
+#include "Trace.h"
+
+/// Zone events a thread can record between two frames (power of two), the excess is dropped
+const size_t PROFILER_THREAD_BUFFER_SIZE = 8192;
+
+/// Number of the recent frame times kept for the overlay
+const size_t PROFILER_FRAME_HISTORY = 128;
+
+/// Events kept by a single capture
+const size_t PROFILER_MAX_CAPTURED_EVENTS = 1024 * 1024;
+
+/// Single completed zone
+struct sProfilerEvent
+{
+	/// Zone names are string literals, they are never copied
+	const char* FName;
+	int64       FStart;
+	int64       FEnd;
+	int         FDepth;
+	uint64      FThread;
+};
+
+/// Event of another engine trace (e.g. clIOTrace) merged into the capture
+struct sProfilerExternalEvent
+{
+	std::string FName;
+	/// String literal
+	const char* FCategory;
+	int64       FStart;
+	int64       FEnd;
+	uint64      FThread;
+	/// Size of the processed data, negative if not applicable
+	int64       FBytes;
+};
+
+/// Time spent in a zone, summed over all the threads
+struct sProfilerZoneStats
+{
+	const char* FName;
+	/// Calls in the last frame
+	int64       FCalls;
+	/// Milliseconds in the last frame
+	double      FTime;
+	/// Longest single call in the last frame, milliseconds
+	double      FMaxTime;
+	/// Exponentially smoothed FTime
+	double      FAverageTime;
+};
+
+/**
+   \brief Frame profiler with nested CPU zones
+
+   Every thread writes completed zones into its own single-producer ring, so recording never takes a lock.
+   The thread which owns the frame loop calls EndFrame() once per frame to drain the rings, aggregate per-zone
+   times and optionally append the events to a capture which can be saved in the Chrome trace format.
+   Everything is a no-op until SetEnabled( true ) is called.
+*/
+class clProfiler
+{
+public:
+	clProfiler();
+
+	void SetEnabled( bool Enabled ) { FEnabled = Enabled; }
+	bool IsEnabled() const { return FEnabled; }
+
+	/// Name of the calling thread in the trace
+	void SetThreadName( const char* Name );
+
+	/// Close the current frame, collect the events of all the threads and start a new frame
+	void EndFrame();
+
+	/// Milliseconds, oldest first
+	void GetFrameTimes( std::vector<float>* Times ) const;
+	/// Zones seen so far, the most expensive first
+	void GetZoneStats( std::vector<sProfilerZoneStats>* Stats ) const;
+	/// Events lost because a thread recorded more than PROFILER_THREAD_BUFFER_SIZE zones between two frames
+	int64 GetNumDroppedEvents() const;
+
+	/// Keep the events collected by EndFrame() until StopCapture()
+	void StartCapture();
+	void StopCapture();
+	bool IsCapturing() const { return FCapturing; }
+	/// Add an event of the calling thread to the capture. Takes a lock, meant for the events much rarer than the zones
+	void AddExternalEvent( const char* Category, const std::string& Name, int64 Start, int64 End, int64 Bytes );
+	/// Save the captured events in the Chrome trace format, readable by chrome://tracing and Perfetto
+	bool SaveChromeTrace( const std::string& FileName ) const;
+
+public:
+	struct sThreadBuffer
+	{
+		uint64 FThread;
+		/// Nesting level of the current zone, used only by the owner thread
+		int    FDepth;
+		/// Written by the owner thread
+		volatile int64 FHead;
+		/// Written by EndFrame()
+		volatile int64 FTail;
+		volatile int64 FDropped;
+		/// The owner thread has exited, the buffer is deleted once drained
+		volatile bool  FRetired;
+		std::vector<sProfilerEvent> FEvents;
+	};
+
+	/// Buffer of the calling thread, created on the first use
+	sThreadBuffer* GetThreadBuffer();
+
+	inline void AddEvent( sThreadBuffer* Buffer, const char* Name, int64 Start, int64 End, int Depth )
+	{
+		if ( Buffer->FHead - Buffer->FTail >= ( int64 )PROFILER_THREAD_BUFFER_SIZE )
+		{
+			Buffer->FDropped++;
+			return;
+		}
+
+		sProfilerEvent& E = Buffer->FEvents[ static_cast<size_t>( Buffer->FHead ) & ( PROFILER_THREAD_BUFFER_SIZE - 1 ) ];
+
+		E.FName   = Name;
+		E.FStart  = Start;
+		E.FEnd    = End;
+		E.FDepth  = Depth;
+		E.FThread = Buffer->FThread;
+
+		// EndFrame() should see the event before the new head
+		Atomic::Barrier();
+		Buffer->FHead++;
+	}
+
+private:
+	struct sZone
+	{
+		sProfilerZoneStats FStats;
+		int64              FCalls;
+		int64              FTime;
+		int64              FMaxTime;
+	};
+
+	sZone& GetZone( const char* Name );
+	void   Collect( sThreadBuffer* Buffer );
+
+	static void ThreadExit( void* Buffer );
+
+private:
+	volatile bool  FEnabled;
+
+#if defined( _WIN32 )
+	unsigned long  FTLSIndex;
+#else
+	pthread_key_t  FTLSKey;
+#endif
+
+	/// everything below is guarded by FMutex
+	mutable clMutex FMutex;
+	std::vector<sThreadBuffer*> FBuffers;
+	std::map<uint64, std::string> FThreadNames;
+	int64          FDroppedRetired;
+
+	/// literals of the same name in different modules are the same zone
+	std::map<const char*, size_t> FZoneByPtr;
+	std::map<std::string, size_t> FZoneByName;
+	std::vector<sZone>            FZones;
+
+	int64          FFrameStart;
+	int64          FFrameIndex;
+	std::vector<float> FFrameTimes;
+
+	volatile bool  FCapturing;
+	std::vector<sProfilerEvent> FCaptured;
+	std::vector<sProfilerExternalEvent> FCapturedExternal;
+};
+
+/// The profiler shared by all the engine subsystems
+inline clProfiler& Profiler_Get()
+{
+	static clProfiler Profiler;
+	return Profiler;
+}
+
+/// Times the enclosed scope as a zone of the calling thread
+class LProfileZone
+{
+public:
+	explicit LProfileZone( const char* Name ): FBuffer( NULL )
+	{
+		if ( !Profiler_Get().IsEnabled() ) { return; }
+
+		FName   = Name;
+		FBuffer = Profiler_Get().GetThreadBuffer();
+		FDepth  = FBuffer->FDepth++;
+		FStart  = Trace_GetNanoseconds();
+	}
+
+	~LProfileZone()
+	{
+		if ( !FBuffer ) { return; }
+
+		FBuffer->FDepth--;
+
+		Profiler_Get().AddEvent( FBuffer, FName, FStart, Trace_GetNanoseconds(), FDepth );
+	}
+
+private:
+	clProfiler::sThreadBuffer* FBuffer;
+	const char* FName;
+	int64       FStart;
+	int         FDepth;
+};
+
+#define L_PROFILE_CONCAT_IMPL( A, B ) A##B
+#define L_PROFILE_CONCAT( A, B ) L_PROFILE_CONCAT_IMPL( A, B )
+
+/// Define L_DISABLE_PROFILER to compile the zones out completely
+#if defined( L_DISABLE_PROFILER )
+#  define L_PROFILE_ZONE( Name )
+#else
+#  define L_PROFILE_ZONE( Name ) LProfileZone L_PROFILE_CONCAT( ProfileZone, __LINE__ )( Name )
+#endif
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "iObject.h"
+
+#include <stdio.h>
+#include <string>
+
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <time.h>
+#  include <pthread.h>
+#endif
+
+/// Monotonic time in nanoseconds. The profiler, the I/O trace and the event queues share this clock
+inline int64 Trace_GetNanoseconds()
+{
+#ifdef _WIN32
+	static LARGE_INTEGER Freq = { 0 };
+
+	if ( !Freq.QuadPart ) { QueryPerformanceFrequency( &Freq ); }
+
+	LARGE_INTEGER T;
+	QueryPerformanceCounter( &T );
+
+	return static_cast<int64>( static_cast<double>( T.QuadPart ) * 1e9 / static_cast<double>( Freq.QuadPart ) );
+#else
+	timespec T;
+	clock_gettime( CLOCK_MONOTONIC, &T );
+
+	return static_cast<int64>( T.tv_sec ) * 1000000000 + static_cast<int64>( T.tv_nsec );
+#endif
+}
+
+/// Identifier of the calling thread in the traces
+inline uint64 Trace_GetThreadID()
+{
+#ifdef _WIN32
+	return static_cast<uint64>( GetCurrentThreadId() );
+#else
+	return static_cast<uint64>( ( size_t )pthread_self() );
+#endif
+}
+
+/// Make the string safe to be put between quotes in a JSON file
+inline std::string Trace_EscapeJSON( const std::string& Str )
+{
+	std::string Result;
+
+	for ( size_t i = 0; i != Str.length(); i++ )
+	{
+		unsigned char Ch = static_cast<unsigned char>( Str[i] );
+
+		if ( Ch < 0x20 )
+		{
+			char Code[8];
+			sprintf( Code, "\\u%04x", Ch );
+			Result += Code;
+			continue;
+		}
+
+		if ( Ch == '\\' || Ch == '"' ) { Result.push_back( '\\' ); }
+
+		Result.push_back( Str[i] );
+	}
+
+	return Result;
+}
+
+/**
+   \brief Writer of the Chrome trace format, readable by chrome://tracing and Perfetto
+
+   Timestamps are Trace_GetNanoseconds() values, they are written in microseconds relative to the origin given to Open()
+*/
+class clChromeTraceWriter
+{
+public:
+	clChromeTraceWriter(): FFile( NULL ), FFirst( true ), FOrigin( 0 ) {}
+	~clChromeTraceWriter() { if ( FFile ) { fclose( FFile ); } }
+
+	bool Open( const std::string& FileName, int64 Origin )
+	{
+		FFile = fopen( FileName.c_str(), "wt" );
+
+		if ( !FFile ) { return false; }
+
+		FFirst  = true;
+		FOrigin = Origin;
+
+		fprintf( FFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+		return true;
+	}
+
+	void AddThreadName( uint64 Thread, const std::string& Name )
+	{
+		fprintf( FFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%llu,\"args\":{\"name\":\"%s\"}}",
+		         GetSeparator(), ( unsigned long long )Thread, Trace_EscapeJSON( Name ).c_str() );
+	}
+
+	/// Complete event. Args is the body of the "args" object, e.g. "\"bytes\":42", or empty
+	void AddEvent( const std::string& Name, const char* Category, uint64 Thread, int64 Start, int64 End, const std::string& Args = std::string() )
+	{
+		fprintf( FFile, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f",
+		         GetSeparator(), Trace_EscapeJSON( Name ).c_str(), Category, ( unsigned long long )Thread,
+		         static_cast<double>( Start - FOrigin ) * 1e-3, static_cast<double>( End - Start ) * 1e-3 );
+
+		if ( !Args.empty() ) { fprintf( FFile, ",\"args\":{%s}", Args.c_str() ); }
+
+		fprintf( FFile, "}" );
+	}
+
+	/// OtherData is the body of the "otherData" object. Returns false if anything has failed
+	bool Close( const std::string& OtherData )
+	{
+		fprintf( FFile, "\n],\n\"otherData\":{%s}}\n", OtherData.c_str() );
+
+		bool Result = ( fclose( FFile ) == 0 );
+
+		FFile = NULL;
+
+		return Result;
+	}
+
+private:
+	const char* GetSeparator()
+	{
+		const char* Separator = FFirst ? "" : ",\n";
+
+		FFirst = false;
+
+		return Separator;
+	}
+
+	FILE* FFile;
+	bool  FFirst;
+	int64 FOrigin;
+};
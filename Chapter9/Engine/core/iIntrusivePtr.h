@@ -38,10 +38,24 @@
 #  define NULL 0
 #endif
 
+#include "iObject.h"
+
+#if defined( __GXX_EXPERIMENTAL_CXX0X__ ) || __cplusplus >= 201103L || ( defined( _MSC_VER ) && _MSC_VER >= 1600 )
+#  define L_HAS_RVALUE_REFERENCES
+#endif
+
 namespace LPtr
 {
-	void IncRef( void* p );
-	void DecRef( void* p );
+	/// iObject is always the first base, so clPtr<T> works for an incomplete T
+	inline void IncRef( void* p )
+	{
+		if ( p ) { reinterpret_cast<iObject*>( p )->IncRefCount(); }
+	}
+
+	inline void DecRef( void* p )
+	{
+		if ( p ) { reinterpret_cast<iObject*>( p )->DecRefCount(); }
+	}
 };
 
 /// Intrusive smart pointer
@@ -67,6 +81,17 @@ public:
 	{
 		LPtr::IncRef( FObject );
 	}
+#ifdef L_HAS_RVALUE_REFERENCES
+	/// move constructor, the reference is transferred
+	clPtr( clPtr&& Ptr ): FObject( Ptr.FObject )
+	{
+		Ptr.FObject = 0;
+	}
+	template <typename U> clPtr( clPtr<U>&& Ptr ): FObject( Ptr.FObject )
+	{
+		Ptr.FObject = 0;
+	}
+#endif
 	/// constructor from T*
 	clPtr( T* const Object ): FObject( Object )
 	{
@@ -93,6 +118,22 @@ public:
 
 		return *this;
 	}
+#ifdef L_HAS_RVALUE_REFERENCES
+	/// move assignment of clPtr
+	clPtr& operator = ( clPtr&& Ptr )
+	{
+		if ( this != &Ptr )
+		{
+			T* Temp = FObject;
+			FObject = Ptr.FObject;
+			Ptr.FObject = 0;
+
+			LPtr::DecRef( Temp );
+		}
+
+		return *this;
+	}
+#endif
 	/// -> operator
 	inline T* operator -> () const
 	{
@@ -134,5 +175,7 @@ public:
 		return FObject;
 	}
 private:
+	template <class U> friend class clPtr;
+
 	T*    FObject;
 };
@@ -71,19 +71,144 @@ typedef int64_t       int64;
 typedef uint64_t      uint64;
 #endif
 
+namespace Atomic
+{
+	/// Add Delta to the 64-bit Value and return the new value
+	inline int64 Add( volatile int64* Value, int64 Delta )
+	{
+#ifdef _WIN32
+		return InterlockedExchangeAdd64( Value, Delta ) + Delta;
+#else
+		return __sync_add_and_fetch( Value, Delta );
+#endif
+	}
+
+	/// Full memory barrier
+	inline void Barrier()
+	{
+#ifdef _WIN32
+		MemoryBarrier();
+#else
+		__sync_synchronize();
+#endif
+	}
+
+	/// Replace Value with Desired if it equals Expected, returns true on success. Acts as a full barrier
+	inline bool CompareAndSwap( volatile int64* Value, int64 Expected, int64 Desired )
+	{
+#ifdef _WIN32
+		return InterlockedCompareExchange64( Value, Desired, Expected ) == Expected;
+#else
+		return __sync_bool_compare_and_swap( Value, Expected, Desired );
+#endif
+	}
+
+	/// Store Value into Ptr and return the previous value, acts as a full barrier
+	template <class T> inline T* ExchangePtr( T* volatile* Ptr, T* Value )
+	{
+#ifdef _WIN32
+		return reinterpret_cast<T*>( InterlockedExchangePointer( reinterpret_cast<PVOID volatile*>( Ptr ), Value ) );
+#else
+		// __sync_lock_test_and_set() is only an acquire barrier
+		__sync_synchronize();
+		return __sync_lock_test_and_set( Ptr, Value );
+#endif
+	}
+
+} // namespace Atomic
+
 /// Intrusive reference-countable object for garbage collection
 class iObject
 {
 public:
-	iObject(): FRefCounter( 0 ) {}
+	iObject(): FRefCounter( 0 ), FThreadConfined( false ) {}
 	virtual ~iObject() {}
 
-	void    IncRefCount() { Atomic::Inc( &FRefCounter ); }
+	void    IncRefCount()
+	{
+		if ( FThreadConfined ) { FRefCounter++; return; }
 
-	void    DecRefCount() { if ( Atomic::Dec( &FRefCounter ) == 0 ) { delete this; } }
+#ifdef _WIN32
+		InterlockedIncrement( &FRefCounter );
+#else
+		// a new reference is always made from an existing one, so no ordering is required
+		__atomic_fetch_add( &FRefCounter, 1, __ATOMIC_RELAXED );
+#endif
+	}
+
+	void    DecRefCount()
+	{
+		if ( FThreadConfined )
+		{
+			if ( --FRefCounter == 0 ) { delete this; }
+
+			return;
+		}
+
+#ifdef _WIN32
+
+		if ( InterlockedDecrement( &FRefCounter ) == 0 ) { delete this; }
+
+#else
+
+		// release our writes to the object and acquire everybody else's before the destructor runs
+		if ( __atomic_sub_fetch( &FRefCounter, 1, __ATOMIC_ACQ_REL ) == 0 ) { delete this; }
+
+#endif
+	}
+
+	/// Take a new reference unless the counter has already dropped to zero. Weak references use it to get a strong one
+	bool    TryIncRefCount()
+	{
+		if ( FThreadConfined )
+		{
+			if ( !FRefCounter ) { return false; }
+
+			FRefCounter++;
+
+			return true;
+		}
+
+#ifdef _WIN32
+
+		for ( long Counter = FRefCounter; Counter; Counter = FRefCounter )
+		{
+			if ( InterlockedCompareExchange( &FRefCounter, Counter + 1, Counter ) == Counter ) { return true; }
+		}
+
+#else
+
+		for ( long Counter = __atomic_load_n( &FRefCounter, __ATOMIC_RELAXED ); Counter; )
+		{
+			// on failure Counter receives the current value
+			if ( __atomic_compare_exchange_n( &FRefCounter, &Counter, Counter + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED ) ) { return true; }
+		}
+
+#endif
+
+		return false;
+	}
 
 	long    GetReferenceCounter() const volatile { return FRefCounter; }
 
+protected:
+	/// Only for iSingleThreadObject
+	explicit iObject( bool ThreadConfined ): FRefCounter( 0 ), FThreadConfined( ThreadConfined ) {}
+
 private:
 	volatile long    FRefCounter;
+	bool             FThreadConfined;
+};
+
+/**
+   Object which is referenced from a single thread only
+
+   The reference counter is not atomic. Use it for the objects which never leave the thread that created them,
+   e.g. GUI geometry and text containers. Handing such an object over to another thread is fine as long as the
+   threads never touch the references simultaneously.
+*/
+class iSingleThreadObject: public iObject
+{
+public:
+	iSingleThreadObject(): iObject( true ) {}
 };
@@ -42,23 +42,126 @@
 
 #include "MountPoint.h"
 
+#include "tinythread.h"
+
 // dummy error handler for the bzip2 library
 extern "C" void bz_internal_error( int e_code ) { ( void )e_code; }
 
 bool ArchiveReader::CloseArchive()
 {
 	/// Clear containers
-	FFileInfos.clear();
-	FFileInfoIdx.clear();
-	FFileNames.clear();
-	FRealFileNames.clear();
 	ClearExtracted();
 
+	FIndex = NULL;
 	FSourceFile = NULL;
 
 	return true;
 }
 
+int ArchiveReader::GetFileIdx( const std::string& FileName ) const
+{
+	if ( !FIndex ) { return -1; }
+
+	unsigned int Hash = Arch_HashFileName( FileName.c_str() );
+	unsigned int Mask = GetHeader()->FNumBuckets - 1;
+
+	const unsigned int* Buckets = GetBuckets();
+
+	/// Linear probing, the table is at most half full so there is always an empty bucket to stop at
+	for ( unsigned int i = Hash & Mask; Buckets[i] != ARCHIVE_INDEX_NO_ENTRY; i = ( i + 1 ) & Mask )
+	{
+		int idx = ( int )Buckets[i];
+
+		if ( GetEntry( idx )->FHash == Hash && FileName == GetEntryName( idx ) ) { return idx; }
+	}
+
+	return -1;
+}
+
+bool ArchiveReader::LoadIndex( const std::string& IndexFileName, uint64 SourceTime )
+{
+	if ( !SourceTime || !FS_FileExistsPhys( IndexFileName ) ) { return false; }
+
+	clPtr<RawFile> File = new RawFile();
+
+	if ( !File->Open( IndexFileName, IndexFileName, AccessHint_WillNeed ) || !File->GetFileData() ) { return false; }
+
+	if ( File->GetFileSize() < sizeof( sArchiveIndexHeader ) ) { return false; }
+
+	const sArchiveIndexHeader* H = reinterpret_cast<const sArchiveIndexHeader*>( File->GetFileData() );
+
+	if ( H->FMagic != ARCHIVE_INDEX_MAGIC || H->FVersion != ARCHIVE_INDEX_VERSION ) { return false; }
+
+	/// The index is stale if the archive has been changed since
+	if ( H->FArchiveSize != FSourceFile->GetSize() || H->FArchiveTime != SourceTime ) { return false; }
+
+	/// The bucket count should be a power of two
+	if ( !H->FNumBuckets || ( H->FNumBuckets & ( H->FNumBuckets - 1 ) ) || H->FNumBuckets <= H->FNumEntries ) { return false; }
+
+	uint64 ExpectedSize = sizeof( sArchiveIndexHeader ) +
+	                      ( uint64 )H->FNumEntries * sizeof( sArchiveIndexEntry ) +
+	                      ( uint64 )H->FNumBuckets * sizeof( unsigned int ) +
+	                      H->FNamesSize;
+
+	if ( File->GetFileSize() != ExpectedSize ) { return false; }
+
+	const sArchiveIndexEntry* Entries = reinterpret_cast<const sArchiveIndexEntry*>( H + 1 );
+	const unsigned int* Buckets = reinterpret_cast<const unsigned int*>( Entries + H->FNumEntries );
+	const char* Names = reinterpret_cast<const char*>( Buckets + H->FNumBuckets );
+
+	/// Every name must be zero-terminated inside the names block
+	if ( H->FNamesSize && Names[H->FNamesSize - 1] != 0 ) { return false; }
+
+	uint64 ArchiveSize = FSourceFile->GetSize();
+
+	for ( unsigned int i = 0 ; i != H->FNumEntries ; i++ )
+	{
+		const sArchiveIndexEntry& E = Entries[i];
+
+		if ( E.FNameOffset >= H->FNamesSize ) { return false; }
+
+		/// Stored entries are served directly from the archive mapping
+		if ( E.FMethod == 0 && E.FOffset > 0 && ( E.FOffset > ArchiveSize || E.FSize > ArchiveSize - E.FOffset ) ) { return false; }
+	}
+
+	/// GetFileIdx() stops probing at an empty bucket, so there has to be at least one
+	bool HasEmptyBucket = false;
+
+	for ( unsigned int i = 0 ; i != H->FNumBuckets ; i++ )
+	{
+		if ( Buckets[i] == ARCHIVE_INDEX_NO_ENTRY ) { HasEmptyBucket = true; }
+		else if ( Buckets[i] >= H->FNumEntries ) { return false; }
+	}
+
+	if ( !HasEmptyBucket ) { return false; }
+
+	FIndex = File;
+
+	return true;
+}
+
+bool ArchiveReader::SaveIndex( const std::string& IndexFileName ) const
+{
+	if ( !FIndex ) { return false; }
+
+	clPtr<FileWriter> Out = new FileWriter();
+
+	// a concurrently starting process must never map a half-written index
+	Out->SetAtomicCommit( true );
+
+	if ( !Out->Open( IndexFileName ) ) { return false; }
+
+	uint64 Size = FIndex->GetFileSize();
+
+	if ( Out->Write( FIndex->GetFileData(), Size ) != Size )
+	{
+		Out->Discard();
+		return false;
+	}
+
+	return Out->Close();
+}
+
 static voidpf ZCALLBACK zip_fopen ( voidpf opaque, const void* filename, int mode )
 {
 	( ( iIStream* )opaque )->Seek( 0 );
@@ -183,7 +286,49 @@ int ExtractCurrentFile_ZIP( unzFile uf, const char* password, int* abort_flag, f
 	return err;
 }
 
-bool ArchiveReader::Enumerate_ZIP()
+/// Read Size bytes at Pos: straight from the mapping if there is one, otherwise through the stream
+static bool Arch_ReadAt( iIStream* Source, uint64 Pos, ubyte* Buf, uint64 Size )
+{
+	if ( Pos + Size > Source->GetSize() ) { return false; }
+
+	if ( Source->MapStream() )
+	{
+		memcpy( Buf, Source->MapStream() + Pos, static_cast<size_t>( Size ) );
+		return true;
+	}
+
+	Source->Seek( Pos );
+
+	return Source->Read( Buf, Size ) == Size;
+}
+
+static inline unsigned int Arch_GetUInt16( const ubyte* P ) { return P[0] | ( P[1] << 8 ); }
+static inline unsigned int Arch_GetUInt32( const ubyte* P ) { return P[0] | ( P[1] << 8 ) | ( P[2] << 16 ) | ( ( unsigned int )P[3] << 24 ); }
+
+/// Find the data of a stored entry from its central directory record and local header, without opening the entry.
+/// Returns false for the layouts we do not parse (self-extracting or zip64 archives), the caller asks unzip then
+static bool Arch_GetStoredDataOffset( iIStream* Source, uint64 DirOffset, uint64* Offset )
+{
+	/// Central directory file header, the relative offset of the local header is at 42
+	ubyte Record[46];
+
+	if ( !Arch_ReadAt( Source, DirOffset, Record, sizeof( Record ) ) || Arch_GetUInt32( Record ) != 0x02014b50 ) { return false; }
+
+	uint64 LocalOffset = Arch_GetUInt32( Record + 42 );
+
+	if ( LocalOffset == 0xFFFFFFFF ) { return false; }
+
+	/// Local file header, the name and the extra field lengths may differ from the central directory ones
+	ubyte Local[30];
+
+	if ( !Arch_ReadAt( Source, LocalOffset, Local, sizeof( Local ) ) || Arch_GetUInt32( Local ) != 0x04034b50 ) { return false; }
+
+	*Offset = LocalOffset + sizeof( Local ) + Arch_GetUInt16( Local + 26 ) + Arch_GetUInt16( Local + 28 );
+
+	return true;
+}
+
+bool ArchiveReader::Enumerate_ZIP( uint64 SourceTime )
 {
 	clPtr<iIStream> TheSource = FSourceFile;
 	FSourceFile->Seek( 0 );
@@ -193,9 +338,16 @@ bool ArchiveReader::Enumerate_ZIP()
 
 	unzFile uf = unzOpen2_64( "", &ffunc );
 
+	if ( !uf ) { return false; }
+
 	unz_global_info64 gi;
 	int err = unzGetGlobalInfo64( uf, &gi );
 
+	std::vector<sArchiveIndexEntry> Entries;
+	std::string Names;
+
+	Entries.reserve( static_cast<size_t>( gi.number_entry ) );
+
 	for ( uLong i = 0; i < gi.number_entry; i++ )
 	{
 		char filename_inzip[256];
@@ -204,6 +356,39 @@ bool ArchiveReader::Enumerate_ZIP()
 
 		if ( err != UNZ_OK ) { break; }
 
+		std::string TheName = Arch_FixFileName( filename_inzip );
+
+		sArchiveIndexEntry Info;
+		Info.FHash = Arch_HashFileName( TheName.c_str() );
+		Info.FMethod = ( unsigned int )file_info.compression_method;
+		Info.FCRC = ( unsigned int )file_info.crc;
+		Info.FNameOffset = ( unsigned int )Names.size();
+		Info.FDirOffset = ( uint64 )unzGetOffset64( uf );
+		Info.FOffset = 0;
+		Info.FCompressedSize = file_info.compressed_size;
+		Info.FSize = file_info.uncompressed_size;
+
+		/// Remember where the data of stored (uncompressed and unencrypted) entries begins, so they can be mapped in-place.
+		/// Unzip seeks before every read, so the headers can be read through the same source
+		if ( Info.FMethod == 0 && !( file_info.flag & 1 ) && Info.FCompressedSize == Info.FSize )
+		{
+			uint64 Offset = 0;
+			int Method = 0;
+
+			if ( Arch_GetStoredDataOffset( TheSource.GetInternalPtr(), Info.FDirOffset, &Offset ) )
+			{
+				if ( Offset + Info.FSize <= FSourceFile->GetSize() ) { Info.FOffset = Offset; }
+			}
+			else if ( unzOpenCurrentFile2( uf, &Method, NULL, 1 ) == UNZ_OK )
+			{
+				Offset = ( uint64 )unzGetCurrentFileZStreamPos64( uf );
+
+				if ( Offset + Info.FSize <= FSourceFile->GetSize() ) { Info.FOffset = Offset; }
+
+				unzCloseCurrentFile( uf );
+			}
+		}
+
 		if ( ( i + 1 ) < gi.number_entry )
 		{
 			err = unzGoToNextFile( uf );
@@ -212,73 +397,495 @@ bool ArchiveReader::Enumerate_ZIP()
 			if ( err != UNZ_OK ) { break; }
 		}
 
-		sFileInfo Info;
-		Info.FOffset = 0;
-		Info.FCompressedSize = file_info.compressed_size;
-		Info.FSize = file_info.uncompressed_size;
-		FFileInfos.push_back( Info );
+		Entries.push_back( Info );
 
-		std::string TheName = Arch_FixFileName( filename_inzip );
-		FFileInfoIdx[TheName] = ( int )FFileNames.size();
-		FFileNames.push_back( TheName );
-		FRealFileNames.push_back( std::string( filename_inzip ) );
+		Names.append( TheName.c_str(), TheName.length() + 1 );
 	}
 
 	unzClose( uf );
+
+	/// Keep the hash table at most half full
+	unsigned int NumBuckets = 16;
+
+	while ( NumBuckets < 2 * Entries.size() ) { NumBuckets *= 2; }
+
+	std::vector<unsigned int> Buckets( NumBuckets, ARCHIVE_INDEX_NO_ENTRY );
+
+	/// Insert in reverse order so that later duplicates shadow earlier ones
+	for ( int i = ( int )Entries.size() - 1; i >= 0; i-- )
+	{
+		unsigned int b = Entries[i].FHash & ( NumBuckets - 1 );
+
+		while ( Buckets[b] != ARCHIVE_INDEX_NO_ENTRY ) { b = ( b + 1 ) & ( NumBuckets - 1 ); }
+
+		Buckets[b] = ( unsigned int )i;
+	}
+
+	sArchiveIndexHeader Header;
+	Header.FMagic = ARCHIVE_INDEX_MAGIC;
+	Header.FVersion = ARCHIVE_INDEX_VERSION;
+	Header.FArchiveSize = FSourceFile->GetSize();
+	Header.FArchiveTime = SourceTime;
+	Header.FNumEntries = ( unsigned int )Entries.size();
+	Header.FNumBuckets = NumBuckets;
+	Header.FNamesSize = Names.size();
+
+	/// Pack everything into a single block with the same layout as the index file
+	clPtr<clBlob> Index = new clBlob();
+	Index->AppendBytes( &Header, sizeof( Header ) );
+
+	if ( !Entries.empty() ) { Index->AppendBytes( &Entries[0], Entries.size() * sizeof( sArchiveIndexEntry ) ); }
+
+	Index->AppendBytes( &Buckets[0], Buckets.size() * sizeof( unsigned int ) );
+
+	if ( !Names.empty() ) { Index->AppendBytes( const_cast<char*>( Names.data() ), Names.size() ); }
+
+	ManagedMemRawFile* IndexFile = new ManagedMemRawFile();
+	IndexFile->SetBlob( Index );
+
+	FIndex = IndexFile;
+
 	return true;
 }
 
 /// end of .ZIP stuff
 
-bool ArchiveReader::ExtractSingleFile( const std::string& FName, const std::string& Password, int* AbortFlag, float* Progress, const clPtr<iOStream>& FOut )
+clPtr<iIStream> ArchiveReader::CreateCursor() const
 {
-	int err = UNZ_OK;
+	/// Memory-mapped sources are immutable, so every reader can have its own position over the same memory
+	if ( FSourceFile->MapStream() ) { return new FileMapper( new SubRawFile( FSourceFile, 0, FSourceFile->GetSize() ) ); }
 
-	std::string ZipName = FName;
-	std::replace( ZipName.begin(), ZipName.end(), '\\', '/' );
+	return FSourceFile;
+}
 
-	clPtr<iIStream> TheSource = FSourceFile;
-	FSourceFile->Seek( 0 );
+void* ArchiveReader::OpenZip( const clPtr<iIStream>& Cursor ) const
+{
+	Cursor->Seek( 0 );
 
-	/// Decompress the data
 	zlib_filefunc64_def ffunc;
-	fill_functions( TheSource.GetInternalPtr(), &ffunc );
+	fill_functions( Cursor.GetInternalPtr(), &ffunc );
 
-	unzFile uf = unzOpen2_64( "", &ffunc );
+	return unzOpen2_64( "", &ffunc );
+}
+
+bool ArchiveReader::ExtractEntry_ZIP( void* Zip, int idx, const char* Password, int* AbortFlag, float* Progress, const clPtr<iOStream>& FOut ) const
+{
+	/// Jump straight to the file record in the central directory instead of scanning it with unzLocateFile()
+	int err = unzSetOffset64( ( unzFile )Zip, GetEntry( idx )->FDirOffset );
 
-	if ( unzLocateFile( uf, ZipName.c_str(), 0/*CASESENSITIVITY - insensitive*/ ) != UNZ_OK )
+	if ( err == UNZ_OK )
+	{
+		err = ExtractCurrentFile_ZIP( ( unzFile )Zip, Password, AbortFlag, Progress, FOut );
+	}
+
+	return ( err == UNZ_OK );
+}
+
+bool ArchiveReader::ExtractSingleFile( const std::string& FName, const std::string& Password, int* AbortFlag, float* Progress, const clPtr<iOStream>& FOut )
+{
+	int idx = GetFileIdx( Arch_FixFileName( FName ) );
+
+	if ( idx < 0 )
 	{
 		// WARNING: "File %s not found in the zipfile\n", FName.c_str()
 		return false;
 	}
 
-	err = ExtractCurrentFile_ZIP( uf, Password.empty() ? NULL : Password.c_str(), AbortFlag, Progress, FOut );
+	clPtr<iIStream> Cursor = CreateCursor();
 
-	unzClose( uf );
+	/// Unmapped sources have a single shared position
+	const clMutex* Guard = ( Cursor == FSourceFile ) ? &FSourceMutex : NULL;
 
-	return ( err == UNZ_OK );
+	if ( Guard ) { Guard->Lock(); }
+
+	void* Zip = OpenZip( Cursor );
+
+	bool Result = Zip && ExtractEntry_ZIP( Zip, idx, Password.empty() ? NULL : Password.c_str(), AbortFlag, Progress, FOut );
+
+	if ( Zip ) { unzClose( ( unzFile )Zip ); }
+
+	if ( Guard ) { Guard->Unlock(); }
+
+	return Result;
+}
+
+clPtr<clBlob> ArchiveReader::GetFileData_ZIP( int idx, void* Zip, const clMutex* Guard )
+{
+	LIOTraceScope TraceScope( IOEvent_Decompress, GetFileName( idx ) );
+
+	clPtr<MemFileWriter> FOut = CreateMemWriter( "mem_blob", GetEntry( idx )->FSize );
+
+	if ( Zip )
+	{
+		if ( Guard ) { Guard->Lock(); }
+
+		bool Result = ExtractEntry_ZIP( Zip, idx, NULL, NULL, NULL, FOut );
+
+		if ( Guard ) { Guard->Unlock(); }
+
+		if ( !Result ) { return NULL; }
+	}
+	else if ( !ExtractSingleFile( GetFileName( idx ), "", NULL, NULL, FOut ) ) { return NULL; }
+
+	clPtr<clBlob> B = FOut->GetContainer();
+	B->SafeResize( static_cast<size_t>( FOut->GetFilePos() ) );
+
+	TraceScope.SetBytes( B->GetSize() );
+
+	IOTrace_Get().Count( IOCounter_BytesDecompressed, B->GetSize() );
+
+	return B;
 }
 
-const void* ArchiveReader::GetFileData_ZIP( size_t idx )
+/// The cached data is handed out as read-only views: a caller modifying its copy does not affect the others, and the views pin the cache entry
+static clPtr<clBlob> Arch_CreateView( const clPtr<clBlob>& Data )
 {
-	if ( FExtractedFromArchive.count( ( int )idx ) > 0 ) { return FExtractedFromArchive[( int )idx]; }
+	clPtr<clBlob> View = new clBlob();
+	View->SetReadOnlyData( Data->GetDataConst(), Data->GetSize(), Data );
 
-	clPtr<MemFileWriter> FOut = CreateMemWriter( "mem_blob", FFileInfos[idx].FSize );
+	return View;
+}
 
-	void* DataPtr = NULL;
+clPtr<clBlob> ArchiveReader::GetFileData( const std::string& FileName )
+{
+	int idx = GetFileIdx( FileName );
 
-	if ( ExtractSingleFile( FRealFileNames[idx], "", NULL, NULL, FOut ) )
+	if ( idx < 0 ) { return NULL; }
+
+	return GetCachedFileData( idx, NULL, NULL );
+}
+
+clPtr<clBlob> ArchiveReader::GetCachedFileData( int idx, void* Zip, const clMutex* Guard )
+{
+	/// Stored entries are not extracted, we point directly into the archive
+	if ( IsStored( idx ) )
+	{
+		clPtr<clBlob> B = new clBlob();
+		B->SetReadOnlyData( GetStoredFileData( idx ), static_cast<size_t>( GetEntry( idx )->FSize ), FSourceFile );
+		return B;
+	}
+
+	/// Check if we already have this data in cache
+	{
+		LMutex Lock( &FExtractedMutex );
+
+		std::map<int, sCachedFile>::iterator i = FExtractedFromArchive.find( idx );
+
+		if ( i != FExtractedFromArchive.end() )
+		{
+			FHits++;
+
+			IOTrace_Get().Count( IOCounter_CacheHits, 1 );
+
+			/// Move to the front of the LRU list
+			FLRU.splice( FLRU.begin(), FLRU, i->second.FUsage );
+
+			return Arch_CreateView( i->second.FData );
+		}
+
+		FMisses++;
+
+		IOTrace_Get().Count( IOCounter_CacheMisses, 1 );
+	}
+
+	const sContentHash Hash( GetEntry( idx )->FCRC, GetEntry( idx )->FSize, 0 );
+
+	/// Another mounted container might have already decoded the same data. The content cache returns a view which only this archive references
+	clPtr<clBlob> Data = FContentCache ? FContentCache->Find( Hash ) : NULL;
+
+	if ( !Data )
+	{
+		/// Decompress/extract the data, other threads can extract in the meantime
+		Data = GetFileData_ZIP( idx, Zip, Guard );
+
+		if ( !Data ) { return NULL; }
+
+		if ( FContentCache ) { Data = FContentCache->Insert( Hash, Data ); }
+	}
+
+	LMutex Lock( &FExtractedMutex );
+
+	/// Somebody was faster, use the existing copy
+	std::map<int, sCachedFile>::iterator i = FExtractedFromArchive.find( idx );
+
+	if ( i != FExtractedFromArchive.end() ) { return Arch_CreateView( i->second.FData ); }
+
+	FLRU.push_front( idx );
+
+	sCachedFile& Entry = FExtractedFromArchive[idx];
+	Entry.FData = Data;
+	Entry.FUsage = FLRU.begin();
+
+	FCachedBytes += Data->GetSize();
+
+	TrimCache();
+
+	return Arch_CreateView( Data );
+}
+
+clPtr<iIStream> ArchiveReader::OpenFileStream( const std::string& FileName )
+{
+	int idx = GetFileIdx( FileName );
+
+	if ( idx < 0 ) { return NULL; }
+
+	if ( IsStored( idx ) )
+	{
+		SubRawFile* View = new SubRawFile( FSourceFile, GetEntry( idx )->FOffset, GetEntry( idx )->FSize );
+
+		View->SetFileName( FileName );
+		View->SetVirtualFileName( FileName );
+
+		/// No release-behind here, the view shares the archive mapping with the other readers
+		return new FileMapper( View );
+	}
+
+	clPtr<clArchiveEntryStream> Stream = new clArchiveEntryStream( this, idx, FileName );
+
+	return Stream->IsValid() ? Stream : NULL;
+}
+
+void ArchiveReader::TrimCache()
+{
+	std::list<int>::iterator i = FLRU.end();
+
+	while ( FCachedBytes > FCacheBudget && i != FLRU.begin() )
+	{
+		--i;
+
+		std::map<int, sCachedFile>::iterator Entry = FExtractedFromArchive.find( *i );
+
+		/// Pinned: somebody is still reading this data, evicting it would not free anything.
+		/// The views handed out by GetFileData() refer to the entry, other mount points sharing the data hold views of their own
+		if ( Entry->second.FData->GetReferenceCounter() > 1 ) { continue; }
+
+		FCachedBytes -= Entry->second.FData->GetSize();
+		FEvictions++;
+
+		FExtractedFromArchive.erase( Entry );
+
+		i = FLRU.erase( i );
+	}
+}
+
+void ArchiveReader::SetCacheBudget( uint64 Bytes )
+{
+	LMutex Lock( &FExtractedMutex );
+
+	FCacheBudget = Bytes;
+
+	TrimCache();
+}
+
+ArchiveReader::sCacheStats ArchiveReader::GetCacheStats() const
+{
+	LMutex Lock( &FExtractedMutex );
+
+	sCacheStats Stats;
+	Stats.FHits = FHits;
+	Stats.FMisses = FMisses;
+	Stats.FEvictions = FEvictions;
+	Stats.FBytes = FCachedBytes;
+	Stats.FEntries = FExtractedFromArchive.size();
+
+	return Stats;
+}
+
+/// Shared state of the ExtractFiles() workers
+struct sExtractBatch
+{
+	ArchiveReader*                  FReader;
+	const std::vector<std::string>* FFileNames;
+	clPtr<iArchiveExtractCallback>  FCallback;
+	/// Number of files not yet taken by any worker
+	volatile long                   FRemaining;
+};
+
+void ArchiveReader::ExtractWorker( void* Param )
+{
+	sExtractBatch* Batch = reinterpret_cast<sExtractBatch*>( Param );
+	ArchiveReader* Reader = Batch->FReader;
+
+	/// Each worker has its own cursor and unzip handle for the whole batch
+	clPtr<iIStream> Cursor = Reader->CreateCursor();
+
+	/// The position of an unmapped source is shared with everybody else, so it is locked for each entry as in clArchiveEntryStream
+	const clMutex* Guard = ( Cursor == Reader->FSourceFile ) ? &Reader->FSourceMutex : NULL;
+
+	if ( Guard ) { Guard->Lock(); }
+
+	void* Zip = Reader->OpenZip( Cursor );
+
+	if ( Guard ) { Guard->Unlock(); }
+
+	const long Count = ( long )Batch->FFileNames->size();
+
+	for ( long Left = Atomic::Dec( &Batch->FRemaining ); Left >= 0; Left = Atomic::Dec( &Batch->FRemaining ) )
+	{
+		const std::string& Name = ( *Batch->FFileNames )[ Count - 1 - Left ];
+
+		int idx = Reader->GetFileIdx( Arch_FixFileName( Name ) );
+
+		/// The extracted files go through the same caches as GetFileData(), so a batch preload is not decompressed again later
+		clPtr<clBlob> Data = ( idx > -1 && Zip ) ? Reader->GetCachedFileData( idx, Zip, Guard ) : NULL;
+
+		Batch->FCallback->FileExtracted( Name, Data );
+	}
+
+	if ( Zip ) { unzClose( ( unzFile )Zip ); }
+}
+
+void ArchiveReader::ExtractFiles( const std::vector<std::string>& FileNames, const clPtr<iArchiveExtractCallback>& Callback, int NumThreads )
+{
+	if ( FileNames.empty() || !Callback || !FIndex ) { return; }
+
+	if ( NumThreads <= 0 ) { NumThreads = ( int )tthread::thread::hardware_concurrency(); }
+
+	/// The shared stream of an unmapped source can not be read concurrently
+	if ( NumThreads <= 0 || !FSourceFile->MapStream() ) { NumThreads = 1; }
+
+	if ( NumThreads > ( int )FileNames.size() ) { NumThreads = ( int )FileNames.size(); }
+
+	sExtractBatch Batch;
+	Batch.FReader = this;
+	Batch.FFileNames = &FileNames;
+	Batch.FCallback = Callback;
+	Batch.FRemaining = ( long )FileNames.size();
+
+	std::vector<tthread::thread*> Workers;
+
+	for ( int i = 1; i < NumThreads; i++ ) { Workers.push_back( new tthread::thread( &ExtractWorker, &Batch ) ); }
+
+	/// The calling thread takes its share of work too
+	ExtractWorker( &Batch );
+
+	for ( size_t i = 0; i != Workers.size(); i++ )
+	{
+		Workers[i]->join();
+		delete Workers[i];
+	}
+}
+
+clArchiveEntryStream::clArchiveEntryStream( const clPtr<ArchiveReader>& Reader, int idx, const std::string& VirtualFileName )
+	: FReader( Reader ),
+	  FIndex( idx ),
+	  FVirtualFileName( VirtualFileName ),
+	  FZip( NULL ),
+	  FGuard( NULL ),
+	  FSize( Reader->GetEntry( idx )->FSize ),
+	  FPosition( 0 ),
+	  FInflatedPos( 0 )
+{
+	FCursor = FReader->CreateCursor();
+
+	/// The position of an unmapped source is shared with everybody else, so it is locked for each read and unzip seeks before every read anyway
+	FGuard = ( FCursor == FReader->FSourceFile ) ? &FReader->FSourceMutex : NULL;
+
+	if ( FGuard ) { FGuard->Lock(); }
+
+	FZip = FReader->OpenZip( FCursor );
+
+	if ( FGuard ) { FGuard->Unlock(); }
+
+	if ( FZip && !Restart() )
+	{
+		unzClose( ( unzFile )FZip );
+		FZip = NULL;
+	}
+}
+
+clArchiveEntryStream::~clArchiveEntryStream()
+{
+	if ( !FZip ) { return; }
+
+	unzCloseCurrentFile( ( unzFile )FZip );
+	unzClose( ( unzFile )FZip );
+}
+
+bool clArchiveEntryStream::Restart()
+{
+	if ( FGuard ) { FGuard->Lock(); }
+
+	/// Closing a file which has not been opened is harmless
+	unzCloseCurrentFile( ( unzFile )FZip );
+
+	int err = unzSetOffset64( ( unzFile )FZip, FReader->GetEntry( FIndex )->FDirOffset );
+
+	if ( err == UNZ_OK ) { err = unzOpenCurrentFile( ( unzFile )FZip ); }
+
+	if ( FGuard ) { FGuard->Unlock(); }
+
+	FInflatedPos = 0;
+
+	return ( err == UNZ_OK );
+}
+
+uint64 clArchiveEntryStream::Inflate( void* Buf, uint64 Size )
+{
+	/// Skipped data goes to a small scratch buffer
+	ubyte Scratch[ WRITEBUFFERSIZE ];
+
+	ubyte* Out = reinterpret_cast<ubyte*>( Buf );
+	uint64 Done = 0;
+
+	while ( Done < Size )
 	{
-		size_t Sz = static_cast<size_t>( FOut->GetFilePos() );
+		uint64 Chunk = Size - Done;
+
+		if ( !Out && Chunk > sizeof( Scratch ) ) { Chunk = sizeof( Scratch ); }
+
+		if ( Chunk > 0x40000000 ) { Chunk = 0x40000000; }
+
+		if ( FGuard ) { FGuard->Lock(); }
+
+		int Result = unzReadCurrentFile( ( unzFile )FZip, Out ? Out + Done : Scratch, ( unsigned )Chunk );
+
+		if ( FGuard ) { FGuard->Unlock(); }
+
+		if ( Result <= 0 ) { break; }
 
-		clPtr<clBlob> B = FOut->GetContainer();
-		B->SafeResize( Sz );
+		Done += Result;
+		FInflatedPos += Result;
+	}
+
+	return Done;
+}
+
+uint64 clArchiveEntryStream::Read( void* Buf, uint64 Size )
+{
+	if ( !FZip || Eof() ) { return 0; }
+
+	if ( FPosition < FInflatedPos && !Restart() ) { return 0; }
+
+	/// Skip up to the requested position
+	if ( FPosition > FInflatedPos ) { Inflate( NULL, FPosition - FInflatedPos ); }
+
+	/// The entry is shorter than the directory says or broken
+	if ( FPosition != FInflatedPos ) { return 0; }
+
+	if ( Size > FSize - FPosition ) { Size = FSize - FPosition; }
+
+	uint64 Done = Inflate( Buf, Size );
+
+	FPosition = FInflatedPos;
+
+	return Done;
+}
+
+std::string clArchiveEntryStream::ReadLine()
+{
+	std::string Line;
+
+	char Ch = 0;
+
+	while ( Read( &Ch, 1 ) == 1 )
+	{
+		if ( Ch == 13 ) { continue; }   // kill char
 
-		const void* BlobPtr = B->GetDataConst();
-		DataPtr = AllocData( Sz );
+		if ( Ch == 10 ) { break; }
 
-		::memcpy( DataPtr, BlobPtr, Sz );
+		Line.push_back( Ch );
 	}
 
-	return DataPtr;
+	return Line;
 }
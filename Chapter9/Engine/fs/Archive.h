@@ -35,57 +35,125 @@
 #pragma once
 
 #include "Streams.h"
+#include "Files.h"
+#include "Mutex.h"
+#include "ContentCache.h"
 #include <map>
+#include <list>
 #include <vector>
 
-/// Encapsulation of .zip archive management
-class ArchiveReader: public iObject
+/// Magic number of the archive index file ("AIDX")
+const unsigned int ARCHIVE_INDEX_MAGIC   = 0x58444941;
+const unsigned int ARCHIVE_INDEX_VERSION = 1;
+
+/// Header of the central directory index. The index is a single memory block: header, entries, hash buckets, names
+struct sArchiveIndexHeader
 {
-private:
-	/// Internal file information
-	struct sFileInfo
-	{
-		/// Offset to the file
-		uint64 FOffset;
-		/// (Uncompressed) File size
-		uint64 FSize;
-		/// Compressed file size
-		uint64 FCompressedSize;
-		/// Compressed data
-		void* FSourceData;
-	};
+	unsigned int FMagic;
+	unsigned int FVersion;
+	/// Size and modification time of the archive this index was built for
+	uint64       FArchiveSize;
+	uint64       FArchiveTime;
+	unsigned int FNumEntries;
+	/// Number of hash buckets (power of two)
+	unsigned int FNumBuckets;
+	/// Total size of the names block
+	uint64       FNamesSize;
+};
 
-	/// File information
-	std::vector<sFileInfo> FFileInfos;
+/// Single file record of the central directory index
+struct sArchiveIndexEntry
+{
+	/// Hash of the file name adapted for our VFS
+	unsigned int FHash;
+	/// Compression method (0 - stored, 8 - deflated)
+	unsigned int FMethod;
+	/// CRC32 of the uncompressed data
+	unsigned int FCRC;
+	/// Offset of the zero-terminated VFS file name in the names block
+	unsigned int FNameOffset;
+	/// Offset of the file record in the central directory (for unzSetOffset64)
+	uint64       FDirOffset;
+	/// Offset to the raw file data in the archive (valid for stored entries only)
+	uint64       FOffset;
+	/// (Uncompressed) File size
+	uint64       FSize;
+	/// Compressed file size
+	uint64       FCompressedSize;
+};
 
-	/// File names (adapted for our VFS - upper case, slash-separated path)
-	std::vector<std::string>   FFileNames;
+/// Default memory budget for the extracted files
+const uint64 ARCHIVE_CACHE_DEFAULT_BUDGET = 16 * 1024 * 1024;
 
-	/// Real (in-archive) file names
-	std::vector<std::string>   FRealFileNames;
+/// Empty hash bucket marker
+const unsigned int ARCHIVE_INDEX_NO_ENTRY = 0xFFFFFFFF;
 
-	/// File information indices (name to index map)
-	mutable std::map<std::string, int> FFileInfoIdx;
+/// FNV-1a hash of the file name
+inline unsigned int Arch_HashFileName( const char* Name )
+{
+	unsigned int Hash = 2166136261u;
 
-	/// Source file
-	clPtr<iIStream> FSourceFile;
+	while ( *Name ) { Hash = ( Hash ^ ( unsigned char )( *Name++ ) ) * 16777619u; }
+
+	return Hash;
+}
+
+/// Receives the results of ArchiveReader::ExtractFiles(). Invoked from the extraction threads
+class iArchiveExtractCallback: public iObject
+{
+public:
+	/// Data is NULL if the file could not be extracted
+	virtual void FileExtracted( const std::string& FileName, const clPtr<clBlob>& Data ) = 0;
+};
+
+/// Encapsulation of .zip archive management
+class ArchiveReader: public iObject
+{
 public:
-	ArchiveReader(): FSourceFile( NULL ) {}
+	ArchiveReader()
+		: FCachedBytes( 0 ),
+		  FCacheBudget( ARCHIVE_CACHE_DEFAULT_BUDGET ),
+		  FHits( 0 ),
+		  FMisses( 0 ),
+		  FEvictions( 0 ),
+		  FSourceFile( NULL ),
+		  FIndex( NULL ) {}
 	virtual ~ArchiveReader() { CloseArchive(); }
 
-	/// Assign the source stream and set the internal ownership flag
-	bool    OpenArchive( const clPtr<iIStream>& Source )
+	/**
+	   \brief Assign the source stream and read the archive directory
+
+	   If IndexFileName is not empty the central directory index is loaded from this file (if it is valid for the archive of SourceTime modification time)
+	   or built and saved there for the subsequent mounts
+	**/
+	bool    OpenArchive( const clPtr<iIStream>& Source, const std::string& IndexFileName = std::string(), uint64 SourceTime = 0 )
 	{
 		if ( !CloseArchive() ) { return false; }
 
 		FSourceFile = Source;
 
-		return ( !FSourceFile ) ? false : Enumerate_ZIP();
+		if ( !FSourceFile ) { return false; }
+
+		if ( !IndexFileName.empty() && LoadIndex( IndexFileName, SourceTime ) ) { return true; }
+
+		if ( !Enumerate_ZIP( SourceTime ) ) { return false; }
+
+		if ( !IndexFileName.empty() ) { SaveIndex( IndexFileName ); }
+
+		return true;
 	}
 
-	/// Extract a file from archive
+	/// Extract a file from archive. Thread-safe: every call reads the archive through its own cursor
 	bool    ExtractSingleFile( const std::string& FName, const std::string& Password, int* AbortFlag, float* Progress, const clPtr<iOStream>& FOut );
 
+	/**
+	   \brief Extract a batch of files on NumThreads worker threads (0 - one per CPU core)
+
+	   Each worker opens its own unzip handle over the shared memory-mapped source and inflates independently.
+	   The data is cached and handed out exactly as by GetFileData(). Returns when all the files are processed
+	*/
+	void    ExtractFiles( const std::vector<std::string>& FileNames, const clPtr<iArchiveExtractCallback>& Callback, int NumThreads = 0 );
+
 	/// Free everything and optionally close the source stream
 	bool    CloseArchive();
 
@@ -98,62 +166,217 @@ public:
 	uint64 GetFileSize( const std::string& FileName ) const
 	{
 		int idx = GetFileIdx( FileName );
-		return ( idx > -1 ) ? FFileInfos[idx].FSize : 0;
+		return ( idx > -1 ) ? GetEntry( idx )->FSize : 0;
 	}
 
-	/// Get the data for this file
-	const void*   GetFileData( const std::string& FileName )
+	/**
+	   \brief Get the data for this file
+
+	   Deflated files are extracted into the LRU cache. The returned blob pins the entry: it is not evicted while referenced.
+	   Stored files borrow the archive memory read-only (copy-on-write) and keep the archive mapping alive
+	*/
+	clPtr<clBlob> GetFileData( const std::string& FileName );
+
+	/**
+	   \brief Open a stream over the file data without extracting the whole file
+
+	   Deflated files are inflated on demand as the stream is read, so only the unzip read buffer and the inflate window are kept in memory.
+	   Stored files in a memory-mapped archive are read in-place. Returns NULL if there is no such file
+	*/
+	clPtr<iIStream> OpenFileStream( const std::string& FileName );
+
+	/// Share the extracted files with other readers through this cache (NULL to disable)
+	void    SetContentCache( const clPtr<clContentCache>& Cache ) { FContentCache = Cache; }
+	clPtr<clContentCache> GetContentCache() const { return FContentCache; }
+
+	/// Content identity of the file (CRC32 and size from the central directory)
+	bool    GetFileContentHash( const std::string& FileName, sContentHash* Hash ) const
 	{
 		int idx = GetFileIdx( FileName );
-		const void* DataPtr = NULL;
 
-		if ( idx > -1 )
-		{
-			/// Check if we already have this data in cache
-			if ( FExtractedFromArchive.count( idx ) > 0 ) { return FExtractedFromArchive[idx]; }
+		if ( idx < 0 ) { return false; }
+
+		*Hash = sContentHash( GetEntry( idx )->FCRC, GetEntry( idx )->FSize, 0 );
+
+		return true;
+	}
+
+	/// Set the memory budget for the extracted files cache
+	void    SetCacheBudget( uint64 Bytes );
+	uint64  GetCacheBudget() const { return FCacheBudget; }
 
-			/// Decompress/extract the data
-			DataPtr = GetFileData_ZIP( idx );
+	/// Cache efficiency counters
+	struct sCacheStats
+	{
+		uint64 FHits;
+		uint64 FMisses;
+		uint64 FEvictions;
+		/// Currently cached bytes and entries
+		uint64 FBytes;
+		size_t FEntries;
+	};
+
+	sCacheStats GetCacheStats() const;
 
-			if ( DataPtr ) { FExtractedFromArchive[idx] = DataPtr; }
-		}
+	/// Check if the file is stored in the archive without compression and can be accessed in-place
+	bool    IsFileStored( const std::string& FileName ) const
+	{
+		int idx = GetFileIdx( FileName );
+		return ( idx > -1 ) ? IsStored( idx ) : false;
+	}
 
-		return DataPtr;
+	/// Get the offset of stored file data inside the archive
+	uint64 GetFileOffset( const std::string& FileName ) const
+	{
+		int idx = GetFileIdx( FileName );
+		return ( idx > -1 ) ? GetEntry( idx )->FOffset : 0;
 	}
 
-	/// Convert file name to an internal linear index
-	int     GetFileIdx( const std::string& FileName ) const { return ( FFileInfoIdx.count( FileName ) > 0 ) ? FFileInfoIdx[FileName] : -1; }
+	/// Convert file name to an internal linear index (a single hash probe in the directory index)
+	int     GetFileIdx( const std::string& FileName ) const;
 
 	/// Get the number of files in archive
-	size_t  GetNumFiles() const { return FFileInfos.size(); }
+	size_t  GetNumFiles() const { return FIndex ? GetHeader()->FNumEntries : 0; }
 
 	/// Get i-th file name in archive
-	std::string GetFileName( int idx ) { return FFileNames[idx]; }
-public:
-	/// The number of files in archive, available soon after the Enumerate() is called
-	int FTotalFiles;
+	std::string GetFileName( int idx ) const { return std::string( GetEntryName( idx ) ); }
 
 private:
-	/// Internal function to enumerate the files in archive
-	bool Enumerate_ZIP();
+	friend class clArchiveEntryStream;
+
+	/// Internal function to enumerate the files in archive and build the directory index
+	bool Enumerate_ZIP( uint64 SourceTime );
+
+	/// Map the cached directory index if it matches the archive
+	bool LoadIndex( const std::string& IndexFileName, uint64 SourceTime );
+
+	/// Store the directory index for the subsequent mounts
+	bool SaveIndex( const std::string& IndexFileName ) const;
+
+	/// Decompress the idx-th file with the opened unzip handle (NULL - open a temporary one). Guard is locked around the extraction
+	clPtr<clBlob> GetFileData_ZIP( int idx, void* Zip, const clMutex* Guard );
+
+	/// GetFileData() for the idx-th file: check the LRU and the content caches, extract and insert the data on a miss
+	clPtr<clBlob> GetCachedFileData( int idx, void* Zip, const clMutex* Guard );
+
+	/// Create an independent read cursor over the immutable source
+	clPtr<iIStream> CreateCursor() const;
+
+	/// Open an unzip handle reading through the Cursor
+	void* OpenZip( const clPtr<iIStream>& Cursor ) const;
 
-	const void* GetFileData_ZIP( size_t idx );
+	/// Extract the idx-th file using the opened unzip handle
+	bool ExtractEntry_ZIP( void* Zip, int idx, const char* Password, int* AbortFlag, float* Progress, const clPtr<iOStream>& FOut ) const;
 
-	/// Remove each extracted file from tmp container
+	static void ExtractWorker( void* Param );
+
+	/// Stored entries with a known data offset inside a memory-mapped source can be used without extraction
+	bool IsStored( int idx ) const { return ( GetEntry( idx )->FMethod == 0 ) && ( GetEntry( idx )->FOffset > 0 ) && FSourceFile->MapStream(); }
+
+	const void* GetStoredFileData( int idx ) const { return FSourceFile->MapStream() + GetEntry( idx )->FOffset; }
+
+	#pragma region Directory index layout
+
+	const sArchiveIndexHeader* GetHeader() const { return reinterpret_cast<const sArchiveIndexHeader*>( FIndex->GetFileData() ); }
+
+	const sArchiveIndexEntry* GetEntry( int idx ) const { return reinterpret_cast<const sArchiveIndexEntry*>( GetHeader() + 1 ) + idx; }
+
+	const unsigned int* GetBuckets() const { return reinterpret_cast<const unsigned int*>( GetEntry( GetHeader()->FNumEntries ) ); }
+
+	const char* GetEntryName( int idx ) const { return reinterpret_cast<const char*>( GetBuckets() + GetHeader()->FNumBuckets ) + GetEntry( idx )->FNameOffset; }
+
+	#pragma endregion
+
+	/// Remove each extracted file from the cache
 	void ClearExtracted()
 	{
-		for ( std::map<int, const void*>::iterator i = FExtractedFromArchive.begin() ; i != FExtractedFromArchive.end() ; i++ )
-		{
-			this->FreeData( const_cast<void*>( i->second ) );
-		}
+		LMutex Lock( &FExtractedMutex );
 
 		FExtractedFromArchive.clear();
+		FLRU.clear();
+		FCachedBytes = 0;
 	}
 
-	inline void* AllocData( size_t Sz ) { return ::malloc( Sz ); }
+	/// Evict least recently used entries not referenced outside of the cache until we fit into the budget. FExtractedMutex should be locked
+	void TrimCache();
+
+	/// Cached entry
+	struct sCachedFile
+	{
+		clPtr<clBlob> FData;
+		/// Position in the LRU list
+		std::list<int>::iterator FUsage;
+	};
+
+	/// Cache for the extracted files. Cleared on CloseArchive() call
+	std::map<int, sCachedFile> FExtractedFromArchive;
+	/// Most recently used entries go first
+	std::list<int>             FLRU;
+	uint64                     FCachedBytes;
+	uint64                     FCacheBudget;
+	uint64                     FHits;
+	uint64                     FMisses;
+	uint64                     FEvictions;
+	clMutex                    FExtractedMutex;
+
+	/// Serializes access to the source stream if it can not be memory-mapped
+	clMutex                    FSourceMutex;
+
+	/// Identical files from all the mounted containers share the data through this cache
+	clPtr<clContentCache> FContentCache;
+
+	/// Source file
+	clPtr<iIStream> FSourceFile;
+
+	/// Central directory index: either a memory-mapped cache file or a freshly built memory block
+	clPtr<iRawFile> FIndex;
+};
+
+/// Sequential reader of a single archive entry which inflates the data as Read() is called
+class clArchiveEntryStream: public iIStream
+{
+public:
+	clArchiveEntryStream( const clPtr<ArchiveReader>& Reader, int idx, const std::string& VirtualFileName );
+	virtual ~clArchiveEntryStream();
+
+	/// Check if the unzip handle has been opened successfully
+	bool IsValid() const { return FZip != NULL; }
+
+	virtual std::string  GetVirtualFileName() const { return FVirtualFileName; }
+	virtual std::string  GetFileName() const { return FVirtualFileName; }
+
+	/// Seeking is lazy: forward seeks skip the data on the next Read(), backward seeks restart inflation from the beginning of the entry
+	virtual void         Seek( const uint64 Position ) { FPosition = ( Position > FSize ) ? FSize : Position; }
+	virtual uint64       Read( void* Buf, uint64 Size );
+	virtual bool         Eof() const { return FPosition >= FSize; }
+	virtual uint64       GetSize() const { return FSize; }
+	virtual uint64       GetPos() const { return FPosition; }
+
+	/// The data is never fully present in memory, so it can not be mapped
+	virtual const ubyte* MapStream() const { return NULL; }
+	virtual const ubyte* MapStreamFromCurrentPos() const { return NULL; }
+
+	virtual std::string  ReadLine();
+
+private:
+	/// Reopen the entry and start inflating from the first byte
+	bool   Restart();
+	/// Inflate Size bytes into Buf (or skip them if Buf is NULL). Returns the number of bytes actually produced
+	uint64 Inflate( void* Buf, uint64 Size );
+
+	clPtr<ArchiveReader> FReader;
+	int                  FIndex;
+	std::string          FVirtualFileName;
 
-	inline void FreeData( void* DataPtr ) { ::free( DataPtr ); }
+	/// Own read cursor and unzip handle
+	clPtr<iIStream>      FCursor;
+	void*                FZip;
+	/// Guards the shared position of an unmapped source
+	const clMutex*       FGuard;
 
-	/// Temporary cache for the extracted files. Removed on CloseArchive() call
-	std::map<int, const void*> FExtractedFromArchive;
+	uint64               FSize;
+	/// Position requested by the user
+	uint64               FPosition;
+	/// Number of bytes inflated so far
+	uint64               FInflatedPos;
 };
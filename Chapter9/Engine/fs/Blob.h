@@ -38,16 +38,165 @@
 #include <malloc.h>
 #include <string.h>
 
+#include <algorithm>
+#include <vector>
+
 #include "iObject.h"
 #include "iIntrusivePtr.h"
 
 #undef min
 #undef max
 
+/// Blobs up to this size keep their data inside the clBlob object itself
+const size_t BLOB_INLINE_SIZE = 32;
+
+/// The first heap block allocated by clBlob::AppendBytes()
+const size_t BLOB_MIN_APPEND_CAPACITY = 8192;
+
+/// Memory provider for clBlob
+class iBlobAllocator
+{
+public:
+	virtual ~iBlobAllocator() {}
+
+	virtual void* Alloc( size_t Size ) = 0;
+	/// Resize the block of OldSize bytes preserving its contents
+	virtual void* Realloc( void* Ptr, size_t OldSize, size_t NewSize ) = 0;
+	virtual void  Free( void* Ptr, size_t Size ) = 0;
+};
+
+/// Default clBlob allocator
+class clMallocBlobAllocator: public iBlobAllocator
+{
+public:
+	virtual void* Alloc( size_t Size ) { return ::malloc( Size ); }
+	virtual void* Realloc( void* Ptr, size_t /*OldSize*/, size_t NewSize ) { return ::realloc( Ptr, NewSize ); }
+	virtual void  Free( void* Ptr, size_t /*Size*/ ) { ::free( Ptr ); }
+
+	static clMallocBlobAllocator* Instance()
+	{
+		static clMallocBlobAllocator TheAllocator;
+		return &TheAllocator;
+	}
+};
+
+/**
+   \brief Linear allocator for short-lived blobs (e.g. the data of a single frame or a single request)
+
+   Allocation is a pointer bump, Free() only reclaims the most recent block. Everything is released at once by Reset().
+   Not thread-safe: use one arena per thread.
+*/
+class clBlobArena: public iBlobAllocator
+{
+public:
+	explicit clBlobArena( size_t ChunkSize = 256 * 1024 ): FChunkSize( ChunkSize ), FCurrentChunk( 0 ), FLastBlock( NULL ) {}
+	virtual ~clBlobArena()
+	{
+		for ( size_t i = 0; i != FChunks.size(); i++ ) { ::free( FChunks[i].FMemory ); }
+	}
+
+	virtual void* Alloc( size_t Size )
+	{
+		Size = Align( Size );
+
+		// look for a chunk with enough space left, the chunks before FCurrentChunk are full
+		for ( ; FCurrentChunk < FChunks.size(); FCurrentChunk++ )
+		{
+			sChunk& C = FChunks[FCurrentChunk];
+
+			if ( C.FSize - C.FUsed >= Size )
+			{
+				FLastBlock = C.FMemory + C.FUsed;
+				C.FUsed += Size;
+				return FLastBlock;
+			}
+		}
+
+		sChunk C;
+		C.FSize   = std::max( Size, FChunkSize );
+		C.FUsed   = Size;
+		C.FMemory = ( ubyte* )::malloc( C.FSize );
+
+		if ( !C.FMemory ) { return NULL; }
+
+		FChunks.push_back( C );
+		FCurrentChunk = FChunks.size() - 1;
+
+		return FLastBlock = C.FMemory;
+	}
+
+	virtual void* Realloc( void* Ptr, size_t OldSize, size_t NewSize )
+	{
+		if ( !Ptr ) { return Alloc( NewSize ); }
+
+		// the most recent block can grow in place
+		if ( Ptr == FLastBlock && FCurrentChunk < FChunks.size() )
+		{
+			sChunk& C = FChunks[FCurrentChunk];
+			size_t Offset = ( ubyte* )Ptr - C.FMemory;
+
+			if ( Offset + Align( NewSize ) <= C.FSize )
+			{
+				C.FUsed = Offset + Align( NewSize );
+				return Ptr;
+			}
+		}
+
+		void* NewPtr = Alloc( NewSize );
+
+		if ( NewPtr ) { memcpy( NewPtr, Ptr, std::min( OldSize, NewSize ) ); }
+
+		return NewPtr;
+	}
+
+	virtual void Free( void* Ptr, size_t /*Size*/ )
+	{
+		if ( Ptr != FLastBlock || FCurrentChunk >= FChunks.size() ) { return; }
+
+		FChunks[FCurrentChunk].FUsed = ( ubyte* )Ptr - FChunks[FCurrentChunk].FMemory;
+		FLastBlock = NULL;
+	}
+
+	/// Release all the blocks. No blob allocated from this arena may be alive
+	void Reset()
+	{
+		for ( size_t i = 0; i != FChunks.size(); i++ ) { FChunks[i].FUsed = 0; }
+
+		FCurrentChunk = 0;
+		FLastBlock = NULL;
+	}
+
+	/// Total amount of memory requested from the system
+	size_t GetReservedSize() const
+	{
+		size_t Total = 0;
+
+		for ( size_t i = 0; i != FChunks.size(); i++ ) { Total += FChunks[i].FSize; }
+
+		return Total;
+	}
+
+private:
+	static size_t Align( size_t Size ) { return ( Size + 15 ) & ~static_cast<size_t>( 15 ); }
+
+	struct sChunk
+	{
+		ubyte* FMemory;
+		size_t FSize;
+		size_t FUsed;
+	};
+
+	std::vector<sChunk> FChunks;
+	size_t FChunkSize;
+	size_t FCurrentChunk;
+	void*  FLastBlock;
+};
+
 class clBlob: public iObject
 {
 public:
-	clBlob(): FData( NULL ), FOwnsData( true ), FSize( 0 ), FCurrentPos( 0 ), FAllocatedSize( 0 ) {}
+	clBlob(): FData( NULL ), FSize( 0 ), FAllocatedSize( 0 ), FOwnsData( true ), FReadOnly( false ), FAllocator( clMallocBlobAllocator::Instance() ), FCurrentPos( 0 ) {}
+	explicit clBlob( iBlobAllocator* Allocator ): FData( NULL ), FSize( 0 ), FAllocatedSize( 0 ), FOwnsData( true ), FReadOnly( false ), FAllocator( Allocator ), FCurrentPos( 0 ) {}
 	virtual ~clBlob() { Delete(); }
 
 	/// Set the blob data pointer to some external memory block
@@ -61,11 +210,30 @@ public:
 		FOwnsData = false;
 	}
 
-	/// Constant access to the blob's data
+	/**
+	   \brief Borrow a read-only memory block (e.g. a file mapping) without copying it
+
+	   Owner is kept alive as long as the blob refers to the block. The block is copied on the first modification (or GetData() call)
+	*/
+	void SetReadOnlyData( const void* Ptr, size_t Sz, const clPtr<iObject>& Owner )
+	{
+		// Owner may be the current FDataOwner which is released by SetExternalData()
+		clPtr<iObject> KeepAlive( Owner );
+
+		SetExternalData( const_cast<void*>( Ptr ), Sz );
+
+		FDataOwner = KeepAlive;
+		FReadOnly = true;
+	}
+
+	/// Check if the blob borrows a read-only memory block
+	bool IsReadOnly() const { return FReadOnly; }
+
+	/// Constant access to the blob's data. Never copies
 	inline void* GetDataConst() const { return FData; }
 
-	/// Direct access to blob's data
-	inline void* GetData() { return FData; }
+	/// Direct access to blob's data. Makes a private copy of the borrowed read-only data
+	inline void* GetData() { MakeWritable(); return FData; }
 
 	/// Alias (setter method) for the reallocator
 	void SetSize( size_t NewSize ) { Reallocate( NewSize ); }
@@ -73,11 +241,78 @@ public:
 	/// Get current blob size
 	size_t GetSize() const { return FSize; }
 
+	/// Get the number of bytes the blob can hold without reallocation
+	size_t GetCapacity() const { return FAllocatedSize; }
+
 	/// Check if this blob manages its own contents
 	bool OwnsData() const { return FOwnsData; }
 
-	/// Change ownership of the memory block
-	void SetOwnership( bool Ownership ) { FOwnsData = Ownership; }
+	/// Change ownership of the memory block. The new owner of a heap block must release it with the blob's allocator
+	void SetOwnership( bool Ownership )
+	{
+		MakeWritable();
+
+		// the inline storage dies with the blob, so hand out a heap copy instead
+		if ( !Ownership && IsInline() ) { Grow( BLOB_INLINE_SIZE + 1, true ); }
+
+		FOwnsData = Ownership;
+	}
+
+	/// Use another allocator. The owned data is moved to the new allocator
+	void SetAllocator( iBlobAllocator* Allocator )
+	{
+		if ( Allocator == FAllocator ) { return; }
+
+		if ( FOwnsData && FData && !IsInline() )
+		{
+			void* NewData = Allocator->Alloc( FAllocatedSize );
+
+			if ( !NewData ) { return; }
+
+			memcpy( NewData, FData, FSize );
+			FAllocator->Free( FData, FAllocatedSize );
+			FData = NewData;
+		}
+
+		FAllocator = Allocator;
+	}
+
+	iBlobAllocator* GetAllocator() const { return FAllocator; }
+
+	/// Make sure Capacity bytes can be stored without reallocation. The contents are preserved
+	bool Reserve( size_t Capacity )
+	{
+		MakeWritable();
+
+		if ( Capacity <= FAllocatedSize ) { return true; }
+
+		if ( !FOwnsData && FData ) { return false; }
+
+		return Grow( Capacity, true );
+	}
+
+	/// Release the unused capacity
+	void ShrinkToFit()
+	{
+		if ( !FOwnsData || FReadOnly || !FData || IsInline() || FSize == FAllocatedSize ) { return; }
+
+		if ( FSize <= BLOB_INLINE_SIZE )
+		{
+			// move back to the inline storage
+			memcpy( FInline, FData, FSize );
+			FAllocator->Free( FData, FAllocatedSize );
+			FData = FInline;
+			FAllocatedSize = BLOB_INLINE_SIZE;
+			return;
+		}
+
+		void* NewData = FAllocator->Realloc( FData, FAllocatedSize, FSize );
+
+		if ( !NewData ) { return; }
+
+		FData = NewData;
+		FAllocatedSize = FSize;
+	}
 
 	/// Make a local copy of the other blob. Can change memory ownership of this blob on reallocation
 	bool CopyBlob( const clPtr<clBlob>& Other ) { return CopyMemoryBlock( Other->GetDataConst(), Other->GetSize() ); }
@@ -105,9 +340,7 @@ public:
 		if ( ( !FromData ) || ( FromSize <= 0 ) ) { return false; }
 
 		// only re-allocate if not enough space
-		Reallocate( FromSize );
-
-		this->FSize = FromSize;
+		if ( !Reallocate( FromSize ) ) { return false; }
 
 		memcpy( this->FData, FromData, FromSize );
 
@@ -123,32 +356,30 @@ public:
 	T GetPOD( size_t Offset ) { T Tmp; GetBytes( Offset, sizeof( T ), ( ubyte* )&Tmp ); return Tmp; }
 
 	/// Item access
-	void SetByte( size_t Offset, ubyte TheByte ) { ( ( ubyte* )FData )[Offset] = TheByte; }
+	void SetByte( size_t Offset, ubyte TheByte ) { MakeWritable(); ( ( ubyte* )FData )[Offset] = TheByte; }
 
 	/// Quick access to the specififed byte. No range checking
 	ubyte GetByte( size_t Offset ) const { return ( ( ubyte* )FData )[Offset]; }
 
-	void SetBytes( size_t Offset, size_t Num, const ubyte* Src ) { memcpy( ( ubyte* )FData + Offset, Src, Num ); }
+	void SetBytes( size_t Offset, size_t Num, const ubyte* Src ) { MakeWritable(); memcpy( ( ubyte* )FData + Offset, Src, Num ); }
 	void GetBytes( size_t Offset, size_t Num, ubyte* Out ) const { memcpy( Out, ( ubyte* )FData + Offset, Num ); }
-	bool AppendBytes( void* Data, size_t Size )
+
+	/// Append the bytes to the end of the blob. The capacity grows geometrically, so a series of appends costs amortized O(1) per byte
+	bool AppendBytes( const void* Data, size_t Size )
 	{
-		const size_t BlobInitialSize = 8192;
+		MakeWritable();
 
-		bool ShouldGrow = ( GetSize() + Size ) > FAllocatedSize;
+		size_t Required = GetSize() + Size;
 
-		if ( ShouldGrow )
+		if ( Required > FAllocatedSize )
 		{
-			if ( !FOwnsData ) { return false; }
-
-			size_t NewSize1 = GetSize() + Size;
-			size_t NewSize2 = NewSize1; // FAllocatedSize * 2;
+			if ( !FOwnsData && FData ) { return false; }
 
-			size_t NewSize = std::max( NewSize1, NewSize2 );
+			size_t NewSize = GetGrowCapacity( Required );
 
-			if ( NewSize < BlobInitialSize ) { NewSize = BlobInitialSize; }
+			if ( NewSize > BLOB_INLINE_SIZE && NewSize < BLOB_MIN_APPEND_CAPACITY ) { NewSize = BLOB_MIN_APPEND_CAPACITY; }
 
-			FData = realloc( FData, NewSize );
-			FAllocatedSize = NewSize;
+			if ( !Grow( NewSize, true ) ) { return false; }
 		}
 
 		memcpy( ( ubyte* )FData + FSize, Data, Size );
@@ -180,23 +411,18 @@ public:
 	/// Resize and do not spoil the contents
 	bool SafeResize( size_t NewSize )
 	{
-		if ( !FOwnsData ) { return false; }
+		MakeWritable();
 
-		if ( !FData ) { Allocate( NewSize ); return true; }
+		if ( !FOwnsData ) { return false; }
 
 		/// No reallocations needed ?
-		if ( NewSize <= FSize )
+		if ( NewSize > FAllocatedSize )
 		{
-			FSize = NewSize;
-
-			return true;
+			// grow geometrically, the blob is likely to be resized again (e.g. by MemFileWriter)
+			if ( !Grow( FData ? GetGrowCapacity( NewSize ) : NewSize, true ) ) { return false; }
 		}
 
-		FData = ::realloc( FData, NewSize );
-
-		if ( !FData ) { return false; }
-
-		FSize = FAllocatedSize = NewSize;
+		FSize = NewSize;
 
 		return true;
 	}
@@ -214,48 +440,114 @@ private:
 	/// True if this Blob manages and deallocates the memory block
 	bool   FOwnsData;
 
+	/// True if FData is borrowed from FDataOwner and must be copied before modification
+	bool   FReadOnly;
+
+	/// Keeps the borrowed read-only block alive
+	clPtr<iObject> FDataOwner;
+
+	/// Provides the heap blocks
+	iBlobAllocator* FAllocator;
+
+	/// Storage for tiny blobs, saves a heap allocation
+	uint64 FInline[ BLOB_INLINE_SIZE / sizeof( uint64 ) ];
+
+	clBlob( const clBlob& );
+	clBlob& operator = ( const clBlob& );
+
 	#pragma region Memory management
 
-	/// Allocate new block and change ownership type
-	inline void Allocate( size_t NewSize )
+	inline bool IsInline() const { return FData == FInline; }
+
+	/// Copy-on-write for the borrowed data
+	inline void MakeWritable()
+	{
+		if ( FReadOnly ) { Grow( FSize, true ); }
+	}
+
+	/// Double the capacity, but not less than required
+	inline size_t GetGrowCapacity( size_t Required ) const { return std::max( Required, FAllocatedSize * 2 ); }
+
+	/**
+	   \brief Make the capacity at least NewCapacity
+
+	   Keeps the FSize bytes of the contents if Preserve is true. External data is never touched: a new owned block is allocated instead.
+	   The old block stays valid if the allocation fails
+	*/
+	bool Grow( size_t NewCapacity, bool Preserve )
 	{
-		FData = ::malloc( NewSize );
-		FSize = FAllocatedSize = NewSize;
+		if ( FOwnsData && NewCapacity <= FAllocatedSize ) { return true; }
+
+		if ( NewCapacity <= BLOB_INLINE_SIZE && ( !FData || !FOwnsData ) )
+		{
+			if ( Preserve && FData ) { memmove( FInline, FData, FSize ); }
+
+			FData = FInline;
+			FAllocatedSize = BLOB_INLINE_SIZE;
+			FOwnsData = true;
+			ReleaseBorrowed();
+			return true;
+		}
+
+		void* NewData = NULL;
+
+		if ( FData && FOwnsData && !IsInline() && Preserve )
+		{
+			NewData = FAllocator->Realloc( FData, FAllocatedSize, NewCapacity );
+
+			if ( !NewData ) { return false; }
+		}
+		else
+		{
+			NewData = FAllocator->Alloc( NewCapacity );
+
+			if ( !NewData ) { return false; }
+
+			if ( Preserve && FData ) { memcpy( NewData, FData, FSize ); }
+
+			if ( FData && FOwnsData && !IsInline() ) { FAllocator->Free( FData, FAllocatedSize ); }
+		}
+
+		FData = NewData;
+		FAllocatedSize = NewCapacity;
 		FOwnsData = true;
+		ReleaseBorrowed();
+
+		return true;
+	}
+
+	inline void ReleaseBorrowed()
+	{
+		FReadOnly = false;
+		FDataOwner = NULL;
 	}
 
 	/// Try to delete the memory block. Not exposed as a public method, because direct access here can cause troubles.
 	inline void Delete()
 	{
-		if ( !FOwnsData || FData == NULL ) { return; }
+		if ( FOwnsData && FData && !IsInline() ) { FAllocator->Free( FData, FAllocatedSize ); }
 
-		::free( FData );
 		FData = NULL;
 		FSize = FAllocatedSize = 0;
-		FOwnsData = false;
+		FOwnsData = true;
+		ReleaseBorrowed();
 	}
 
-	/// Reallocate the data block if it is required
-	void Reallocate( size_t NewSize )
+	/// Reallocate the data block if it is required. The contents are preserved only if the block is not reallocated
+	bool Reallocate( size_t NewSize )
 	{
-		if ( !FData ) { Allocate( NewSize ); }
+		// the borrowed data is copied first, SetSize() on a mapped file must not lose it
+		MakeWritable();
 
-		if ( FData != NULL )
+		// external blocks are resized in place as long as they fit
+		if ( FOwnsData || !FData || NewSize > FAllocatedSize )
 		{
-			if ( NewSize > FAllocatedSize )
-			{
-				// try to delete
-				Delete();
-
-				// change ownership
-				Allocate( NewSize );
-			}
-			else if ( NewSize <= FAllocatedSize )
-			{
-				// do nothing, just change the size
-				FSize = NewSize;
-			}
+			if ( !Grow( NewSize, false ) ) { return false; }
 		}
+
+		FSize = NewSize;
+
+		return true;
 	}
 
 	#pragma endregion
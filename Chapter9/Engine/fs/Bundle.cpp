@@ -0,0 +1,658 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Bundle.h"
+#include "Archive.h"
+
+#include "libcompress.h"
+
+#include <algorithm>
+
+#pragma region LZ4 block codec
+
+const int LZ4_MIN_MATCH     = 4;
+/// The last bytes of a block are always literals
+const int LZ4_LAST_LITERALS = 5;
+/// A match can not start closer than this to the end of the block
+const int LZ4_MF_LIMIT      = 12;
+const int LZ4_HASH_BITS     = 12;
+const int LZ4_MAX_OFFSET    = 65535;
+
+static inline unsigned int LZ4_Read32( const ubyte* P )
+{
+	unsigned int V;
+	memcpy( &V, P, sizeof( V ) );
+	return V;
+}
+
+static inline unsigned int LZ4_Hash( unsigned int Seq )
+{
+	return ( Seq * 2654435761U ) >> ( 32 - LZ4_HASH_BITS );
+}
+
+/// Write the length continuation bytes
+static inline bool LZ4_WriteLength( ubyte*& Op, const ubyte* OEnd, int Len )
+{
+	for ( ; Len >= 255; Len -= 255 )
+	{
+		if ( Op >= OEnd ) { return false; }
+
+		*Op++ = 255;
+	}
+
+	if ( Op >= OEnd ) { return false; }
+
+	*Op++ = ( ubyte )Len;
+
+	return true;
+}
+
+static bool LZ4_WriteSequence( ubyte*& Op, const ubyte* OEnd, const ubyte* Literals, int NumLiterals, int Offset, int MatchLength )
+{
+	if ( Op >= OEnd ) { return false; }
+
+	ubyte* Token = Op++;
+
+	int LitCode = std::min( NumLiterals, 15 );
+
+	if ( NumLiterals >= 15 && !LZ4_WriteLength( Op, OEnd, NumLiterals - 15 ) ) { return false; }
+
+	if ( OEnd - Op < NumLiterals ) { return false; }
+
+	memcpy( Op, Literals, NumLiterals );
+	Op += NumLiterals;
+
+	// the last sequence has no match
+	if ( !MatchLength )
+	{
+		*Token = ( ubyte )( LitCode << 4 );
+		return true;
+	}
+
+	if ( OEnd - Op < 2 ) { return false; }
+
+	*Op++ = ( ubyte )( Offset & 0xFF );
+	*Op++ = ( ubyte )( Offset >> 8 );
+
+	int MatchCode = std::min( MatchLength - LZ4_MIN_MATCH, 15 );
+
+	if ( MatchCode == 15 && !LZ4_WriteLength( Op, OEnd, MatchLength - LZ4_MIN_MATCH - 15 ) ) { return false; }
+
+	*Token = ( ubyte )( ( LitCode << 4 ) | MatchCode );
+
+	return true;
+}
+
+int Bundle_LZ4Compress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity )
+{
+	ubyte* Op = Dst;
+	const ubyte* OEnd = Dst + DstCapacity;
+
+	int Anchor = 0;
+
+	if ( SrcSize > LZ4_MF_LIMIT )
+	{
+		std::vector<int> Table( 1 << LZ4_HASH_BITS, -1 );
+
+		const int Limit = SrcSize - LZ4_MF_LIMIT;
+
+		for ( int Ip = 0; Ip < Limit; )
+		{
+			unsigned int Seq = LZ4_Read32( Src + Ip );
+			unsigned int H = LZ4_Hash( Seq );
+
+			int Ref = Table[H];
+			Table[H] = Ip;
+
+			if ( Ref < 0 || Ip - Ref > LZ4_MAX_OFFSET || LZ4_Read32( Src + Ref ) != Seq )
+			{
+				Ip++;
+				continue;
+			}
+
+			int MatchLength = LZ4_MIN_MATCH;
+			int MaxLength = SrcSize - LZ4_LAST_LITERALS - Ip;
+
+			while ( MatchLength < MaxLength && Src[Ref + MatchLength] == Src[Ip + MatchLength] ) { MatchLength++; }
+
+			if ( !LZ4_WriteSequence( Op, OEnd, Src + Anchor, Ip - Anchor, Ip - Ref, MatchLength ) ) { return -1; }
+
+			Ip += MatchLength;
+			Anchor = Ip;
+		}
+	}
+
+	if ( !LZ4_WriteSequence( Op, OEnd, Src + Anchor, SrcSize - Anchor, 0, 0 ) ) { return -1; }
+
+	return ( int )( Op - Dst );
+}
+
+int Bundle_LZ4Decompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity )
+{
+	const ubyte* Ip = Src;
+	const ubyte* IEnd = Src + SrcSize;
+	ubyte* Op = Dst;
+	const ubyte* OEnd = Dst + DstCapacity;
+
+	while ( Ip < IEnd )
+	{
+		unsigned int Token = *Ip++;
+
+		size_t NumLiterals = Token >> 4;
+
+		if ( NumLiterals == 15 )
+		{
+			unsigned int B;
+
+			do
+			{
+				if ( Ip >= IEnd ) { return -1; }
+
+				B = *Ip++;
+				NumLiterals += B;
+			}
+			while ( B == 255 );
+		}
+
+		if ( ( size_t )( IEnd - Ip ) < NumLiterals || ( size_t )( OEnd - Op ) < NumLiterals ) { return -1; }
+
+		memcpy( Op, Ip, NumLiterals );
+		Ip += NumLiterals;
+		Op += NumLiterals;
+
+		// the last sequence has only literals
+		if ( Ip == IEnd ) { break; }
+
+		if ( IEnd - Ip < 2 ) { return -1; }
+
+		size_t Offset = Ip[0] | ( Ip[1] << 8 );
+		Ip += 2;
+
+		if ( !Offset || Offset > ( size_t )( Op - Dst ) ) { return -1; }
+
+		size_t MatchLength = Token & 15;
+
+		if ( MatchLength == 15 )
+		{
+			unsigned int B;
+
+			do
+			{
+				if ( Ip >= IEnd ) { return -1; }
+
+				B = *Ip++;
+				MatchLength += B;
+			}
+			while ( B == 255 );
+		}
+
+		MatchLength += LZ4_MIN_MATCH;
+
+		if ( ( size_t )( OEnd - Op ) < MatchLength ) { return -1; }
+
+		// the match may overlap the output
+		const ubyte* Match = Op - Offset;
+
+		for ( size_t i = 0; i != MatchLength; i++ ) { *Op++ = *Match++; }
+	}
+
+	return ( int )( Op - Dst );
+}
+
+#pragma endregion
+
+int Bundle_DeflateCompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity )
+{
+	z_stream Stream;
+	memset( &Stream, 0, sizeof( Stream ) );
+
+	if ( deflateInit2( &Stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY ) != Z_OK ) { return -1; }
+
+	Stream.next_in   = const_cast<Bytef*>( Src );
+	Stream.avail_in  = SrcSize;
+	Stream.next_out  = Dst;
+	Stream.avail_out = DstCapacity;
+
+	int Result = deflate( &Stream, Z_FINISH );
+	int Size = ( int )Stream.total_out;
+
+	deflateEnd( &Stream );
+
+	return ( Result == Z_STREAM_END ) ? Size : -1;
+}
+
+int Bundle_DeflateDecompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity )
+{
+	z_stream Stream;
+	memset( &Stream, 0, sizeof( Stream ) );
+
+	if ( inflateInit2( &Stream, -MAX_WBITS ) != Z_OK ) { return -1; }
+
+	Stream.next_in   = const_cast<Bytef*>( Src );
+	Stream.avail_in  = SrcSize;
+	Stream.next_out  = Dst;
+	Stream.avail_out = DstCapacity;
+
+	int Result = inflate( &Stream, Z_FINISH );
+	int Size = ( int )Stream.total_out;
+
+	inflateEnd( &Stream );
+
+	return ( Result == Z_STREAM_END ) ? Size : -1;
+}
+
+static inline uint64 Bundle_Align( uint64 Offset )
+{
+	return ( Offset + BUNDLE_ALIGNMENT - 1 ) & ~( BUNDLE_ALIGNMENT - 1 );
+}
+
+/// Check that [Offset, Offset + Size) lies inside of the Total bytes
+static inline bool Bundle_InRange( uint64 Offset, uint64 Size, uint64 Total )
+{
+	return Offset <= Total && Size <= Total - Offset;
+}
+
+bool clBundleReader::Open( const clPtr<iIStream>& Source )
+{
+	FSourceFile = NULL;
+
+	if ( !Source || !Source->MapStream() ) { return false; }
+
+	const uint64 Total = Source->GetSize();
+
+	if ( Total < sizeof( sBundleHeader ) ) { return false; }
+
+	const ubyte* Base = Source->MapStream();
+	const sBundleHeader* H = reinterpret_cast<const sBundleHeader*>( Base );
+
+	if ( H->FMagic != BUNDLE_MAGIC || H->FVersion != BUNDLE_VERSION || H->FChunkSize != BUNDLE_CHUNK_SIZE ) { return false; }
+
+	if ( H->FEntriesOffset % BUNDLE_ALIGNMENT || H->FChunksOffset % BUNDLE_ALIGNMENT ) { return false; }
+
+	if ( !Bundle_InRange( H->FEntriesOffset, ( uint64 )H->FNumEntries * sizeof( sBundleEntry ), Total ) ||
+	     H->FNumChunks > Total / sizeof( sBundleChunk ) ||
+	     !Bundle_InRange( H->FChunksOffset, H->FNumChunks * sizeof( sBundleChunk ), Total ) ||
+	     !Bundle_InRange( H->FNamesOffset, H->FNamesSize, Total ) ||
+	     ( H->FNamesSize && Base[H->FNamesOffset + H->FNamesSize - 1] != 0 ) )
+	{
+		return false;
+	}
+
+	const sBundleEntry* Entries = reinterpret_cast<const sBundleEntry*>( Base + H->FEntriesOffset );
+	const sBundleChunk* Chunks  = reinterpret_cast<const sBundleChunk*>( Base + H->FChunksOffset );
+
+	// a broken bundle is rejected here once, so the accessors need no checks
+	for ( unsigned int i = 0; i != H->FNumEntries; i++ )
+	{
+		const sBundleEntry& E = Entries[i];
+
+		if ( E.FNameOffset >= H->FNamesSize || !Bundle_InRange( E.FOffset, E.FStoredSize, Total ) ) { return false; }
+
+		if ( E.FCompression == BundleCompression_None )
+		{
+			if ( E.FStoredSize != E.FSize ) { return false; }
+
+			continue;
+		}
+
+		if ( E.FCompression > BundleCompression_Deflate ) { return false; }
+
+		if ( ( uint64 )E.FFirstChunk + E.FNumChunks > H->FNumChunks ) { return false; }
+
+		if ( E.FNumChunks != ( E.FSize + BUNDLE_CHUNK_SIZE - 1 ) / BUNDLE_CHUNK_SIZE ) { return false; }
+
+		for ( unsigned int c = 0; c != E.FNumChunks; c++ )
+		{
+			const sBundleChunk& C = Chunks[E.FFirstChunk + c];
+
+			uint64 Expected = std::min( ( uint64 )BUNDLE_CHUNK_SIZE, E.FSize - ( uint64 )c * BUNDLE_CHUNK_SIZE );
+
+			if ( C.FSize != Expected || C.FStoredSize > C.FSize || !Bundle_InRange( C.FOffset, C.FStoredSize, Total ) ) { return false; }
+		}
+	}
+
+	FSourceFile = Source;
+
+	return true;
+}
+
+int clBundleReader::GetFileIdx( const std::string& FileName ) const
+{
+	if ( !FSourceFile ) { return -1; }
+
+	std::string Name = Bundle_FixFileName( FileName );
+
+	unsigned int Hash = Arch_HashFileName( Name.c_str() );
+
+	int Lo = 0;
+	int Hi = ( int )GetHeader()->FNumEntries;
+
+	// the first entry with FHash >= Hash
+	while ( Lo < Hi )
+	{
+		int Mid = ( Lo + Hi ) / 2;
+
+		if ( GetEntry( Mid )->FHash < Hash ) { Lo = Mid + 1; }
+		else { Hi = Mid; }
+	}
+
+	for ( int i = Lo; i < ( int )GetHeader()->FNumEntries && GetEntry( i )->FHash == Hash; i++ )
+	{
+		if ( Name == GetEntryName( i ) ) { return i; }
+	}
+
+	return -1;
+}
+
+bool clBundleReader::DecodeChunk( const sBundleEntry* Entry, unsigned int Chunk, ubyte* Out ) const
+{
+	const sBundleChunk* C = GetChunk( Entry->FFirstChunk + Chunk );
+	const ubyte* Src = GetBase() + C->FOffset;
+
+	if ( C->FStoredSize == C->FSize )
+	{
+		memcpy( Out, Src, C->FSize );
+		return true;
+	}
+
+	int Size = ( Entry->FCompression == BundleCompression_LZ4 ) ?
+	           Bundle_LZ4Decompress( Src, C->FStoredSize, Out, C->FSize ) :
+	           Bundle_DeflateDecompress( Src, C->FStoredSize, Out, C->FSize );
+
+	return Size == ( int )C->FSize;
+}
+
+uint64 clBundleReader::Read( int idx, uint64 Offset, void* Out, uint64 Size ) const
+{
+	const sBundleEntry* E = GetEntry( idx );
+
+	if ( Offset >= E->FSize ) { return 0; }
+
+	Size = std::min( Size, E->FSize - Offset );
+
+	ubyte* Dst = reinterpret_cast<ubyte*>( Out );
+
+	if ( E->FCompression == BundleCompression_None )
+	{
+		memcpy( Dst, GetBase() + E->FOffset + Offset, static_cast<size_t>( Size ) );
+		return Size;
+	}
+
+	std::vector<ubyte> Temp;
+
+	for ( uint64 Pos = Offset; Pos < Offset + Size; )
+	{
+		unsigned int Chunk = ( unsigned int )( Pos / BUNDLE_CHUNK_SIZE );
+		uint64 ChunkStart  = ( uint64 )Chunk * BUNDLE_CHUNK_SIZE;
+		uint64 ChunkSize   = GetChunk( E->FFirstChunk + Chunk )->FSize;
+		uint64 Count       = std::min( ChunkStart + ChunkSize, Offset + Size ) - Pos;
+
+		if ( Pos == ChunkStart && Count == ChunkSize )
+		{
+			// the whole chunk is requested, decode in-place
+			if ( !DecodeChunk( E, Chunk, Dst + ( Pos - Offset ) ) ) { return Pos - Offset; }
+		}
+		else
+		{
+			Temp.resize( BUNDLE_CHUNK_SIZE );
+
+			if ( !DecodeChunk( E, Chunk, &Temp[0] ) ) { return Pos - Offset; }
+
+			memcpy( Dst + ( Pos - Offset ), &Temp[0] + ( Pos - ChunkStart ), static_cast<size_t>( Count ) );
+		}
+
+		Pos += Count;
+	}
+
+	return Size;
+}
+
+clPtr<clBlob> clBundleReader::GetFileData( const std::string& FileName ) const
+{
+	int idx = GetFileIdx( FileName );
+
+	if ( idx < 0 ) { return NULL; }
+
+	const sBundleEntry* E = GetEntry( idx );
+
+	clPtr<clBlob> Result = new clBlob();
+
+	if ( E->FCompression == BundleCompression_None )
+	{
+		Result->SetReadOnlyData( GetBase() + E->FOffset, static_cast<size_t>( E->FSize ), FSourceFile );
+		return Result;
+	}
+
+	// identical data could have been decoded from another container
+	clPtr<clBlob> Shared = FContentCache ? FContentCache->Find( GetContentHash( E ) ) : NULL;
+
+	if ( Shared ) { return Shared; }
+
+	// decode straight into the final buffer, there is no intermediate copy of the whole file
+	if ( !Result->SafeResize( static_cast<size_t>( E->FSize ) ) ) { return NULL; }
+
+	if ( Read( idx, 0, Result->GetData(), E->FSize ) != E->FSize ) { return NULL; }
+
+	return FContentCache ? FContentCache->Insert( GetContentHash( E ), Result ) : Result;
+}
+
+void clBundleWriter::AddFile( const std::string& Name, const clPtr<clBlob>& Data, LBundleCompression Compression )
+{
+	sSourceFile F;
+	F.FName        = Bundle_FixFileName( Name );
+	F.FData        = Data;
+	F.FCompression = Compression;
+
+	FFiles.push_back( F );
+}
+
+/// Packed representation of a single file
+struct sPackedFile
+{
+	sBundleEntry              FEntry;
+	std::string               FName;
+	const ubyte*              FData;
+	std::vector<sBundleChunk> FChunks;
+	/// Compressed chunks, empty for uncompressed files
+	std::vector<ubyte>        FPacked;
+};
+
+static bool Bundle_ComparePacked( const sPackedFile* A, const sPackedFile* B )
+{
+	return ( A->FEntry.FHash != B->FEntry.FHash ) ? ( A->FEntry.FHash < B->FEntry.FHash ) : ( A->FName < B->FName );
+}
+
+static bool Bundle_WritePadding( const clPtr<FileWriter>& Out, uint64 Offset )
+{
+	static const ubyte Zeros[BUNDLE_ALIGNMENT] = { 0 };
+
+	uint64 Size = Bundle_Align( Offset ) - Offset;
+
+	return !Size || Out->Write( Zeros, Size ) == Size;
+}
+
+bool clBundleWriter::Save( const std::string& FileName ) const
+{
+	std::vector<sPackedFile> Packed( FFiles.size() );
+
+	for ( size_t i = 0; i != FFiles.size(); i++ )
+	{
+		const sSourceFile& Src = FFiles[i];
+		sPackedFile& P = Packed[i];
+
+		const ubyte* Data = reinterpret_cast<const ubyte*>( Src.FData->GetDataConst() );
+		uint64 Size = Src.FData->GetSize();
+
+		memset( &P.FEntry, 0, sizeof( P.FEntry ) );
+		P.FName  = Src.FName;
+		P.FData  = Data;
+		P.FEntry.FHash        = Arch_HashFileName( Src.FName.c_str() );
+		P.FEntry.FCRC         = Size ? ( unsigned int )crc32( 0L, Data, ( uInt )Size ) : 0;
+		P.FEntry.FContentHash = Size ? Content_HashData( Data, Size ) : 0;
+		P.FEntry.FSize        = Size;
+		P.FEntry.FStoredSize  = Size;
+		P.FEntry.FCompression = BundleCompression_None;
+
+		if ( Src.FCompression == BundleCompression_None || !Size ) { continue; }
+
+		std::vector<ubyte> Buffer( BUNDLE_CHUNK_SIZE );
+
+		for ( uint64 Pos = 0; Pos < Size; Pos += BUNDLE_CHUNK_SIZE )
+		{
+			int ChunkSize = ( int )std::min( ( uint64 )BUNDLE_CHUNK_SIZE, Size - Pos );
+
+			int PackedSize = ( Src.FCompression == BundleCompression_LZ4 ) ?
+			                 Bundle_LZ4Compress( Data + Pos, ChunkSize, &Buffer[0], ChunkSize - 1 ) :
+			                 Bundle_DeflateCompress( Data + Pos, ChunkSize, &Buffer[0], ChunkSize - 1 );
+
+			sBundleChunk C;
+			C.FOffset = P.FPacked.size();
+			C.FSize   = ChunkSize;
+
+			if ( PackedSize > 0 )
+			{
+				C.FStoredSize = PackedSize;
+				P.FPacked.insert( P.FPacked.end(), Buffer.begin(), Buffer.begin() + PackedSize );
+			}
+			else
+			{
+				// incompressible chunk
+				C.FStoredSize = ChunkSize;
+				P.FPacked.insert( P.FPacked.end(), Data + Pos, Data + Pos + ChunkSize );
+			}
+
+			P.FChunks.push_back( C );
+		}
+
+		if ( P.FPacked.size() > Size * FMinCompressionRatio )
+		{
+			// not worth decoding
+			P.FChunks.clear();
+			P.FPacked.clear();
+			continue;
+		}
+
+		P.FEntry.FCompression = Src.FCompression;
+		P.FEntry.FStoredSize  = P.FPacked.size();
+	}
+
+	std::vector<sPackedFile*> Sorted( Packed.size() );
+
+	for ( size_t i = 0; i != Packed.size(); i++ ) { Sorted[i] = &Packed[i]; }
+
+	std::sort( Sorted.begin(), Sorted.end(), Bundle_ComparePacked );
+
+	// layout
+	sBundleHeader H;
+	memset( &H, 0, sizeof( H ) );
+
+	H.FMagic      = BUNDLE_MAGIC;
+	H.FVersion    = BUNDLE_VERSION;
+	H.FChunkSize  = BUNDLE_CHUNK_SIZE;
+	H.FNumEntries = ( unsigned int )Sorted.size();
+
+	std::string Names;
+
+	for ( size_t i = 0; i != Sorted.size(); i++ )
+	{
+		Sorted[i]->FEntry.FNameOffset = ( unsigned int )Names.size();
+		Sorted[i]->FEntry.FFirstChunk = ( unsigned int )H.FNumChunks;
+		Sorted[i]->FEntry.FNumChunks  = ( unsigned int )Sorted[i]->FChunks.size();
+
+		Names += Sorted[i]->FName;
+		Names.push_back( 0 );
+
+		H.FNumChunks += Sorted[i]->FChunks.size();
+	}
+
+	H.FEntriesOffset = Bundle_Align( sizeof( sBundleHeader ) );
+	H.FChunksOffset  = Bundle_Align( H.FEntriesOffset + H.FNumEntries * sizeof( sBundleEntry ) );
+	H.FNamesOffset   = Bundle_Align( H.FChunksOffset + H.FNumChunks * sizeof( sBundleChunk ) );
+	H.FNamesSize     = Names.size();
+
+	uint64 Offset = Bundle_Align( H.FNamesOffset + H.FNamesSize );
+
+	for ( size_t i = 0; i != Sorted.size(); i++ )
+	{
+		sPackedFile* P = Sorted[i];
+
+		P->FEntry.FOffset = Offset;
+
+		for ( size_t c = 0; c != P->FChunks.size(); c++ ) { P->FChunks[c].FOffset += Offset; }
+
+		Offset = Bundle_Align( Offset + P->FEntry.FStoredSize );
+	}
+
+	// output
+	clPtr<FileWriter> Out = new FileWriter();
+	Out->SetAtomicCommit( true );
+
+	if ( !Out->Open( FileName ) ) { return false; }
+
+	Out->Write( &H, sizeof( H ) );
+	Bundle_WritePadding( Out, sizeof( H ) );
+
+	for ( size_t i = 0; i != Sorted.size(); i++ ) { Out->Write( &Sorted[i]->FEntry, sizeof( sBundleEntry ) ); }
+
+	Bundle_WritePadding( Out, Out->GetFilePos() );
+
+	for ( size_t i = 0; i != Sorted.size(); i++ )
+	{
+		if ( !Sorted[i]->FChunks.empty() ) { Out->Write( &Sorted[i]->FChunks[0], Sorted[i]->FChunks.size() * sizeof( sBundleChunk ) ); }
+	}
+
+	Bundle_WritePadding( Out, Out->GetFilePos() );
+
+	Out->Write( Names.data(), Names.size() );
+	Bundle_WritePadding( Out, Out->GetFilePos() );
+
+	for ( size_t i = 0; i != Sorted.size(); i++ )
+	{
+		sPackedFile* P = Sorted[i];
+
+		const void* Data = P->FPacked.empty() ? P->FData : &P->FPacked[0];
+
+		if ( P->FEntry.FStoredSize ) { Out->Write( Data, P->FEntry.FStoredSize ); }
+
+		Bundle_WritePadding( Out, Out->GetFilePos() );
+	}
+
+	if ( Out->HasFailed() )
+	{
+		Out->Discard();
+		return false;
+	}
+
+	return Out->Close();
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "Streams.h"
+#include "Files.h"
+#include "ContentCache.h"
+#include <vector>
+
+/**
+   Engine-native asset bundle
+
+   Layout (all offsets are absolute, all sections start at BUNDLE_ALIGNMENT):
+      sBundleHeader
+      sBundleEntry[FNumEntries]   - sorted by (FHash, name), binary searched
+      sBundleChunk[FNumChunks]    - chunks of all compressed entries
+      names                       - zero-terminated virtual file names
+      data                        - every entry starts at BUNDLE_ALIGNMENT
+
+   Uncompressed entries are used directly from the memory-mapped bundle. Compressed entries are split into
+   BUNDLE_CHUNK_SIZE pieces which are decoded independently, so any range can be read without decoding the whole entry
+*/
+
+/// "BNDL"
+const unsigned int BUNDLE_MAGIC      = 0x4C444E42;
+const unsigned int BUNDLE_VERSION    = 1;
+const uint64       BUNDLE_ALIGNMENT  = 64;
+const unsigned int BUNDLE_CHUNK_SIZE = 64 * 1024;
+
+enum LBundleCompression
+{
+   BundleCompression_None    = 0,
+   BundleCompression_LZ4     = 1,
+   BundleCompression_Deflate = 2
+};
+
+struct sBundleHeader
+{
+	unsigned int FMagic;
+	unsigned int FVersion;
+	unsigned int FNumEntries;
+	unsigned int FChunkSize;
+	uint64       FEntriesOffset;
+	uint64       FChunksOffset;
+	uint64       FNumChunks;
+	uint64       FNamesOffset;
+	uint64       FNamesSize;
+	uint64       FReserved;
+};
+
+/// Table of contents record, one cache line each
+struct sBundleEntry
+{
+	/// Arch_HashFileName() of the name
+	unsigned int FHash;
+	/// LBundleCompression
+	unsigned int FCompression;
+	/// Offset of the name in the names block
+	unsigned int FNameOffset;
+	/// CRC32 of the uncompressed data
+	unsigned int FCRC;
+	/// Aligned offset of the data (the first chunk for compressed entries)
+	uint64       FOffset;
+	/// Uncompressed size
+	uint64       FSize;
+	/// Size of the data in the bundle
+	uint64       FStoredSize;
+	/// Chunks of the compressed entry
+	unsigned int FFirstChunk;
+	unsigned int FNumChunks;
+	/// Content_HashData() of the uncompressed data, 0 if unknown
+	uint64       FContentHash;
+	uint64       FReserved;
+};
+
+/// Independently decodable piece of a compressed entry
+struct sBundleChunk
+{
+	uint64       FOffset;
+	/// Chunks which do not compress are kept as is, in this case FStoredSize == FSize
+	unsigned int FStoredSize;
+	unsigned int FSize;
+};
+
+/// Bundle names always use forward slashes
+inline std::string Bundle_FixFileName( const std::string& Name )
+{
+	std::string Result( Name );
+
+	for ( size_t i = 0; i != Result.length(); i++ ) if ( Result[i] == '\\' ) { Result[i] = '/'; }
+
+	return Result;
+}
+
+/// LZ4 block format. Return the number of produced bytes or -1 if the output does not fit or the input is malformed
+int Bundle_LZ4Compress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity );
+int Bundle_LZ4Decompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity );
+
+/// Raw deflate with the same conventions
+int Bundle_DeflateCompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity );
+int Bundle_DeflateDecompress( const ubyte* Src, int SrcSize, ubyte* Dst, int DstCapacity );
+
+/// Read-only access to a memory-mapped bundle. All the methods are thread-safe
+class clBundleReader: public iObject
+{
+public:
+	clBundleReader() {}
+	virtual ~clBundleReader() {}
+
+	/// The source has to be memory-mapped, it is kept open while the reader is alive
+	bool    Open( const clPtr<iIStream>& Source );
+
+	clPtr<iIStream> GetSourceFile() const { return FSourceFile; }
+
+	/// Find the entry index, -1 if there is no such file
+	int     GetFileIdx( const std::string& FileName ) const;
+
+	bool    FileExists( const std::string& FileName ) const { return GetFileIdx( FileName ) > -1; }
+
+	uint64  GetFileSize( const std::string& FileName ) const
+	{
+		int idx = GetFileIdx( FileName );
+		return ( idx > -1 ) ? GetEntry( idx )->FSize : 0;
+	}
+
+	/// Uncompressed entries can be used in-place
+	bool    IsFileStored( const std::string& FileName ) const
+	{
+		int idx = GetFileIdx( FileName );
+		return ( idx > -1 ) ? ( GetEntry( idx )->FCompression == BundleCompression_None ) : false;
+	}
+
+	uint64  GetFileOffset( const std::string& FileName ) const
+	{
+		int idx = GetFileIdx( FileName );
+		return ( idx > -1 ) ? GetEntry( idx )->FOffset : 0;
+	}
+
+	/// Read Size bytes at Offset of the idx-th file. Only the chunks covering the range are decoded
+	uint64  Read( int idx, uint64 Offset, void* Out, uint64 Size ) const;
+
+	/// Uncompressed files borrow the bundle memory, compressed ones are decoded straight into the returned blob
+	clPtr<clBlob> GetFileData( const std::string& FileName ) const;
+
+	/// Share the decoded files with other readers through this cache (NULL to disable). Should be set before the reader is used
+	void    SetContentCache( const clPtr<clContentCache>& Cache ) { FContentCache = Cache; }
+	clPtr<clContentCache> GetContentCache() const { return FContentCache; }
+
+	/// Content identity of the file (CRC32, size and the 64-bit content hash)
+	bool    GetFileContentHash( const std::string& FileName, sContentHash* Hash ) const
+	{
+		int idx = GetFileIdx( FileName );
+
+		if ( idx < 0 ) { return false; }
+
+		*Hash = GetContentHash( GetEntry( idx ) );
+
+		return true;
+	}
+
+	size_t  GetNumFiles() const { return FSourceFile ? GetHeader()->FNumEntries : 0; }
+
+	std::string GetFileName( int idx ) const { return std::string( GetEntryName( idx ) ); }
+
+private:
+	bool    DecodeChunk( const sBundleEntry* Entry, unsigned int Chunk, ubyte* Out ) const;
+
+	static sContentHash GetContentHash( const sBundleEntry* Entry ) { return sContentHash( Entry->FCRC, Entry->FSize, Entry->FContentHash ); }
+
+	const ubyte*         GetBase() const { return FSourceFile->MapStream(); }
+	const sBundleHeader* GetHeader() const { return reinterpret_cast<const sBundleHeader*>( GetBase() ); }
+	const sBundleEntry*  GetEntry( int idx ) const { return reinterpret_cast<const sBundleEntry*>( GetBase() + GetHeader()->FEntriesOffset ) + idx; }
+	const sBundleChunk*  GetChunk( unsigned int idx ) const { return reinterpret_cast<const sBundleChunk*>( GetBase() + GetHeader()->FChunksOffset ) + idx; }
+	const char*          GetEntryName( int idx ) const { return reinterpret_cast<const char*>( GetBase() + GetHeader()->FNamesOffset ) + GetEntry( idx )->FNameOffset; }
+
+private:
+	clPtr<iIStream> FSourceFile;
+
+	clPtr<clContentCache> FContentCache;
+};
+
+/// Builds bundles, used by the packer tool
+class clBundleWriter: public iObject
+{
+public:
+	clBundleWriter(): FDefaultCompression( BundleCompression_LZ4 ), FMinCompressionRatio( 0.9f ) {}
+	virtual ~clBundleWriter() {}
+
+	void SetDefaultCompression( LBundleCompression C ) { FDefaultCompression = C; }
+
+	/// Compressed entries which do not get smaller than this ratio are stored uncompressed
+	void SetMinCompressionRatio( float Ratio ) { FMinCompressionRatio = Ratio; }
+
+	void AddFile( const std::string& Name, const clPtr<clBlob>& Data ) { AddFile( Name, Data, FDefaultCompression ); }
+	void AddFile( const std::string& Name, const clPtr<clBlob>& Data, LBundleCompression Compression );
+
+	/// Write the bundle atomically
+	bool Save( const std::string& FileName ) const;
+
+private:
+	struct sSourceFile
+	{
+		std::string        FName;
+		clPtr<clBlob>      FData;
+		LBundleCompression FCompression;
+	};
+
+	std::vector<sSourceFile> FFiles;
+	LBundleCompression       FDefaultCompression;
+	float                    FMinCompressionRatio;
+};
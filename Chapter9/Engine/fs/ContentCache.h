@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "Blob.h"
+#include "Mutex.h"
+#include <map>
+
+/// Identity of the file contents
+struct sContentHash
+{
+	sContentHash(): FCRC( 0 ), FSize( 0 ), FStrongHash( 0 ) {}
+	sContentHash( unsigned int CRC, uint64 Size, uint64 StrongHash ): FCRC( CRC ), FSize( Size ), FStrongHash( StrongHash ) {}
+
+	/// CRC32 of the data
+	unsigned int FCRC;
+	uint64       FSize;
+	/// Stronger 64-bit hash of the data, 0 if the container does not store it
+	uint64       FStrongHash;
+};
+
+/// 64-bit FNV-1a hash of the file data
+inline uint64 Content_HashData( const void* Data, uint64 Size )
+{
+	const ubyte* Ptr = reinterpret_cast<const ubyte*>( Data );
+
+	uint64 Hash = 14695981039346656037ull;
+
+	for ( uint64 i = 0; i != Size; i++ ) { Hash = ( Hash ^ Ptr[i] ) * 1099511628211ull; }
+
+	/// 0 is reserved for "unknown"
+	return Hash ? Hash : 1;
+}
+
+/**
+   \brief Shared in-memory copies of the decoded files, keyed by the content hash
+
+   Identical files served by different mount points (e.g. the base .apk and a patch .zip) end up in a single copy.
+   The callers get read-only views of the shared data, so writing through one of them never touches the others.
+   The cache does not keep the data alive: it refers to the shared copies weakly and a copy unregisters itself
+   once its last view has gone. All the methods are thread-safe
+*/
+class clContentCache: public iObject
+{
+public:
+	clContentCache(): FHits( 0 ), FMisses( 0 ), FSavedBytes( 0 ) {}
+	virtual ~clContentCache() {}
+
+	/// Find a view of the blob with the same content, NULL if there is none
+	clPtr<clBlob> Find( const sContentHash& Hash )
+	{
+		LMutex Lock( &FMutex );
+
+		clPtr<clSharedContent> Content = FindLocked( Hash );
+
+		if ( !Content )
+		{
+			FMisses++;
+			return NULL;
+		}
+
+		FHits++;
+		FSavedBytes += Hash.FSize;
+
+		return Content->CreateView();
+	}
+
+	/// Register the decoded file. Returns a view of the data to be used: the existing one if the same content has been registered meanwhile
+	clPtr<clBlob> Insert( const sContentHash& Hash, const clPtr<clBlob>& Data )
+	{
+		if ( !Data || !Hash.FSize ) { return Data; }
+
+		LMutex Lock( &FMutex );
+
+		std::map<sKey, sEntry>::iterator i = FEntries.find( sKey( Hash ) );
+
+		if ( i != FEntries.end() )
+		{
+			/// CRC32 collision of different files, keep the first one
+			if ( !IsSameContent( i->second.FStrongHash, Hash.FStrongHash ) ) { return Data; }
+
+			clPtr<clSharedContent> Content = FindLocked( Hash );
+
+			if ( Content )
+			{
+				FSavedBytes += Hash.FSize;
+
+				return Content->CreateView();
+			}
+		}
+
+		/// A new entry or a dying one which is about to unregister itself
+		clPtr<clSharedContent> Content = new clSharedContent( this, sKey( Hash ), Data );
+
+		sEntry& Entry = FEntries[ sKey( Hash ) ];
+		Entry.FContent = Content.GetInternalPtr();
+		Entry.FStrongHash = Hash.FStrongHash;
+
+		return Content->CreateView();
+	}
+
+	struct sStats
+	{
+		uint64 FHits;
+		uint64 FMisses;
+		/// Total size of the files which have been shared instead of being decoded once more
+		uint64 FSavedBytes;
+		/// Currently cached bytes and entries
+		uint64 FBytes;
+		size_t FEntries;
+	};
+
+	sStats GetStats() const
+	{
+		LMutex Lock( &FMutex );
+
+		sStats Stats;
+		Stats.FHits = FHits;
+		Stats.FMisses = FMisses;
+		Stats.FSavedBytes = FSavedBytes;
+		Stats.FBytes = 0;
+		Stats.FEntries = FEntries.size();
+
+		for ( std::map<sKey, sEntry>::const_iterator i = FEntries.begin(); i != FEntries.end(); ++i ) { Stats.FBytes += i->first.FSize; }
+
+		return Stats;
+	}
+
+private:
+	struct sKey
+	{
+		explicit sKey( const sContentHash& Hash ): FCRC( Hash.FCRC ), FSize( Hash.FSize ) {}
+
+		bool operator < ( const sKey& Other ) const { return ( FSize != Other.FSize ) ? ( FSize < Other.FSize ) : ( FCRC < Other.FCRC ); }
+
+		unsigned int FCRC;
+		uint64       FSize;
+	};
+
+	/// The shared copy of the data. Only the views keep it alive
+	class clSharedContent: public iObject
+	{
+	public:
+		clSharedContent( clContentCache* Cache, const sKey& Key, const clPtr<clBlob>& Data ): FCache( Cache ), FKey( Key ), FData( Data ) {}
+		virtual ~clSharedContent() { FCache->Unregister( this, FKey ); }
+
+		clPtr<clBlob> CreateView()
+		{
+			clPtr<clBlob> View = new clBlob();
+			View->SetReadOnlyData( FData->GetDataConst(), FData->GetSize(), this );
+
+			return View;
+		}
+
+	private:
+		/// The copies keep the cache alive, there is no cycle since the cache does not own them
+		clPtr<clContentCache> FCache;
+		sKey                  FKey;
+		clPtr<clBlob>         FData;
+	};
+
+	/// Strong hashes are compared only if both files have them
+	static bool IsSameContent( uint64 Hash1, uint64 Hash2 ) { return !Hash1 || !Hash2 || Hash1 == Hash2; }
+
+	/// Turn the weak reference into a strong one, NULL if the content is gone or is being destroyed
+	clPtr<clSharedContent> FindLocked( const sContentHash& Hash )
+	{
+		std::map<sKey, sEntry>::iterator i = FEntries.find( sKey( Hash ) );
+
+		if ( i == FEntries.end() || !IsSameContent( i->second.FStrongHash, Hash.FStrongHash ) ) { return NULL; }
+
+		if ( !i->second.FContent->TryIncRefCount() ) { return NULL; }
+
+		clPtr<clSharedContent> Content( i->second.FContent );
+
+		/// drop the extra reference taken by TryIncRefCount(), Content holds its own
+		i->second.FContent->DecRefCount();
+
+		return Content;
+	}
+
+	void Unregister( clSharedContent* Content, const sKey& Key )
+	{
+		LMutex Lock( &FMutex );
+
+		std::map<sKey, sEntry>::iterator i = FEntries.find( Key );
+
+		/// the slot might have been taken by a newer copy of the same content
+		if ( i != FEntries.end() && i->second.FContent == Content ) { FEntries.erase( i ); }
+	}
+
+	struct sEntry
+	{
+		/// Weak reference
+		clSharedContent* FContent;
+		uint64           FStrongHash;
+	};
+
+	std::map<sKey, sEntry> FEntries;
+	uint64                 FHits;
+	uint64                 FMisses;
+	uint64                 FSavedBytes;
+	clMutex                FMutex;
+};
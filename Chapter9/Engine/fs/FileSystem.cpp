@@ -32,6 +32,7 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "Engine.h"
 #include "FileSystem.h"
 #include "Files.h"
 #include "MountPoint.h"
@@ -39,6 +40,8 @@
 
 #include "Blob.h"
 
+#include "tinythread.h"
+
 #include <algorithm>
 
 #ifdef _WIN32
@@ -49,18 +52,365 @@
 #  include <stdlib.h>
 #endif
 
-clPtr<iIStream> clFileSystem::CreateReader( const std::string& FileName ) const
+clFileSystem::~clFileSystem()
+{
+	{
+		/// Neutralize the deliveries still sitting in FEventQueue
+		LMutex Lock( &FLink->FMutex );
+
+		FLink->FFileSystem = NULL;
+	}
+
+	WaitForPreload( true );
+
+	if ( FIOThread )
+	{
+		FIOThread->CancelAll();
+		FIOThread->Exit( true );
+	}
+}
+
+/// Delivers the loaded file to the main thread unless the load has been cancelled
+class clFileLoadDelivery: public iAsyncCapsule
+{
+public:
+	clFileLoadDelivery( const clPtr<clFileSystemLink>& Link, const clPtr<clFileLoadCompleteCallback>& CB ): FLink( Link ), FCallback( CB ) {}
+
+	virtual void Invoke()
+	{
+		bool Completed = false;
+
+		{
+			/// The file system can not go away while the link is locked
+			LMutex Lock( &FLink->FMutex );
+
+			Completed = FLink->FFileSystem && FLink->FFileSystem->CompleteLoad( FCallback->FTaskID );
+		}
+
+		if ( Completed ) { FCallback->Invoke(); }
+	}
+
+private:
+	/// The delivery can outlive the file system in FEventQueue, then the link is cleared
+	clPtr<clFileSystemLink>           FLink;
+	clPtr<clFileLoadCompleteCallback> FCallback;
+};
+
+class clFileLoadTask: public iTask
+{
+	L_POOLED_OBJECT( clFileLoadTask )
+public:
+	clFileLoadTask( clFileSystem* FS, const std::string& FileName, const clPtr<clFileLoadCompleteCallback>& CB )
+		: FFileSystem( FS ), FFileName( FileName ), FCallback( CB ) {}
+
+	virtual void Run()
+	{
+		clPtr<clBlob> Result = FFileSystem->FileExists( FFileName ) ? FFileSystem->LoadFileAsBlob( FFileName ) : NULL;
+
+		if ( IsPendingExit() ) { return; }
+
+		FCallback->FTaskID = GetTaskID();
+		FCallback->FFileName = FFileName;
+		FCallback->FResult = Result;
+
+		if ( FFileSystem->FEventQueue )
+		{
+			FFileSystem->FEventQueue->EnqueueCapsule( new clFileLoadDelivery( FFileSystem->FLink, FCallback ) );
+		}
+		else if ( FFileSystem->CompleteLoad( GetTaskID() ) )
+		{
+			FCallback->Invoke();
+		}
+	}
+
+private:
+	clFileSystem*                     FFileSystem;
+	std::string                       FFileName;
+	clPtr<clFileLoadCompleteCallback> FCallback;
+};
+
+size_t clFileSystem::LoadAsync( const std::string& FileName, int Priority, const clPtr<clFileLoadCompleteCallback>& CB )
+{
+	if ( !CB ) { return 0; }
+
+	size_t TaskID = ( size_t )Atomic::Inc( &FNextTaskID ) + 1;
+
+	clPtr<clFileLoadTask> Task = new clFileLoadTask( this, FileName, CB );
+	Task->SetTaskID( TaskID );
+	Task->SetPriority( Priority );
+
+	{
+		LMutex Lock( &FIOThreadMutex );
+
+		if ( !FIOThread )
+		{
+			FIOThread = new clWorkerThread();
+			FIOThread->Start( iThread::Priority_Normal );
+		}
+
+		FLoads[ TaskID ] = Task;
+	}
+
+	FIOThread->AddTask( Task );
+
+	return TaskID;
+}
+
+bool clFileSystem::CompleteLoad( size_t TaskID )
+{
+	LMutex Lock( &FIOThreadMutex );
+
+	std::map< size_t, clPtr<iTask> >::iterator i = FLoads.find( TaskID );
+
+	if ( i == FLoads.end() ) { return false; }
+
+	bool Cancelled = i->second->IsPendingExit();
+
+	FLoads.erase( i );
+
+	return !Cancelled;
+}
+
+bool clFileSystem::CancelLoad( size_t TaskID )
 {
+	LMutex Lock( &FIOThreadMutex );
+
+	std::map< size_t, clPtr<iTask> >::iterator i = FLoads.find( TaskID );
+
+	if ( i == FLoads.end() ) { return false; }
+
+	// the task could be already finished with its delivery still sitting in FEventQueue
+	i->second->Exit();
+
+	FIOThread->CancelTask( TaskID );
+
+	FLoads.erase( i );
+
+	return true;
+}
+
+bool clFileSystem::SetLoadPriority( size_t TaskID, int Priority )
+{
+	LMutex Lock( &FIOThreadMutex );
+
+	return FIOThread ? FIOThread->SetTaskPriority( TaskID, Priority ) : false;
+}
+
+size_t clFileSystem::GetNumPendingLoads() const
+{
+	LMutex Lock( &FIOThreadMutex );
+
+	return FLoads.size();
+}
+
+clPtr<iIStream> clFileSystem::CreateReader( const std::string& FileName, LAccessHint Hint ) const
+{
+	LIOTraceScope TraceScope( IOEvent_CreateReader, FileName );
+
 	std::string Name = Arch_FixFileName( FileName );
 
-	clPtr<iMountPoint> MountPoint = FindMountPoint( Name );
-	clPtr<iRawFile> RAWFile = MountPoint->CreateReader( Name );
+	RecordAccess( Name );
+
+	clPtr<iRawFile> RAWFile = TakePreloaded( Name );
+
+	if ( !RAWFile )
+	{
+		clPtr<iMountPoint> MountPoint = FindMountPoint( Name, NULL );
+		RAWFile = MountPoint ? MountPoint->CreateReader( Name, Hint ) : NULL;
+	}
+
+	if ( !RAWFile )
+	{
+		LOGI( "ERROR: unable to open file %s\n", FileName.c_str() );
+		return NULL;
+	}
 
 	if ( !RAWFile->GetFileData() ) { LOGI( "ERROR: unable to load file %s\n", FileName.c_str() ); }
 
+	TraceScope.SetBytes( RAWFile->GetFileSize() );
+
 	return new FileMapper( RAWFile );
 }
 
+clPtr<iIStream> clFileSystem::CreateStreamReader( const std::string& FileName ) const
+{
+	std::string Name = Arch_FixFileName( FileName );
+
+	RecordAccess( Name );
+
+	// the stream reads the file on its own, just release the pinned copy
+	TakePreloaded( Name );
+
+	clPtr<iMountPoint> MountPoint = FindMountPoint( Name, NULL );
+	clPtr<iIStream> Stream = MountPoint ? MountPoint->CreateStream( Name ) : NULL;
+
+	if ( !Stream ) { LOGI( "ERROR: unable to open file %s\n", FileName.c_str() ); }
+
+	return Stream;
+}
+
+void clFileSystem::StartAccessRecording( double Seconds )
+{
+	LMutex Lock( &FRecordingMutex );
+
+	FRecordedNames.clear();
+	FRecordedSet.clear();
+	FRecordingEnd = IOTrace_GetMicroseconds() + static_cast<int64>( Seconds * 1000000.0 );
+	FRecording = true;
+}
+
+void clFileSystem::StopAccessRecording()
+{
+	FRecording = false;
+}
+
+std::vector<std::string> clFileSystem::GetRecordedAccesses() const
+{
+	LMutex Lock( &FRecordingMutex );
+
+	return FRecordedNames;
+}
+
+void clFileSystem::RecordAccess( const std::string& FileName ) const
+{
+	if ( !FRecording ) { return; }
+
+	LMutex Lock( &FRecordingMutex );
+
+	if ( IOTrace_GetMicroseconds() > FRecordingEnd )
+	{
+		FRecording = false;
+		return;
+	}
+
+	if ( FRecordedSet.insert( FileName ).second ) { FRecordedNames.push_back( FileName ); }
+}
+
+bool clFileSystem::SaveAccessManifest( const std::string& PhysicalName ) const
+{
+	std::vector<std::string> Names = GetRecordedAccesses();
+
+	clPtr<FileWriter> Out = new FileWriter();
+
+	Out->SetAtomicCommit( true );
+
+	if ( !Out->Open( PhysicalName ) ) { return false; }
+
+	for ( size_t i = 0; i != Names.size(); i++ )
+	{
+		Out->Write( Names[i].c_str(), Names[i].length() );
+		Out->Write( "\n", 1 );
+	}
+
+	return Out->Close();
+}
+
+bool clFileSystem::PreloadFromManifest( const std::string& PhysicalName, int NumThreads )
+{
+	WaitForPreload( true );
+
+	{
+		LMutex Lock( &FPreloadMutex );
+
+		FPreloaded.clear();
+		FPreloadedBytes = 0;
+	}
+
+	clPtr<RawFile> Manifest = new RawFile();
+
+	if ( !FS_FileExistsPhys( PhysicalName ) || !Manifest->Open( PhysicalName, PhysicalName, AccessHint_Sequential ) ) { return false; }
+
+	FileMapper Reader( Manifest );
+
+	FPreloadNames.clear();
+
+	while ( !Reader.Eof() )
+	{
+		std::string Name = Reader.ReadLine();
+
+		if ( !Name.empty() ) { FPreloadNames.push_back( Arch_FixFileName( Name ) ); }
+	}
+
+	if ( NumThreads <= 0 ) { NumThreads = ( int )tthread::thread::hardware_concurrency(); }
+
+	if ( NumThreads <= 0 ) { NumThreads = 1; }
+
+	if ( NumThreads > ( int )FPreloadNames.size() ) { NumThreads = ( int )FPreloadNames.size(); }
+
+	FPreloadNext = 0;
+	FPreloadAbort = false;
+
+	for ( int i = 0; i < NumThreads; i++ ) { FPreloadThreads.push_back( new tthread::thread( &PreloadWorker, this ) ); }
+
+	return true;
+}
+
+void clFileSystem::PreloadWorker( void* Param )
+{
+	clFileSystem* FS = reinterpret_cast<clFileSystem*>( Param );
+
+	const int64 Count = ( int64 )FS->FPreloadNames.size();
+
+	while ( !FS->FPreloadAbort )
+	{
+		int64 i = Atomic::Add( &FS->FPreloadNext, 1 ) - 1;
+
+		if ( i >= Count ) { break; }
+
+		const std::string& Name = FS->FPreloadNames[ static_cast<size_t>( i ) ];
+
+		bool Exists = false;
+		clPtr<iMountPoint> MP = FS->FindMountPoint( Name, &Exists );
+
+		if ( !Exists ) { continue; }
+
+		/// Going around clFileSystem::CreateReader() keeps the preloading out of the access recording
+		clPtr<iRawFile> File = MP->CreateReader( Name, AccessHint_WillNeed );
+
+		if ( !File ) { continue; }
+
+		LMutex Lock( &FS->FPreloadMutex );
+
+		if ( !FS->FPreloaded.insert( std::make_pair( Name, File ) ).second ) { continue; }
+
+		FS->FPreloadedBytes += File->GetFileSize();
+
+		// the files further down the list would push the first ones out of memory
+		if ( FS->FPreloadedBytes >= FS_PRELOAD_BUDGET ) { break; }
+	}
+}
+
+clPtr<iRawFile> clFileSystem::TakePreloaded( const std::string& FileName ) const
+{
+	LMutex Lock( &FPreloadMutex );
+
+	if ( FPreloaded.empty() ) { return NULL; }
+
+	std::unordered_map< std::string, clPtr<iRawFile> >::iterator i = FPreloaded.find( FileName );
+
+	if ( i == FPreloaded.end() ) { return NULL; }
+
+	clPtr<iRawFile> File = i->second;
+
+	FPreloaded.erase( i );
+	FPreloadedBytes -= File->GetFileSize();
+
+	return File;
+}
+
+void clFileSystem::WaitForPreload( bool Abort )
+{
+	if ( Abort ) { FPreloadAbort = true; }
+
+	for ( size_t i = 0; i != FPreloadThreads.size(); i++ )
+	{
+		FPreloadThreads[i]->join();
+		delete FPreloadThreads[i];
+	}
+
+	FPreloadThreads.clear();
+}
+
 clPtr<iIStream> clFileSystem::ReaderFromString( const std::string& Str ) const
 {
 	MemRawFile* RawFile = new MemRawFile();
@@ -86,30 +436,88 @@ bool clFileSystem::FileExists( const std::string& Name ) const
 {
 	if ( Name.empty() || Name == "." ) { return false; }
 
-	clPtr<iMountPoint> MPD = FindMountPoint( Name );
-	return MPD ? MPD->FileExists( Name ) : false;
+	bool Exists = false;
+	FindMountPoint( Arch_FixFileName( Name ), &Exists );
+	return Exists;
 }
 
 std::string clFileSystem::VirtualNameToPhysical( const std::string& Path ) const
 {
 	if ( FS_IsFullPath( Path ) ) { return Path; }
 
-	clPtr<iMountPoint> MP = FindMountPoint( Path );
+	clPtr<iMountPoint> MP = FindMountPoint( Arch_FixFileName( Path ), NULL );
 	return ( !MP ) ? Path : MP->MapName( Path );
 }
 
 void clFileSystem::Mount( const std::string& PhysicalPath )
+{
+	AddMountPoint( CreateMountPoint( PhysicalPath ) );
+}
+
+clPtr<OverlayMountPoint> clFileSystem::MountOverlay( const std::vector<std::string>& PhysicalPaths )
+{
+	clPtr<OverlayMountPoint> Overlay = new OverlayMountPoint();
+
+	for ( size_t i = 0; i != PhysicalPaths.size(); i++ ) { Overlay->AddLayer( CreateMountPoint( PhysicalPaths[i] ) ); }
+
+	AddMountPoint( Overlay );
+
+	return Overlay;
+}
+
+bool clFileSystem::AddOverlayLayer( const clPtr<OverlayMountPoint>& Overlay, const std::string& PhysicalPath )
+{
+	clPtr<iMountPoint> Layer = CreateMountPoint( PhysicalPath );
+
+	if ( !Layer || !Overlay ) { return false; }
+
+	std::vector<std::string> Changed;
+
+	/// A folder patch can not list its files, so the index has no idea which names it provides
+	if ( Overlay->AddLayer( Layer, &Changed ) ) { UpdateIndex( Changed ); }
+	else { InvalidateIndex(); }
+
+	return true;
+}
+
+void clFileSystem::RemoveOverlayFile( const clPtr<OverlayMountPoint>& Overlay, const std::string& VirtualName )
+{
+	if ( !Overlay ) { return; }
+
+	std::vector<std::string> Changed;
+
+	if ( Overlay->RemoveFile( Arch_FixFileName( VirtualName ), &Changed ) ) { UpdateIndex( Changed ); }
+	else { InvalidateIndex(); }
+}
+
+clPtr<iMountPoint> clFileSystem::CreateMountPoint( const std::string& PhysicalPath )
 {
 	clPtr<iMountPoint> MPD = NULL;
 
 	if ( PhysicalPath.find( ".apk" ) != std::string::npos || PhysicalPath.find( ".zip" ) != std::string::npos )
 	{
 		clPtr<ArchiveReader> Reader = new ArchiveReader();
+		Reader->SetContentCache( FContentCache );
+
+		std::string PhysicalName = VirtualNameToPhysical( PhysicalPath );
 
-		Reader->OpenArchive( CreateReader( PhysicalPath ) );
+		Reader->OpenArchive( CreateReader( PhysicalPath ), GetArchiveIndexName( PhysicalName ), FS_GetFileTime( PhysicalName ) );
 
 		MPD = new ArchiveMountPoint( Reader );
 	}
+	else if ( PhysicalPath.find( ".bundle" ) != std::string::npos )
+	{
+		clPtr<clBundleReader> Reader = new clBundleReader();
+		Reader->SetContentCache( FContentCache );
+
+		if ( !Reader->Open( CreateReader( PhysicalPath, AccessHint_Random ) ) )
+		{
+			LOGI( "ERROR: invalid bundle %s\n", PhysicalPath.c_str() );
+			return NULL;
+		}
+
+		MPD = new BundleMountPoint( Reader );
+	}
 	else
 	{
 #if !defined( OS_ANDROID )
@@ -117,18 +525,30 @@ void clFileSystem::Mount( const std::string& PhysicalPath )
 		if ( !FS_FileExistsPhys( PhysicalPath ) )
 		{
 			// WARNING: "Unable to mount: '" + PhysicalPath + "' not found"
-			return;
+			return NULL;
 		}
 
 #endif
 		MPD = new PhysicalMountPoint( PhysicalPath );
 	}
 
-	if ( MPD )
-	{
-		MPD->SetName( PhysicalPath );
-		AddMountPoint( MPD );
-	}
+	if ( MPD ) { MPD->SetName( PhysicalPath ); }
+
+	return MPD;
+}
+
+std::string clFileSystem::GetArchiveIndexName( const std::string& PhysicalName ) const
+{
+	if ( FArchiveIndexDir.empty() ) { return PhysicalName + ".idx"; }
+
+	std::string Dir = FArchiveIndexDir;
+	Str_AddTrailingChar( &Dir, PATH_SEPARATOR );
+
+	/// Archives with the same name from different folders should not share the index
+	size_t Slash = PhysicalName.find_last_of( "/\\" );
+	std::string BaseName = ( Slash == std::string::npos ) ? PhysicalName : PhysicalName.substr( Slash + 1 );
+
+	return Dir + BaseName + Str_GetFormatted( ".%08x.idx", Arch_HashFileName( PhysicalName.c_str() ) );
 }
 
 void clFileSystem::AddAliasMountPoint( const std::string& SrcPath, const std::string& AliasPrefix )
@@ -144,6 +564,8 @@ void clFileSystem::AddAliasMountPoint( const std::string& SrcPath, const std::st
 
 clPtr<iMountPoint> clFileSystem::FindMountPointByName( const std::string& ThePath )
 {
+	LMutex Lock( &FResolvedNamesMutex );
+
 	for ( size_t i = 0 ; i != FMountPoints.size() ; i++ )
 		if ( FMountPoints[i]->GetName() == ThePath ) { return FMountPoints[i]; }
 
@@ -154,21 +576,136 @@ void clFileSystem::AddMountPoint( const clPtr<iMountPoint>& MP )
 {
 	if ( !MP ) { return; }
 
-	if ( std::find( FMountPoints.begin(), FMountPoints.end(), MP ) == FMountPoints.end() ) { FMountPoints.push_back( MP ); }
+	{
+		/// The I/O and preloading threads may be looking up names right now
+		LMutex Lock( &FResolvedNamesMutex );
+
+		if ( std::find( FMountPoints.begin(), FMountPoints.end(), MP ) == FMountPoints.end() ) { FMountPoints.push_back( MP ); }
+	}
+
+	InvalidateIndex();
+}
+
+/// The first mount point is checked first, then the rest in reverse order
+static size_t MountPointByPriority( size_t i, size_t Count )
+{
+	return ( i == 0 ) ? 0 : Count - i;
+}
+
+void clFileSystem::InvalidateIndex()
+{
+	LMutex Lock( &FResolvedNamesMutex );
+
+	FResolvedNames.clear();
+	FUnlisted.clear();
+
+	/// Prefill the index from the mount points which can list their files, the others are remembered to be probed on lookup
+	for ( size_t i = 0; i != FMountPoints.size(); i++ )
+	{
+		const clPtr<iMountPoint>& MP = FMountPoints[ MountPointByPriority( i, FMountPoints.size() ) ];
+
+		sResolvedName Resolved;
+		Resolved.FMountPoint = MP;
+		Resolved.FExists = true;
+		Resolved.FRank = i;
+
+		std::vector<std::string> Names;
+
+		if ( !MP->EnumerateFiles( &Names ) )
+		{
+			FUnlisted.push_back( Resolved );
+			continue;
+		}
+
+		/// Names from the higher priority mount points are already there and are not replaced
+		for ( size_t j = 0; j != Names.size(); j++ ) { FResolvedNames.insert( std::make_pair( Names[j], Resolved ) ); }
+	}
 }
 
-clPtr<iMountPoint> clFileSystem::FindMountPoint( const std::string& FileName ) const
+void clFileSystem::UpdateIndex( const std::vector<std::string>& Names )
 {
-	if ( FMountPoints.empty() ) { return NULL; }
+	LMutex Lock( &FResolvedNamesMutex );
 
-	if ( ( *FMountPoints.begin() )->FileExists( FileName ) )
+	for ( size_t i = 0; i != Names.size(); i++ )
 	{
-		return ( *FMountPoints.begin() );
+		sResolvedName Resolved;
+
+		/// Every enumerable mount point is in the index, so a missing name means none of them has the file
+		if ( ProbeListedMountPoints( Names[i], &Resolved ) ) { FResolvedNames[ Names[i] ] = Resolved; }
+		else { FResolvedNames.erase( Names[i] ); }
+	}
+}
+
+bool clFileSystem::ProbeListedMountPoints( const std::string& FileName, sResolvedName* Resolved ) const
+{
+	size_t Unlisted = 0;
+
+	for ( size_t i = 0; i != FMountPoints.size(); i++ )
+	{
+		if ( Unlisted != FUnlisted.size() && FUnlisted[ Unlisted ].FRank == i )
+		{
+			Unlisted++;
+			continue;
+		}
+
+		const clPtr<iMountPoint>& MP = FMountPoints[ MountPointByPriority( i, FMountPoints.size() ) ];
+
+		IOTrace_Get().CountProbe( MP->GetName() );
+
+		if ( MP->FileExists( FileName ) )
+		{
+			Resolved->FMountPoint = MP;
+			Resolved->FExists = true;
+			Resolved->FRank = i;
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+clPtr<iMountPoint> clFileSystem::FindMountPoint( const std::string& FileName, bool* Exists ) const
+{
+	if ( Exists ) { *Exists = false; }
+
+	sResolvedName Resolved;
+	std::vector<sResolvedName> Unlisted;
+
+	{
+		LMutex Lock( &FResolvedNamesMutex );
+
+		if ( FMountPoints.empty() ) { return NULL; }
+
+		std::unordered_map<std::string, sResolvedName>::const_iterator i = FResolvedNames.find( FileName );
+
+		if ( i != FResolvedNames.end() )
+		{
+			Resolved = i->second;
+		}
+		else
+		{
+			Resolved.FMountPoint = *( FMountPoints.begin() );
+			Resolved.FExists = false;
+			Resolved.FRank = FMountPoints.size();
+		}
+
+		Unlisted = FUnlisted;
+	}
+
+	/// Probing is slow, so the unlisted mount points are probed outside of the lock. Those with a higher priority override the index
+	for ( size_t i = 0; i != Unlisted.size() && Unlisted[i].FRank < Resolved.FRank; i++ )
+	{
+		IOTrace_Get().CountProbe( Unlisted[i].FMountPoint->GetName() );
+
+		if ( Unlisted[i].FMountPoint->FileExists( FileName ) )
+		{
+			Resolved = Unlisted[i];
+			break;
+		}
 	}
 
-	// reverse order
-	for ( std::vector<clPtr<iMountPoint> >::const_reverse_iterator i = FMountPoints.rbegin(); i != FMountPoints.rend(); ++i )
-		if ( ( *i )->FileExists( FileName ) ) { return ( *i ); }
+	if ( Exists ) { *Exists = Resolved.FExists; }
 
-	return *( FMountPoints.begin() );
+	return Resolved.FMountPoint;
 }
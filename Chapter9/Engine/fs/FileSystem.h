@@ -35,41 +35,223 @@
 #pragma once
 
 #include "Files.h"
+#include "ContentCache.h"
+#include "Mutex.h"
+#include "WorkerThread.h"
+#include "Event.h"
 
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace tthread
+{
+	class thread;
+}
 
 class iMountPoint;
+class OverlayMountPoint;
+
+/// Preloaded files held until their first use, preloading stops when they add up to this many bytes
+const uint64 FS_PRELOAD_BUDGET = 16 * 1024 * 1024;
+
+/// Completion callback for clFileSystem::LoadAsync(). FResult is NULL if the file can not be loaded
+class clFileLoadCompleteCallback: public iAsyncCapsule
+{
+public:
+	virtual void Invoke() {}
+
+	size_t        FTaskID;
+	std::string   FFileName;
+	clPtr<clBlob> FResult;
+};
+
+class clFileSystem;
+
+/// Weak link to the file system for the async load deliveries, cleared by the destructor of clFileSystem
+class clFileSystemLink: public iObject
+{
+public:
+	explicit clFileSystemLink( clFileSystem* FS ): FFileSystem( FS ) {}
+
+	clFileSystem* FFileSystem;
+	clMutex       FMutex;
+};
 
 class clFileSystem: public iObject
 {
 public:
-	clFileSystem() {}
-	virtual ~clFileSystem() {}
+	clFileSystem(): FEventQueue( NULL ), FRecording( false ), FRecordingEnd( 0 ), FPreloadNext( 0 ), FPreloadAbort( false ), FPreloadedBytes( 0 ), FNextTaskID( 0 ), FLink( new clFileSystemLink( this ) ) {}
+	virtual ~clFileSystem();
 
-	clPtr<iIStream> CreateReader( const std::string& FileName ) const;
+	/// Open the file. Hint is passed down to the mount point to set up read-ahead for the mapping
+	clPtr<iIStream> CreateReader( const std::string& FileName, LAccessHint Hint = AccessHint_Normal ) const;
+	/// Open the file for sequential reading. Compressed archive entries are decoded as the stream is read and are never fully loaded into memory
+	clPtr<iIStream> CreateStreamReader( const std::string& FileName ) const;
 	clPtr<iIStream> ReaderFromString( const std::string& Str ) const;
 	clPtr<iIStream> ReaderFromMemory( const void* BufPtr, uint64 BufSize, bool OwnsData ) const;
 	clPtr<iIStream> ReaderFromBlob( const clPtr<clBlob>& Blob ) const;
 
-	clPtr<clBlob> LoadFileAsBlob( const std::string& FName ) const
+	/// Load the file as a read-only blob borrowing the file mapping. Nothing is copied until the blob is modified
+	// most callers parse the file once from start to end
+	clPtr<clBlob> LoadFileAsBlob( const std::string& FName, LAccessHint Hint = AccessHint_Sequential ) const
 	{
-		clPtr<iIStream> input = CreateReader( FName );
+		LIOTraceScope TraceScope( IOEvent_LoadBlob, FName );
+
+		clPtr<iIStream> input = CreateReader( FName, Hint );
+
+		if ( !input ) { return NULL; }
+
 		clPtr<clBlob> Res = new clBlob();
-		Res->CopyMemoryBlock( input->MapStream(), ( size_t )input->GetSize() );
+		Res->SetReadOnlyData( input->MapStream(), ( size_t )input->GetSize(), input );
+		TraceScope.SetBytes( Res->GetSize() );
 		return Res;
 	}
 
 	void        Mount( const std::string& PhysicalPath );
+	/// Mount the folders/archives/bundles as layers of a single overlay, the last one is on top
+	clPtr<OverlayMountPoint> MountOverlay( const std::vector<std::string>& PhysicalPaths );
+	/// Put a patch on top of the overlay at runtime. Only the names provided or deleted by the patch are reindexed
+	bool        AddOverlayLayer( const clPtr<OverlayMountPoint>& Overlay, const std::string& PhysicalPath );
+	/// Delete the file or folder from all the layers of the overlay and reindex the affected names
+	void        RemoveOverlayFile( const clPtr<OverlayMountPoint>& Overlay, const std::string& VirtualName );
 	void        AddAliasMountPoint( const std::string& SrcPath, const std::string& AliasPrefix );
 	void        AddMountPoint( const clPtr<iMountPoint>& MP );
 
 	std::string VirtualNameToPhysical( const std::string& Path ) const;
 	bool        FileExists( const std::string& Name ) const;
+
+	/// Set the folder for the cached archive directory indices. By default they are stored next to the archives
+	void        SetArchiveIndexDir( const std::string& Dir ) { FArchiveIndexDir = Dir; }
+	std::string GetArchiveIndexDir() const { return FArchiveIndexDir; }
+
+	/// Let identical files from different archives and bundles share a single decoded copy. Affects the containers mounted afterwards
+	void        SetContentSharing( bool Enable ) { FContentCache = Enable ? ( FContentCache ? FContentCache : new clContentCache() ) : NULL; }
+	/// NULL if the content sharing is disabled
+	clPtr<clContentCache> GetContentCache() const { return FContentCache; }
+
+	/// Forget all resolved names. Should be called if files are added to or removed from physical folders at runtime
+	void        InvalidateIndex();
+
+	/**
+	   \brief Load the file as a blob on the I/O thread
+
+	   Higher priority requests are served first. The callback is delivered through FEventQueue (or invoked on the I/O thread if there is no queue).
+	   Returns the task ID to be used with CancelLoad() and SetLoadPriority()
+	*/
+	size_t      LoadAsync( const std::string& FileName, int Priority, const clPtr<clFileLoadCompleteCallback>& CB );
+
+	/// Cancel the pending load. The callback will not be invoked if this is called on the thread which demultiplexes FEventQueue
+	bool        CancelLoad( size_t TaskID );
+
+	/// Reorder the pending load
+	bool        SetLoadPriority( size_t TaskID, int Priority );
+
+	/// Number of async loads which have not been delivered yet
+	size_t      GetNumPendingLoads() const;
+
+	/// Start logging the files opened during the next Seconds, each file is listed once in the order of the first access
+	void        StartAccessRecording( double Seconds );
+	void        StopAccessRecording();
+	std::vector<std::string> GetRecordedAccesses() const;
+
+	/// Save the recorded file list, one virtual name per line
+	bool        SaveAccessManifest( const std::string& PhysicalName ) const;
+
+	/**
+	   \brief Prefetch the files listed in the manifest on NumThreads background threads (0 - one per CPU core)
+
+	   Deflated archive entries are extracted into the archive cache, the other files are read ahead into the page cache.
+	   The files are taken in the recorded order, so the first ones are ready first. Each preloaded file is held until
+	   it is first opened, up to FS_PRELOAD_BUDGET bytes. Returns false if the manifest can not be read
+	*/
+	bool        PreloadFromManifest( const std::string& PhysicalName, int NumThreads = 0 );
+
+	/// Block until the preloading threads are finished. If Abort is true the files not yet taken are skipped
+	void        WaitForPreload( bool Abort = false );
+
+	/// External event queue for the async load callbacks
+	iAsyncQueue* FEventQueue;
 private:
+	/// Get the name of the cached directory index for the archive
+	std::string GetArchiveIndexName( const std::string& PhysicalName ) const;
+
+	/// Create a mount point for the folder, archive or bundle. Returns NULL if it can not be mounted
+	clPtr<iMountPoint> CreateMountPoint( const std::string& PhysicalPath );
+	/// Resolve the names again after some of them have been added or deleted
+	void        UpdateIndex( const std::vector<std::string>& Names );
+
 	clPtr<iMountPoint> FindMountPointByName( const std::string& ThePath );
-	/// Search for a mount point for this file
-	clPtr<iMountPoint>  FindMountPoint( const std::string& FileName ) const;
-	std::vector< clPtr<iMountPoint> > FMountPoints;
+	/// Search for a mount point for this (normalized) file name. Exists is set if the file is actually found
+	clPtr<iMountPoint>  FindMountPoint( const std::string& FileName, bool* Exists ) const;
+	typedef std::vector< clPtr<iMountPoint> > clMountPoints;
+
+	/// Guarded by FResolvedNamesMutex: the I/O and preloading threads resolve names while the main thread mounts
+	clMountPoints FMountPoints;
+	std::string FArchiveIndexDir;
+
+	/// Decoded files shared by all the mounted containers
+	clPtr<clContentCache> FContentCache;
+
+	/// Virtual name resolution index entry
+	struct sResolvedName
+	{
+		clPtr<iMountPoint> FMountPoint;
+		bool               FExists;
+		/// Position of FMountPoint in the probing order
+		size_t             FRank;
+	};
+
+	/// Probe the enumerable mount points in the order of priority. Returns false if none of them has the file
+	bool ProbeListedMountPoints( const std::string& FileName, sResolvedName* Resolved ) const;
+
+	/// Normalized virtual name to mount point map, filled from the enumerable mount points only
+	std::unordered_map<std::string, sResolvedName> FResolvedNames;
+	/// Mount points which can not list their files (e.g. folders) in the probing order. They are probed on each lookup
+	/// and their files never go to FResolvedNames, since the files in a folder come and go
+	std::vector<sResolvedName> FUnlisted;
+	/// Guards FResolvedNames, FUnlisted and FMountPoints
+	mutable clMutex FResolvedNamesMutex;
+
+	friend class clFileLoadTask;
+	friend class clFileLoadDelivery;
+
+	/// Remove the load from FLoads. Returns false if it has been cancelled
+	bool CompleteLoad( size_t TaskID );
+
+	/// Remember the opened file if the access recording is on
+	void RecordAccess( const std::string& FileName ) const;
+
+	static void PreloadWorker( void* Param );
+
+	/// Take the preloaded file out of FPreloaded, NULL if it has not been preloaded
+	clPtr<iRawFile> TakePreloaded( const std::string& FileName ) const;
+
+	mutable volatile bool FRecording;
+	int64          FRecordingEnd;
+	mutable std::vector<std::string>        FRecordedNames;
+	mutable std::unordered_set<std::string> FRecordedSet;
+	mutable clMutex                         FRecordingMutex;
+
+	std::vector<std::string>       FPreloadNames;
+	volatile int64                 FPreloadNext;
+	volatile bool                  FPreloadAbort;
+	std::vector<tthread::thread*>  FPreloadThreads;
+	/// Guarded by FPreloadMutex: the extracted blobs are pinned here, otherwise the later preloads evict them from the archive cache
+	mutable std::unordered_map< std::string, clPtr<iRawFile> > FPreloaded;
+	mutable uint64                 FPreloadedBytes;
+	mutable clMutex                FPreloadMutex;
+
+	/// Dedicated thread for the async loads, started on demand
+	clPtr<clWorkerThread> FIOThread;
+	/// Loads which have not been delivered yet
+	std::map< size_t, clPtr<iTask> > FLoads;
+	mutable clMutex       FIOThreadMutex;
+	volatile long         FNextTaskID;
+
+	/// Shared with the deliveries sitting in FEventQueue
+	clPtr<clFileSystemLink> FLink;
 };
 
 inline clPtr<MemFileWriter> CreateMemWriter( const std::string& FileName, uint64 InitialSize )
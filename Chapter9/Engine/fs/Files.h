@@ -36,6 +36,7 @@
 
 #include "Streams.h"
 #include "Blob.h"
+#include "IOTrace.h"
 
 #ifdef _WIN32
 #  include <windows.h>
@@ -43,7 +44,9 @@
 #  include <sys/types.h>
 #  include <sys/stat.h>
 #  include <sys/mman.h>
+#  include <sys/uio.h>
 #  include <fcntl.h>
+#  include <unistd.h>
 #  include <errno.h>
 #endif
 
@@ -51,6 +54,17 @@
 #include <string.h>
 #include <stdio.h>
 
+#include <vector>
+
+/// Default size of the FileWriter coalescing buffer
+const size_t FILEWRITER_DEFAULT_BUFFER_SIZE = 64 * 1024;
+
+/// Files up to this size are prefaulted at once by RawFile::Open() with AccessHint_WillNeed
+const uint64 RAWFILE_POPULATE_MAX_SIZE = 1024 * 1024;
+
+/// Granularity of ReleaseRange() calls made by the streams which drop the data behind the read cursor
+const uint64 STREAM_RELEASE_CHUNK = 256 * 1024;
+
 class iRawFile: public iObject
 {
 public:
@@ -65,6 +79,12 @@ public:
 
 	virtual const ubyte*    GetFileData() const = 0;
 	virtual uint64          GetFileSize() const = 0;
+
+	/// Advise the kernel about the access pattern of the given range (the whole file if Size is 0). Returns false if the hint is not supported
+	virtual bool            AdviseAccess( LAccessHint /*Hint*/, uint64 /*Offset*/ = 0, uint64 /*Size*/ = 0 ) { return false; }
+	/// Let the kernel drop the pages of the range which have already been consumed. Only a file which owns its mapping does it,
+	/// a view into a shared mapping (e.g. an archive entry) would take the pages away from the other readers
+	virtual void            ReleaseRange( uint64 /*Offset*/, uint64 /*Size*/ ) {}
 protected:
 	std::string    FFileName;
 	std::string    FVirtualFileName;
@@ -77,8 +97,10 @@ public:
 	RawFile() {}
 	virtual ~RawFile() { Close(); }
 
-	bool Open( const std::string& FileName, const std::string& VirtualFileName )
+	bool Open( const std::string& FileName, const std::string& VirtualFileName, LAccessHint Hint = AccessHint_Normal )
 	{
+		LIOTraceScope TraceScope( IOEvent_Open, VirtualFileName );
+
 		SetFileName( FileName );
 		SetVirtualFileName( VirtualFileName );
 
@@ -87,10 +109,13 @@ public:
 
 #ifdef _WIN32
 		FMapFile = CreateFileA( FFileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-		                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS, NULL );
+		                        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | ( Hint == AccessHint_Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS ), NULL );
 		// FMapFile == INVALID_HANDLE_VALUE ?
 #else
 		FFileHandle = open( FileName.c_str(), O_RDONLY );
+
+		if ( FFileHandle == -1 ) { return false; }
+
 #endif
 
 #ifdef _WIN32
@@ -110,15 +135,85 @@ public:
 		// don't call mmap() for zero-sized files
 		if ( FSize )
 		{
+#if defined( __linux__ ) && !defined( ANDROID )
+
+			if ( Hint != AccessHint_Normal ) { posix_fadvise( FFileHandle, 0, 0, GetFAdvice( Hint ) ); }
+
+#endif
+
+			int Flags = MAP_PRIVATE;
+
+#if defined( MAP_POPULATE )
+
+			// read small files in one go instead of faulting them page by page
+			if ( Hint == AccessHint_WillNeed && FSize <= RAWFILE_POPULATE_MAX_SIZE ) { Flags |= MAP_POPULATE; }
+
+#endif
+
 			// create share/read-only file mapping
-			FFileData = ( ubyte* )( mmap( NULL, FSize, PROT_READ, MAP_PRIVATE, FFileHandle, 0 ) );
+			FFileData = ( ubyte* )( mmap( NULL, FSize, PROT_READ, Flags, FFileHandle, 0 ) );
+
+			if ( FFileData == MAP_FAILED ) { FFileData = NULL; }
+
+			if ( FFileData && Hint != AccessHint_Normal ) { AdviseAccess( Hint ); }
 		}
 
 		close( FFileHandle );
 #endif
+		TraceScope.SetBytes( FSize );
+
+		IOTrace_Get().Count( IOCounter_Opens, 1 );
+
+		if ( FFileData ) { IOTrace_Get().Count( IOCounter_BytesMapped, FSize ); }
+
 		return true;
 	}
 
+	virtual bool AdviseAccess( LAccessHint Hint, uint64 Offset = 0, uint64 Size = 0 )
+	{
+#ifdef _WIN32
+		return false;
+#else
+
+		if ( !FFileData || Offset >= FSize ) { return false; }
+
+		if ( !Size || Size > FSize - Offset ) { Size = FSize - Offset; }
+
+		const uint64 PageSize = static_cast<uint64>( sysconf( _SC_PAGESIZE ) );
+
+		uint64 Begin = Offset & ~( PageSize - 1 );
+		uint64 End   = Offset + Size;
+
+		// never drop the pages partially outside of the range, someone may still use them
+		if ( Hint == AccessHint_DontNeed )
+		{
+			Begin = ( Offset + PageSize - 1 ) & ~( PageSize - 1 );
+			End   = ( End == FSize ) ? End : End & ~( PageSize - 1 );
+		}
+
+		if ( End <= Begin ) { return false; }
+
+		return madvise( FFileData + Begin, static_cast<size_t>( End - Begin ), GetMAdvice( Hint ) ) == 0;
+#endif
+	}
+
+	/// Unmap the range from this mapping, then drop it from the page cache. The kernel keeps the pages other processes or views still map
+	virtual void ReleaseRange( uint64 Offset, uint64 Size )
+	{
+		if ( !AdviseAccess( AccessHint_DontNeed, Offset, Size ) ) { return; }
+
+#if defined( __linux__ ) && !defined( ANDROID )
+		// the handle is closed right after mmap() in Open()
+		int Handle = open( FFileName.c_str(), O_RDONLY );
+
+		if ( Handle == -1 ) { return; }
+
+		posix_fadvise( Handle, static_cast<off_t>( Offset ), static_cast<off_t>( Size ), POSIX_FADV_DONTNEED );
+
+		close( Handle );
+#endif
+	}
+
 	void Close()
 	{
 #ifdef _WIN32
@@ -143,6 +238,42 @@ private:
 	HANDLE     FMapHandle;
 #else
 	int        FFileHandle;
+
+	static int GetMAdvice( LAccessHint Hint )
+	{
+		switch ( Hint )
+		{
+			case AccessHint_Sequential:
+				return MADV_SEQUENTIAL;
+			case AccessHint_Random:
+				return MADV_RANDOM;
+			case AccessHint_WillNeed:
+				return MADV_WILLNEED;
+			case AccessHint_DontNeed:
+				return MADV_DONTNEED;
+			default:
+				return MADV_NORMAL;
+		}
+	}
+
+#if defined( __linux__ ) && !defined( ANDROID )
+	static int GetFAdvice( LAccessHint Hint )
+	{
+		switch ( Hint )
+		{
+			case AccessHint_Sequential:
+				return POSIX_FADV_SEQUENTIAL;
+			case AccessHint_Random:
+				return POSIX_FADV_RANDOM;
+			case AccessHint_WillNeed:
+				return POSIX_FADV_WILLNEED;
+			case AccessHint_DontNeed:
+				return POSIX_FADV_DONTNEED;
+			default:
+				return POSIX_FADV_NORMAL;
+		}
+	}
+#endif
 #endif
 	ubyte*    FFileData;
 	uint64    FSize;
@@ -213,12 +344,36 @@ private:
 	uint64        FBufferSize;
 };
 
+/// Read-only window into the memory of another stream (e.g. an entry stored inside a memory-mapped archive)
+class SubRawFile: public iRawFile
+{
+public:
+	SubRawFile( const clPtr<iIStream>& Source, uint64 Offset, uint64 Size ): FSource( Source ), FOffset( Offset ), FSize( Size ) {}
+
+	virtual const ubyte* GetFileData() const { return FSource->MapStream() + FOffset; }
+	virtual uint64       GetFileSize() const { return FSize; }
+
+	virtual bool         AdviseAccess( LAccessHint Hint, uint64 Offset = 0, uint64 Size = 0 )
+	{
+		if ( Offset >= FSize ) { return false; }
+
+		if ( !Size || Size > FSize - Offset ) { Size = FSize - Offset; }
+
+		return FSource->AdviseAccess( Hint, FOffset + Offset, Size );
+	}
+private:
+	/// Keeps the underlying mapping alive while this view is in use
+	clPtr<iIStream> FSource;
+	uint64          FOffset;
+	uint64          FSize;
+};
+
 class ManagedMemRawFile: public iRawFile
 {
 public:
 	ManagedMemRawFile(): FBlob( NULL ) {}
 
-	virtual const ubyte* GetFileData() const { return ( const ubyte* )FBlob->GetData(); }
+	virtual const ubyte* GetFileData() const { return ( const ubyte* )FBlob->GetDataConst(); }
 	virtual uint64       GetFileSize() const { return FBlob->GetSize(); }
 
 	void SetBlob( const clPtr<clBlob>& Ptr ) { FBlob = Ptr; }
@@ -229,7 +384,7 @@ private:
 class FileMapper: public iIStream
 {
 public:
-	FileMapper( clPtr<iRawFile> File ): FFile( File ), FPosition( 0 ) {}
+	FileMapper( clPtr<iRawFile> File ): FFile( File ), FPosition( 0 ), FReleaseBehind( false ), FReleasedPos( 0 ) {}
 	virtual ~FileMapper() {}
 
 	virtual std::string  GetVirtualFileName() const { return FFile->GetVirtualFileName(); }
@@ -242,10 +397,27 @@ public:
 
 		FPosition += RealSize;
 
+		IOTrace_Get().Count( IOCounter_BytesCopied, RealSize );
+
+		if ( FReleaseBehind && FPosition >= FReleasedPos + STREAM_RELEASE_CHUNK )
+		{
+			FFile->ReleaseRange( FReleasedPos, FPosition - FReleasedPos );
+			FReleasedPos = FPosition;
+		}
+
 		return RealSize;
 	}
 
-	virtual void         Seek( const uint64 Position )     { FPosition  = Position; }
+	virtual void         Seek( const uint64 Position )
+	{
+		FPosition = Position;
+
+		// the pages before the new position will be faulted in again if they are read
+		if ( FPosition < FReleasedPos ) { FReleasedPos = FPosition; }
+	}
+
+	/// Drop the pages behind the read cursor as Read() goes. Only for the streams read once from start to end, MapStream() users would fault them in again
+	void                 SetReleaseBehind( bool ReleaseBehind ) { FReleaseBehind = ReleaseBehind; }
 
 	virtual uint64       GetSize() const { return FFile->GetFileSize(); }
 	virtual uint64       GetPos()  const { return FPosition; }
@@ -254,6 +426,9 @@ public:
 	virtual const ubyte* MapStream()   const { return FFile->GetFileData(); }
 	virtual const ubyte* MapStreamFromCurrentPos() const { return ( FFile->GetFileData() + FPosition ); }
 
+	virtual bool         AdviseAccess( LAccessHint Hint, uint64 Offset = 0, uint64 Size = 0 ) { return FFile->AdviseAccess( Hint, Offset, Size ); }
+	virtual void         ReleaseRange( uint64 Offset, uint64 Size ) { FFile->ReleaseRange( Offset, Size ); }
+
 	virtual std::string ReadLine()
 	{
 		const size_t MAX_LINE_WIDTH = 65535;
@@ -285,45 +460,170 @@ public:
 private:
 	clPtr<iRawFile> FFile;
 	uint64          FPosition;
+	bool            FReleaseBehind;
+	/// Everything before this position has been released
+	uint64          FReleasedPos;
 };
 
+/// When the written data is forced to the storage device
+enum LDurability
+{
+   Durability_None        = 0,
+   /// fdatasync() once in Close()
+   Durability_SyncOnClose = 1,
+   /// fdatasync() every SetSyncPeriod() bytes and in Close()
+   Durability_Periodic    = 2
+};
+
+/// Buffered file writer. Small writes are coalesced in memory, large ones are sent together with the buffered data in a single writev()
 class FileWriter: public iOStream
 {
 public:
-	FileWriter(): FPosition( 0 ) {}
+	FileWriter()
+		: FPosition( 0 ),
+		  FBufferSize( FILEWRITER_DEFAULT_BUFFER_SIZE ),
+		  FDurability( Durability_None ),
+		  FSyncPeriod( 0 ),
+		  FUnsyncedBytes( 0 ),
+		  FAtomicCommit( false ),
+		  FFailed( false )
+#ifdef _WIN32
+		, FMapFile( INVALID_HANDLE_VALUE )
+#else
+		, FMapFile( -1 )
+#endif
+	{}
 	virtual ~FileWriter() { Close(); }
 
+	/// Size of the coalescing buffer, 0 disables buffering. Takes effect on the next Open()
+	void   SetBufferSize( size_t Size ) { FBufferSize = Size; }
+	size_t GetBufferSize() const { return FBufferSize; }
+
+	void   SetDurability( LDurability Durability ) { FDurability = Durability; }
+	/// Number of bytes between fdatasync() calls for Durability_Periodic
+	void   SetSyncPeriod( uint64 Bytes ) { FSyncPeriod = Bytes; }
+
+	/**
+	   \brief Write into a temporary file and rename it over FileName in Close()
+
+	   Readers see either the old or the complete new file, never a partial one. Must be set before Open().
+	   With any durability other than Durability_None the parent folder is synced after the rename as well
+	*/
+	void   SetAtomicCommit( bool Atomic ) { FAtomicCommit = Atomic; }
+
+	/// True if any write or sync has failed since Open()
+	bool   HasFailed() const { return FFailed; }
+
 	bool Open( const std::string& FileName )
 	{
+		Close();
+
 		FFileName = FileName;
+		FTargetFileName = FAtomicCommit ? FileName + ".tmp" : FileName;
+		FPosition = 0;
+		FUnsyncedBytes = 0;
+		FFailed = false;
+
+		FBuffer.clear();
+		FBuffer.reserve( FBufferSize );
+
 #ifdef _WIN32
-		FMapFile = CreateFile( FFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+		FMapFile = CreateFile( FTargetFileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
 		                       CREATE_ALWAYS,
 		                       FILE_ATTRIBUTE_NORMAL, NULL );
 
 		return !( FMapFile == ( void* )INVALID_HANDLE_VALUE );
 #else
-		FMapFile = open( FFileName.c_str(), O_WRONLY | O_CREAT );
-		FPosition = 0;
+		FMapFile = open( FTargetFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH );
 		return !( FMapFile == -1 );
 #endif
 	}
 
-	void Close()
+	/// Flush, sync and close the file. In the atomic mode the file replaces the target only if everything has been written. Returns false on any failure
+	bool Close()
 	{
+		if ( !IsOpen() ) { return !FFailed; }
+
+		Flush();
+
+		if ( FDurability != Durability_None || FAtomicCommit ) { Sync(); }
+
 #ifdef _WIN32
 		CloseHandle( FMapFile );
+		FMapFile = INVALID_HANDLE_VALUE;
+#else
+
+		if ( close( FMapFile ) != 0 ) { FFailed = true; }
+
+		FMapFile = -1;
+#endif
+
+		if ( FAtomicCommit )
+		{
+			if ( FFailed || !RenameFile( FTargetFileName, FFileName ) )
+			{
+				remove( FTargetFileName.c_str() );
+				FFailed = true;
+			}
+			// the new directory entry is durable only after the directory itself is synced
+			else if ( FDurability != Durability_None && !SyncParentFolder( FFileName ) )
+			{
+				FFailed = true;
+			}
+		}
+
+		return !FFailed;
+	}
+
+	/// Close the file without committing it. In the atomic mode the previous contents of the target file are preserved
+	void Discard()
+	{
+		FFailed = true;
+		FBuffer.clear();
+		Close();
+	}
+
+	/// Send the buffered data to the OS
+	bool Flush()
+	{
+		if ( FBuffer.empty() ) { return !FFailed; }
+
+		bool Result = WriteFully( &FBuffer[0], FBuffer.size(), NULL, 0 );
+
+		FBuffer.clear();
+
+		return Result;
+	}
+
+	/// Force the written data to the storage device
+	bool Sync()
+	{
+		if ( !Flush() ) { return false; }
+
+		FUnsyncedBytes = 0;
+
+#ifdef _WIN32
+
+		if ( !FlushFileBuffers( FMapFile ) ) { FFailed = true; }
+
+#elif defined( __APPLE__ )
+
+		if ( fsync( FMapFile ) != 0 ) { FFailed = true; }
+
 #else
 
-		if ( FMapFile != -1 ) { close( FMapFile ); }
+		if ( fdatasync( FMapFile ) != 0 ) { FFailed = true; }
 
 #endif
+		return !FFailed;
 	}
 
 	virtual std::string GetFileName() const { return FFileName; }
 	virtual uint64      GetFilePos() const { return FPosition; }
 	virtual void        Seek( const uint64 Position )
 	{
+		Flush();
+
 #ifdef _WIN32
 		SetFilePointerEx( FMapFile, *reinterpret_cast<const LARGE_INTEGER*>( &Position ), NULL, FILE_BEGIN );
 #else
@@ -335,27 +635,162 @@ public:
 	}
 
 	virtual uint64      Write( const void* Buf, const uint64 Size )
+	{
+		if ( !IsOpen() || FFailed ) { return 0; }
+
+		if ( FBuffer.size() + Size <= FBufferSize )
+		{
+			// coalesce small writes
+			const ubyte* Src = reinterpret_cast<const ubyte*>( Buf );
+			FBuffer.insert( FBuffer.end(), Src, Src + Size );
+		}
+		else
+		{
+			// the buffered data and the new block go out together
+			bool Result = WriteFully( FBuffer.empty() ? NULL : &FBuffer[0], FBuffer.size(), Buf, Size );
+
+			FBuffer.clear();
+
+			if ( !Result ) { return 0; }
+		}
+
+		FPosition += Size;
+
+		if ( FDurability == Durability_Periodic && FSyncPeriod )
+		{
+			FUnsyncedBytes += Size;
+
+			if ( FUnsyncedBytes >= FSyncPeriod ) { Sync(); }
+		}
+
+		return Size;
+	}
+
+private:
+	bool IsOpen() const
+	{
+#ifdef _WIN32
+		return FMapFile != INVALID_HANDLE_VALUE;
+#else
+		return FMapFile != -1;
+#endif
+	}
+
+	/// Write both blocks in full, retrying short and interrupted writes
+	bool WriteFully( const void* Buf1, uint64 Size1, const void* Buf2, uint64 Size2 )
+	{
+#ifdef _WIN32
+		const void* Bufs[]  = { Buf1, Buf2 };
+		uint64      Sizes[] = { Size1, Size2 };
+
+		for ( int i = 0; i != 2; i++ )
+		{
+			const ubyte* Ptr = reinterpret_cast<const ubyte*>( Bufs[i] );
+			uint64 Left = Sizes[i];
+
+			while ( Left )
+			{
+				DWORD Written = 0;
+				DWORD Chunk = ( DWORD )( Left > 0x40000000 ? 0x40000000 : Left );
+
+				if ( !WriteFile( FMapFile, Ptr, Chunk, &Written, NULL ) || !Written ) { FFailed = true; return false; }
+
+				Ptr  += Written;
+				Left -= Written;
+			}
+		}
+
+#else
+		struct iovec Vec[2];
+		int NumVec = 0;
+
+		if ( Size1 ) { Vec[NumVec].iov_base = const_cast<void*>( Buf1 ); Vec[NumVec].iov_len = static_cast<size_t>( Size1 ); NumVec++; }
+
+		if ( Size2 ) { Vec[NumVec].iov_base = const_cast<void*>( Buf2 ); Vec[NumVec].iov_len = static_cast<size_t>( Size2 ); NumVec++; }
+
+		struct iovec* V = Vec;
+
+		while ( NumVec )
+		{
+			ssize_t Written = writev( FMapFile, V, NumVec );
+
+			if ( Written < 0 )
+			{
+				if ( errno == EINTR ) { continue; }
+
+				FFailed = true;
+				return false;
+			}
+
+			// skip the fully written vectors and adjust the partially written one
+			while ( NumVec && static_cast<size_t>( Written ) >= V->iov_len )
+			{
+				Written -= V->iov_len;
+				V++;
+				NumVec--;
+			}
+
+			if ( NumVec )
+			{
+				V->iov_base = reinterpret_cast<ubyte*>( V->iov_base ) + Written;
+				V->iov_len -= Written;
+			}
+		}
+
+#endif
+		return true;
+	}
+
+	static bool RenameFile( const std::string& From, const std::string& To )
 	{
 #ifdef _WIN32
-		DWORD written;
-		WriteFile( FMapFile, Buf, DWORD( Size ), &written, NULL );
+		return MoveFileExA( From.c_str(), To.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
 #else
+		return rename( From.c_str(), To.c_str() ) == 0;
+#endif
+	}
+
+	static bool SyncParentFolder( const std::string& FileName )
+	{
+#ifdef _WIN32
+		// MOVEFILE_WRITE_THROUGH has already flushed the rename
+		return true;
+#else
+		size_t Slash = FileName.find_last_of( '/' );
 
-		if ( FMapFile != -1 ) { write( FMapFile, Buf, Size ); }
+		std::string Folder = ( Slash == std::string::npos ) ? "." : ( Slash ? FileName.substr( 0, Slash ) : "/" );
 
+		int Handle = open( Folder.c_str(), O_RDONLY );
+
+		if ( Handle == -1 ) { return false; }
+
+		bool Result = ( fsync( Handle ) == 0 );
+
+		close( Handle );
+
+		return Result;
 #endif
-		FPosition += Size;
-		return Size;
 	}
 
 private:
 	std::string FFileName;
+	/// The file actually being written, differs from FFileName in the atomic mode
+	std::string FTargetFileName;
+	uint64      FPosition;
+
+	std::vector<ubyte> FBuffer;
+	size_t      FBufferSize;
+
+	LDurability FDurability;
+	uint64      FSyncPeriod;
+	uint64      FUnsyncedBytes;
+	bool        FAtomicCommit;
+	bool        FFailed;
 #ifdef _WIN32
 	HANDLE FMapFile;
 #else
 	int    FMapFile;
 #endif
-	uint64    FPosition;
 };
 
 /// File writer for some dynamically-sized clBlob
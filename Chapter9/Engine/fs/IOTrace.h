@@ -0,0 +1,393 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include "iObject.h"
+#include "Mutex.h"
+#include "Trace.h"
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <limits>
+
+/// Number of the most recent per-file events kept by the trace (power of two)
+const size_t IOTRACE_RING_SIZE = 4096;
+
+/// Longer file names are truncated in the events, keeping the end
+const size_t IOTRACE_MAX_NAME = 96;
+
+enum LIOEventType
+{
+   IOEvent_Open         = 0,
+   IOEvent_CreateReader = 1,
+   IOEvent_LoadBlob     = 2,
+   IOEvent_Decompress   = 3,
+   IOEvent_NumTypes     = 4
+};
+
+enum LIOCounter
+{
+   /// Physical files opened
+   IOCounter_Opens              = 0,
+   /// Bytes of memory-mapped physical files
+   IOCounter_BytesMapped        = 1,
+   /// Bytes copied out of the mappings and blobs by the stream readers
+   IOCounter_BytesCopied        = 2,
+   /// Bytes produced by archive decompression
+   IOCounter_BytesDecompressed  = 3,
+   /// Total time spent in archive decompression, microseconds
+   IOCounter_DecompressTime     = 4,
+   /// Archive cache lookups
+   IOCounter_CacheHits          = 5,
+   IOCounter_CacheMisses        = 6,
+   /// FileExists() calls made to resolve the virtual names
+   IOCounter_MountProbes        = 7,
+   IOCounter_NumCounters        = 8
+};
+
+/// Monotonic time in microseconds, on the same clock as the profiler
+inline int64 IOTrace_GetMicroseconds()
+{
+	return Trace_GetNanoseconds() / 1000;
+}
+
+/// Single timed operation on a file
+struct sIOEvent
+{
+	/// Sequence number of the event, 0 for an empty slot, -Seq while the writer of Seq is filling it
+	volatile int64 FSeq;
+	int            FType;
+	uint64         FThread;
+	/// Microseconds
+	int64          FStart;
+	int64          FDuration;
+	int64          FBytes;
+	char           FName[ IOTRACE_MAX_NAME ];
+};
+
+/**
+   \brief File system instrumentation
+
+   Cumulative counters plus a lock-free ring of the recent per-file events. Writers never block each other: every event
+   takes a ticket and claims its slot with a CAS on the sequence number, readers copy a slot and check the sequence again. Everything is a no-op until SetEnabled( true ) is called.
+   While the profiler is capturing, the events also go into its capture, so the file operations show up next to the zones
+*/
+class clIOTrace
+{
+public:
+	clIOTrace(): FEnabled( false ), FNextEvent( 0 ) { Reset(); }
+
+	/// The event ring is allocated when the trace is enabled for the first time. Should not be called concurrently with the traced operations
+	void SetEnabled( bool Enabled )
+	{
+		if ( Enabled && FEvents.empty() )
+		{
+			FEvents.resize( IOTRACE_RING_SIZE );
+			Atomic::Barrier();
+		}
+
+		FEnabled = Enabled;
+	}
+
+	bool IsEnabled() const { return FEnabled; }
+
+	/// Forget all the events and counters
+	void Reset()
+	{
+		LMutex Lock( &FProbesMutex );
+
+		for ( int i = 0; i != IOCounter_NumCounters; i++ ) { FCounters[i] = 0; }
+
+		for ( size_t i = 0; i != FEvents.size(); i++ ) { FEvents[i].FSeq = 0; }
+
+		FProbes.clear();
+	}
+
+	void Count( LIOCounter Counter, int64 Value )
+	{
+		if ( FEnabled ) { Atomic::Add( &FCounters[ Counter ], Value ); }
+	}
+
+	int64 GetCounter( LIOCounter Counter ) const { return FCounters[ Counter ]; }
+
+	/// Count a FileExists() probe of the mount point
+	void CountProbe( const std::string& MountPointName )
+	{
+		if ( !FEnabled ) { return; }
+
+		Atomic::Add( &FCounters[ IOCounter_MountProbes ], 1 );
+
+		LMutex Lock( &FProbesMutex );
+
+		FProbes[ MountPointName ]++;
+	}
+
+	/// Number of probes per mount point name
+	std::map<std::string, int64> GetProbeCounts() const
+	{
+		LMutex Lock( &FProbesMutex );
+
+		return FProbes;
+	}
+
+	void AddEvent( LIOEventType Type, const std::string& Name, int64 Start, int64 Duration, int64 Bytes )
+	{
+		/// The cheap flag goes first, the profiler is asked only if the trace is off
+		if ( !FEnabled && !Profiler_Get().IsCapturing() ) { return; }
+
+		if ( Profiler_Get().IsCapturing() )
+		{
+			Profiler_Get().AddExternalEvent( GetEventTypeName( Type ), Name, Start * 1000, ( Start + Duration ) * 1000, Bytes );
+		}
+
+		if ( !FEnabled ) { return; }
+
+		if ( Type == IOEvent_Decompress ) { Atomic::Add( &FCounters[ IOCounter_DecompressTime ], Duration ); }
+
+		int64 Seq = Atomic::Add( &FNextEvent, 1 );
+
+		sIOEvent& E = FEvents[ static_cast<size_t>( Seq ) & ( IOTRACE_RING_SIZE - 1 ) ];
+
+		int64 Old = E.FSeq;
+
+		/// Readers skip the slot until it is complete. If a newer event or another writer holds the slot, this event is dropped
+		if ( Old < 0 || Old >= Seq || !Atomic::CompareAndSwap( &E.FSeq, Old, -Seq ) ) { return; }
+
+		E.FType     = Type;
+		E.FThread   = Trace_GetThreadID();
+		E.FStart    = Start;
+		E.FDuration = Duration;
+		E.FBytes    = Bytes;
+
+		size_t Len = std::min( Name.length(), IOTRACE_MAX_NAME - 1 );
+		memcpy( E.FName, Name.c_str() + Name.length() - Len, Len );
+		E.FName[ Len ] = 0;
+
+		Atomic::Barrier();
+		E.FSeq = Seq;
+	}
+
+	/// Copy the complete events, oldest first. Slots being overwritten concurrently are skipped
+	std::vector<sIOEvent> GetEvents() const
+	{
+		std::vector<sIOEvent> Result;
+
+		if ( FEvents.empty() ) { return Result; }
+
+		int64 Last = FNextEvent;
+		int64 First = ( Last > ( int64 )IOTRACE_RING_SIZE ) ? Last - ( int64 )IOTRACE_RING_SIZE + 1 : 1;
+
+		Result.reserve( static_cast<size_t>( Last - First + 1 ) );
+
+		for ( int64 Seq = First; Seq <= Last; Seq++ )
+		{
+			const sIOEvent& Slot = FEvents[ static_cast<size_t>( Seq ) & ( IOTRACE_RING_SIZE - 1 ) ];
+
+			int64 Before = Slot.FSeq;
+
+			/// The fields are not read before the sequence number
+			Atomic::Barrier();
+
+			if ( Before != Seq ) { continue; }
+
+			sIOEvent E = Slot;
+
+			/// The copy is complete before the sequence number is read again
+			Atomic::Barrier();
+
+			if ( Slot.FSeq != Seq ) { continue; }
+
+			E.FSeq = Seq;
+
+			Result.push_back( E );
+		}
+
+		return Result;
+	}
+
+	/// Save the events in the Chrome trace format (chrome://tracing), the counters go into "otherData"
+	bool SaveChromeTrace( const std::string& FileName ) const
+	{
+		std::vector<sIOEvent> Events = GetEvents();
+
+		int64 Origin = std::numeric_limits<int64>::max();
+
+		for ( size_t i = 0; i != Events.size(); i++ ) { Origin = std::min( Origin, Events[i].FStart * 1000 ); }
+
+		clChromeTraceWriter Writer;
+
+		if ( !Writer.Open( FileName, Origin ) ) { return false; }
+
+		for ( size_t i = 0; i != Events.size(); i++ )
+		{
+			const sIOEvent& E = Events[i];
+
+			char Args[64];
+			sprintf( Args, "\"bytes\":%lld", ( long long )E.FBytes );
+
+			Writer.AddEvent( E.FName, GetEventTypeName( E.FType ), E.FThread, E.FStart * 1000, ( E.FStart + E.FDuration ) * 1000, Args );
+		}
+
+		std::string OtherData;
+
+		char Value[64];
+
+		for ( int i = 0; i != IOCounter_NumCounters; i++ )
+		{
+			sprintf( Value, "%s\"%s\":%lld", i ? "," : "", GetCounterName( i ), ( long long )FCounters[i] );
+			OtherData += Value;
+		}
+
+		std::map<std::string, int64> Probes = GetProbeCounts();
+
+		for ( std::map<std::string, int64>::const_iterator i = Probes.begin(); i != Probes.end(); ++i )
+		{
+			sprintf( Value, "\":%lld", ( long long )i->second );
+			OtherData += ",\"probes " + Trace_EscapeJSON( i->first ) + Value;
+		}
+
+		return Writer.Close( OtherData );
+	}
+
+	/// Save per-file totals of the recorded events as CSV, the slowest files first
+	bool SaveSummaryCSV( const std::string& FileName ) const
+	{
+		FILE* F = fopen( FileName.c_str(), "wt" );
+
+		if ( !F ) { return false; }
+
+		struct sFileTotals
+		{
+			sFileTotals(): FTime( 0 ), FBytes( 0 ) { for ( int i = 0; i != IOEvent_NumTypes; i++ ) { FCount[i] = 0; } }
+
+			int64 FCount[ IOEvent_NumTypes ];
+			int64 FTime;
+			int64 FBytes;
+		};
+
+		std::map<std::string, sFileTotals> Totals;
+
+		std::vector<sIOEvent> Events = GetEvents();
+
+		for ( size_t i = 0; i != Events.size(); i++ )
+		{
+			sFileTotals& T = Totals[ Events[i].FName ];
+			T.FCount[ Events[i].FType ]++;
+			T.FTime  += Events[i].FDuration;
+			T.FBytes += Events[i].FBytes;
+		}
+
+		std::multimap<int64, std::string> ByTime;
+
+		for ( std::map<std::string, sFileTotals>::const_iterator i = Totals.begin(); i != Totals.end(); ++i ) { ByTime.insert( std::make_pair( -i->second.FTime, i->first ) ); }
+
+		fprintf( F, "file,opens,readers,blob_loads,decompressions,bytes,total_us\n" );
+
+		for ( std::multimap<int64, std::string>::const_iterator i = ByTime.begin(); i != ByTime.end(); ++i )
+		{
+			const sFileTotals& T = Totals[ i->second ];
+
+			fprintf( F, "\"%s\",%lld,%lld,%lld,%lld,%lld,%lld\n", i->second.c_str(),
+			         ( long long )T.FCount[ IOEvent_Open ], ( long long )T.FCount[ IOEvent_CreateReader ],
+			         ( long long )T.FCount[ IOEvent_LoadBlob ], ( long long )T.FCount[ IOEvent_Decompress ],
+			         ( long long )T.FBytes, ( long long )T.FTime );
+		}
+
+		return fclose( F ) == 0;
+	}
+
+	static const char* GetEventTypeName( int Type )
+	{
+		static const char* Names[ IOEvent_NumTypes ] = { "open", "create_reader", "load_blob", "decompress" };
+
+		return ( Type >= 0 && Type < IOEvent_NumTypes ) ? Names[ Type ] : "unknown";
+	}
+
+	static const char* GetCounterName( int Counter )
+	{
+		static const char* Names[ IOCounter_NumCounters ] = { "opens", "bytes_mapped", "bytes_copied", "bytes_decompressed", "decompress_us", "cache_hits", "cache_misses", "mount_probes" };
+
+		return ( Counter >= 0 && Counter < IOCounter_NumCounters ) ? Names[ Counter ] : "unknown";
+	}
+
+private:
+	volatile bool  FEnabled;
+	volatile int64 FCounters[ IOCounter_NumCounters ];
+	/// Sequence number of the last event
+	volatile int64 FNextEvent;
+	std::vector<sIOEvent> FEvents;
+
+	std::map<std::string, int64> FProbes;
+	clMutex        FProbesMutex;
+};
+
+/// The file system trace shared by all the engine subsystems
+inline clIOTrace& IOTrace_Get()
+{
+	static clIOTrace Trace;
+	return Trace;
+}
+
+/// Times the enclosed file operation and records it in the trace
+class LIOTraceScope
+{
+public:
+	LIOTraceScope( LIOEventType Type, const std::string& Name ): FType( Type ), FStart( -1 ), FBytes( 0 )
+	{
+		if ( !IOTrace_Get().IsEnabled() && !Profiler_Get().IsCapturing() ) { return; }
+
+		FName = Name;
+		FStart = IOTrace_GetMicroseconds();
+	}
+
+	~LIOTraceScope()
+	{
+		if ( FStart >= 0 ) { IOTrace_Get().AddEvent( FType, FName, FStart, IOTrace_GetMicroseconds() - FStart, FBytes ); }
+	}
+
+	void SetBytes( int64 Bytes ) { FBytes = Bytes; }
+
+private:
+	LIOEventType FType;
+	std::string  FName;
+	int64        FStart;
+	int64        FBytes;
+};
@@ -34,12 +34,18 @@
 
 #pragma once
 
-#include "Engine.h"
 #include "Files.h"
 #include "Archive.h"
+#include "Bundle.h"
 #include <sys/stat.h>
 
+#include <string>
 #include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+/// Declared here instead of including Engine.h, so the archive code builds without the platform wrappers (see Engine.cpp)
+void Str_AddTrailingChar( std::string* Str, char Ch );
 
 #if defined( _WIN32 )
 const char PATH_SEPARATOR = '\\';
@@ -47,6 +53,9 @@ const char PATH_SEPARATOR = '\\';
 const char PATH_SEPARATOR = '/';
 #endif // OS_WINDOWS
 
+/// Name prefix of the whiteout files: "dir/.wh.name" in an overlay layer deletes "dir/name" (and everything under it) from the layers below
+const char OVERLAY_WHITEOUT_PREFIX[] = ".wh.";
+
 inline std::string Arch_FixFileName( const std::string& VName )
 {
 	std::string s( VName );
@@ -66,8 +75,21 @@ public:
 	virtual bool         FileExists( const std::string& VirtualName ) const = 0;
 	/// Convert local file VirtualName to global name
 	virtual std::string      MapName( const std::string& VirtualName ) const = 0;
-	/// Create appropriate file reader for the specified VirtualName
-	virtual clPtr<iRawFile>  CreateReader( const std::string& VirtualName ) const = 0;
+	/// Create appropriate file reader for the specified VirtualName. Hint describes how the data is going to be accessed
+	virtual clPtr<iRawFile>  CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const = 0;
+	/// Create a sequential stream for the specified VirtualName. Mount points which can decode the data on demand should override this
+	virtual clPtr<iIStream>  CreateStream( const std::string& VirtualName ) const
+	{
+		clPtr<iRawFile> File = CreateReader( VirtualName, AccessHint_Sequential );
+
+		if ( !File ) { return NULL; }
+
+		FileMapper* Stream = new FileMapper( File );
+		Stream->SetReleaseBehind( true );
+		return Stream;
+	}
+	/// List all the files of this mount point. Returns false if the mount point can not enumerate its contents cheaply
+	virtual bool             EnumerateFiles( std::vector<std::string>* /*Names*/ ) const { return false; }
 
 	/// Set internal mount point name
 	virtual void    SetName( const std::string& N ) { FName = N; }
@@ -112,6 +134,19 @@ inline bool FS_FileExistsPhys( const std::string& PhysicalName )
 	return Result == 0;
 }
 
+/// Get the modification time of the physical file, 0 if the file does not exist
+inline uint64 FS_GetFileTime( const std::string& PhysicalName )
+{
+#ifdef _WIN32
+	struct _stat buf;
+	int Result = _stat( FS_ValidatePath( PhysicalName ).c_str(), &buf );
+#else
+	struct stat buf;
+	int Result = stat( FS_ValidatePath( PhysicalName ).c_str(), &buf );
+#endif
+	return ( Result == 0 ) ? static_cast<uint64>( buf.st_mtime ) : 0;
+}
+
 /// Mount point implementation for the physical folder
 class PhysicalMountPoint: public iMountPoint
 {
@@ -131,12 +166,12 @@ public:
 		return ( !FUseVirtualFileNames || FS_IsFullPath( VirtualName ) ) ? VirtualName : ( FPhysicalName + VirtualName );
 	}
 
-	virtual clPtr<iRawFile>    CreateReader( const std::string& VirtualName ) const
+	virtual clPtr<iRawFile>    CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const
 	{
 		std::string PhysName = FS_IsFullPath( VirtualName ) ? VirtualName : MapName( VirtualName );
 
 		clPtr<RawFile> File = new RawFile();
-		return !File->Open( FS_ValidatePath( PhysName ), VirtualName ) ? NULL : File;
+		return !File->Open( FS_ValidatePath( PhysName ), VirtualName, Hint ) ? NULL : File;
 	}
 private:
 	std::string FPhysicalName;
@@ -162,7 +197,21 @@ public:
 
 	virtual bool            FileExists( const std::string& VirtualName ) const { return FMP->FileExists( FAlias + VirtualName ); }
 	virtual std::string     MapName( const std::string& VirtualName ) const { return FMP->MapName( FAlias + VirtualName ); }
-	virtual clPtr<iRawFile> CreateReader( const std::string& VirtualName ) const { return FMP->CreateReader( FAlias + VirtualName ); }
+	virtual clPtr<iRawFile> CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const { return FMP->CreateReader( FAlias + VirtualName, Hint ); }
+	virtual clPtr<iIStream> CreateStream( const std::string& VirtualName ) const { return FMP->CreateStream( FAlias + VirtualName ); }
+	virtual bool            EnumerateFiles( std::vector<std::string>* Names ) const
+	{
+		std::vector<std::string> All;
+
+		if ( !FMP->EnumerateFiles( &All ) ) { return false; }
+
+		for ( size_t i = 0; i != All.size(); i++ )
+		{
+			if ( All[i].compare( 0, FAlias.length(), FAlias ) == 0 ) { Names->push_back( All[i].substr( FAlias.length() ) ); }
+		}
+
+		return true;
+	}
 private:
 	/// Name to append to each file in this mount point
 	std::string FAlias;
@@ -178,24 +227,338 @@ public:
 	ArchiveMountPoint( const clPtr<ArchiveReader>& R ): FReader( R ) {}
 	virtual ~ArchiveMountPoint() {}
 
-	virtual clPtr<iRawFile>    CreateReader( const std::string& VirtualName ) const
+	virtual clPtr<iRawFile>    CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const
 	{
 		std::string FName = Arch_FixFileName( VirtualName );
 
-		MemRawFile* File = new MemRawFile();
+		/// Stored entries are served straight from the archive's memory map: no decompression, no copy
+		if ( FReader->IsFileStored( FName ) )
+		{
+			SubRawFile* View = new SubRawFile( FReader->GetSourceFile(), FReader->GetFileOffset( FName ), FReader->GetFileSize( FName ) );
+
+			View->SetFileName( VirtualName );
+			View->SetVirtualFileName( VirtualName );
+
+			if ( Hint != AccessHint_Normal ) { View->AdviseAccess( Hint ); }
+
+			return View;
+		}
+
+		/// The blob pins the cached entry while the file is in use
+		ManagedMemRawFile* File = new ManagedMemRawFile();
 
 		File->SetFileName( VirtualName );
 		File->SetVirtualFileName( VirtualName );
 
-		const void* DataPtr = FReader->GetFileData( FName );
-		uint64 FileSize = FReader->GetFileSize( FName );
+		clPtr<clBlob> Data = FReader->GetFileData( FName );
+
+		File->SetBlob( Data ? Data : new clBlob() );
 
-		File->CreateFromManagedBuffer( DataPtr, FileSize );
 		return File;
 	}
 
+	/// Deflated entries are inflated as the stream is read instead of being extracted into the cache
+	virtual clPtr<iIStream>    CreateStream( const std::string& VirtualName ) const
+	{
+		return FReader->OpenFileStream( Arch_FixFileName( VirtualName ) );
+	}
+
 	virtual bool FileExists( const std::string& VirtualName ) const { return FReader->FileExists( Arch_FixFileName( VirtualName ) ); }
 	virtual std::string      MapName( const std::string& VirtualName ) const { return VirtualName; }
+	virtual bool             EnumerateFiles( std::vector<std::string>* Names ) const
+	{
+		Names->reserve( Names->size() + FReader->GetNumFiles() );
+
+		for ( size_t i = 0; i != FReader->GetNumFiles(); i++ ) { Names->push_back( FReader->GetFileName( ( int )i ) ); }
+
+		return true;
+	}
 private:
 	clPtr<ArchiveReader> FReader;
 };
+
+/// Mount point for the engine-native bundles
+class BundleMountPoint: public iMountPoint
+{
+public:
+	BundleMountPoint( const clPtr<clBundleReader>& R ): FReader( R ) {}
+	virtual ~BundleMountPoint() {}
+
+	virtual clPtr<iRawFile>    CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const
+	{
+		/// Uncompressed entries are aligned and used in-place, compressed ones are decoded into a blob
+		if ( FReader->IsFileStored( VirtualName ) )
+		{
+			SubRawFile* View = new SubRawFile( FReader->GetSourceFile(), FReader->GetFileOffset( VirtualName ), FReader->GetFileSize( VirtualName ) );
+
+			View->SetFileName( VirtualName );
+			View->SetVirtualFileName( VirtualName );
+
+			if ( Hint != AccessHint_Normal ) { View->AdviseAccess( Hint ); }
+
+			return View;
+		}
+
+		ManagedMemRawFile* File = new ManagedMemRawFile();
+
+		File->SetFileName( VirtualName );
+		File->SetVirtualFileName( VirtualName );
+
+		clPtr<clBlob> Data = FReader->GetFileData( VirtualName );
+
+		File->SetBlob( Data ? Data : new clBlob() );
+
+		return File;
+	}
+
+	virtual bool FileExists( const std::string& VirtualName ) const { return FReader->FileExists( VirtualName ); }
+	virtual std::string      MapName( const std::string& VirtualName ) const { return VirtualName; }
+	virtual bool             EnumerateFiles( std::vector<std::string>* Names ) const
+	{
+		Names->reserve( Names->size() + FReader->GetNumFiles() );
+
+		for ( size_t i = 0; i != FReader->GetNumFiles(); i++ ) { Names->push_back( FReader->GetFileName( ( int )i ) ); }
+
+		return true;
+	}
+private:
+	clPtr<clBundleReader> FReader;
+};
+
+/**
+   \brief Layered mount point: upper layers (patches, DLC) shadow and delete the files of the lower ones
+
+   The file lists of the layers are merged into a single table when the layers are added, so a lookup is a single hash probe
+   regardless of the number of layers. Layers which can not enumerate their files are probed at lookup time
+*/
+class OverlayMountPoint: public iMountPoint
+{
+public:
+	OverlayMountPoint(): FHasTombstones( false ) {}
+	virtual ~OverlayMountPoint() {}
+
+	/**
+	   \brief Put the layer on top of the existing ones
+
+	   Only the files of the new layer are merged into the table. Names whose resolution could have changed are appended to Changed (if not NULL).
+	   Returns false if Changed is incomplete: the layer can not list its files or it deletes folders which might exist in the probed layers
+	*/
+	bool AddLayer( const clPtr<iMountPoint>& Layer, std::vector<std::string>* Changed = NULL )
+	{
+		if ( !Layer ) { return true; }
+
+		LMutex Lock( &FMutex );
+
+		int LayerIdx = ( int )FLayers.size();
+
+		FLayers.push_back( Layer );
+
+		std::vector<std::string> Names;
+
+		if ( !Layer->EnumerateFiles( &Names ) )
+		{
+			FProbedLayers.push_back( LayerIdx );
+			return false;
+		}
+
+		bool Complete = true;
+
+		/// Whiteouts go first, so a layer can delete a lower file and provide a new one below the same folder
+		for ( size_t i = 0; i != Names.size(); i++ )
+		{
+			std::string Target;
+
+			if ( IsWhiteout( Names[i], &Target ) && !Delete( Target, LayerIdx, Changed ) ) { Complete = false; }
+		}
+
+		sEntry Entry;
+		Entry.FLayer = LayerIdx;
+		Entry.FDeleted = false;
+
+		for ( size_t i = 0; i != Names.size(); i++ )
+		{
+			if ( IsWhiteout( Names[i], NULL ) ) { continue; }
+
+			FTable[ Names[i] ] = Entry;
+
+			AddFolders( Names[i] );
+
+			if ( Changed ) { Changed->push_back( Names[i] ); }
+		}
+
+		return Complete;
+	}
+
+	/// Delete the file (and everything under it if it is a folder) from all the current layers. Returns false if Changed is incomplete, see AddLayer()
+	bool RemoveFile( const std::string& VirtualName, std::vector<std::string>* Changed = NULL )
+	{
+		LMutex Lock( &FMutex );
+
+		/// The tombstone is above the topmost layer, so it hides the files of that layer too
+		return Delete( VirtualName, ( int )FLayers.size(), Changed );
+	}
+
+	size_t GetNumLayers() const { return FLayers.size(); }
+
+	virtual bool FileExists( const std::string& VirtualName ) const { return FindLayer( VirtualName ) != NULL; }
+
+	virtual std::string MapName( const std::string& VirtualName ) const
+	{
+		clPtr<iMountPoint> Layer = FindLayer( VirtualName );
+		return Layer ? Layer->MapName( VirtualName ) : VirtualName;
+	}
+
+	virtual clPtr<iRawFile> CreateReader( const std::string& VirtualName, LAccessHint Hint = AccessHint_Normal ) const
+	{
+		clPtr<iMountPoint> Layer = FindLayer( VirtualName );
+		return Layer ? Layer->CreateReader( VirtualName, Hint ) : NULL;
+	}
+
+	virtual clPtr<iIStream> CreateStream( const std::string& VirtualName ) const
+	{
+		clPtr<iMountPoint> Layer = FindLayer( VirtualName );
+		return Layer ? Layer->CreateStream( VirtualName ) : NULL;
+	}
+
+	/// Only the files which are visible through the overlay are listed
+	virtual bool EnumerateFiles( std::vector<std::string>* Names ) const
+	{
+		LMutex Lock( &FMutex );
+
+		if ( !FProbedLayers.empty() ) { return false; }
+
+		for ( std::unordered_map<std::string, sEntry>::const_iterator i = FTable.begin(); i != FTable.end(); ++i )
+		{
+			if ( !i->second.FDeleted ) { Names->push_back( i->first ); }
+		}
+
+		return true;
+	}
+
+private:
+	/// Check if the name is a whiteout and get the name of the deleted file
+	static bool IsWhiteout( const std::string& Name, std::string* Target )
+	{
+		size_t Slash = Name.find_last_of( "/\\" );
+		size_t Base = ( Slash == std::string::npos ) ? 0 : Slash + 1;
+
+		if ( Name.compare( Base, sizeof( OVERLAY_WHITEOUT_PREFIX ) - 1, OVERLAY_WHITEOUT_PREFIX ) != 0 ) { return false; }
+
+		if ( Target ) { *Target = Name.substr( 0, Base ) + Name.substr( Base + sizeof( OVERLAY_WHITEOUT_PREFIX ) - 1 ); }
+
+		return true;
+	}
+
+	/// Remember the folders containing the file. FMutex should be locked
+	void AddFolders( const std::string& Name )
+	{
+		for ( size_t Slash = Name.find_last_of( "/\\" ); Slash != std::string::npos && Slash > 0; Slash = Name.find_last_of( "/\\", Slash - 1 ) )
+		{
+			/// The parent folders of a known folder are known too
+			if ( !FFolders.insert( Name.substr( 0, Slash ) ).second ) { break; }
+		}
+	}
+
+	/**
+	   \brief Put a tombstone for Name at Layer (hiding the files of the layers below) and drop the files under it. FMutex should be locked
+
+	   Returns false if the files of the probed layers could be affected, they are not listed in Changed
+	*/
+	bool Delete( const std::string& Name, int Layer, std::vector<std::string>* Changed )
+	{
+		sEntry Tombstone;
+		Tombstone.FLayer = Layer;
+		Tombstone.FDeleted = true;
+
+		FTable[ Name ] = Tombstone;
+		FHasTombstones = true;
+
+		if ( Changed ) { Changed->push_back( Name ); }
+
+		/// The name could be a folder of a probed layer. FindLayer() checks the tombstones of the parent folders for such files
+		bool Complete = FProbedLayers.empty();
+
+		/// Only the folders of the enumerable layers are worth a scan, and folder deletions are rare
+		if ( FFolders.find( Name ) == FFolders.end() ) { return Complete; }
+
+		for ( std::unordered_map<std::string, sEntry>::iterator i = FTable.begin(); i != FTable.end(); ++i )
+		{
+			if ( i->first.length() > Name.length() &&
+			     ( i->first[ Name.length() ] == '/' || i->first[ Name.length() ] == '\\' ) &&
+			     i->first.compare( 0, Name.length(), Name ) == 0 && !i->second.FDeleted )
+			{
+				i->second = Tombstone;
+
+				if ( Changed ) { Changed->push_back( i->first ); }
+			}
+		}
+
+		return Complete;
+	}
+
+	/// The topmost layer which has deleted one of the folders containing the file, -1 if there is none. FMutex should be locked
+	int GetFolderTombstone( const std::string& Name ) const
+	{
+		int Result = -1;
+
+		for ( size_t Slash = Name.find_last_of( "/\\" ); Slash != std::string::npos && Slash > 0; Slash = Name.find_last_of( "/\\", Slash - 1 ) )
+		{
+			std::unordered_map<std::string, sEntry>::const_iterator i = FTable.find( Name.substr( 0, Slash ) );
+
+			if ( i != FTable.end() && i->second.FDeleted && i->second.FLayer > Result ) { Result = i->second.FLayer; }
+		}
+
+		return Result;
+	}
+
+	/// Get the topmost layer containing the file, NULL if there is no such file or it has been deleted
+	clPtr<iMountPoint> FindLayer( const std::string& VirtualName ) const
+	{
+		LMutex Lock( &FMutex );
+
+		std::unordered_map<std::string, sEntry>::const_iterator i = FTable.find( VirtualName );
+
+		int  Resolved = ( i != FTable.end() ) ? i->second.FLayer : -1;
+		bool Deleted  = ( i != FTable.end() ) && i->second.FDeleted;
+
+		/// A folder deleted above the file hides it, the file might come from a probed layer and have no entry at all
+		int FolderTombstone = FHasTombstones ? GetFolderTombstone( VirtualName ) : -1;
+
+		if ( FolderTombstone > Resolved )
+		{
+			Resolved = FolderTombstone;
+			Deleted = true;
+		}
+
+		/// The layers which could not list their files still take precedence if they are above the resolved one
+		for ( size_t j = FProbedLayers.size(); j-- > 0; )
+		{
+			int Layer = FProbedLayers[j];
+
+			if ( Layer <= Resolved ) { break; }
+
+			if ( FLayers[ Layer ]->FileExists( VirtualName ) ) { return FLayers[ Layer ]; }
+		}
+
+		return ( Resolved < 0 || Deleted ) ? NULL : FLayers[ Resolved ];
+	}
+
+	struct sEntry
+	{
+		/// Topmost layer which has this file or the tombstone. A tombstone of RemoveFile() is one above the topmost layer
+		int  FLayer;
+		bool FDeleted;
+	};
+
+	/// Bottom layer goes first
+	std::vector< clPtr<iMountPoint> > FLayers;
+	/// Layers which can not enumerate their files, in ascending order
+	std::vector<int> FProbedLayers;
+	/// Merged directory of all the enumerable layers
+	std::unordered_map<std::string, sEntry> FTable;
+	/// Folders of the enumerable layers, only these are scanned on deletion
+	std::unordered_set<std::string> FFolders;
+	/// Skip the parent folder checks until something is deleted
+	bool FHasTombstones;
+	clMutex FMutex;
+};
@@ -37,6 +37,16 @@
 #include "iObject.h"
 #include <string>
 
+/// Expected access pattern of the file data, passed down to madvise()/posix_fadvise()
+enum LAccessHint
+{
+   AccessHint_Normal     = 0,
+   AccessHint_Sequential = 1,
+   AccessHint_Random     = 2,
+   AccessHint_WillNeed   = 3,
+   AccessHint_DontNeed   = 4
+};
+
 /// Input stream
 class iIStream: public iObject
 {
@@ -58,6 +68,11 @@ public:
 	virtual const ubyte*  MapStreamFromCurrentPos() const = 0;
 
 	virtual std::string ReadLine() = 0;
+
+	/// Advise the kernel about the access pattern of the given range (the whole stream if Size is 0). Only mapped files support this
+	virtual bool AdviseAccess( LAccessHint /*Hint*/, uint64 /*Offset*/ = 0, uint64 /*Size*/ = 0 ) { return false; }
+	/// Let the kernel drop the pages of the range which have already been consumed
+	virtual void ReleaseRange( uint64 /*Offset*/, uint64 /*Size*/ ) {}
 };
 
 /// Output stream
@@ -39,6 +39,9 @@
 #include "iIntrusivePtr.h"
 #include "VecMath.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 enum LBitmapFormat
 {
    L_BITMAP_INVALID_FORMAT = -1,
@@ -53,8 +53,8 @@ const int L_VS_TOTAL_ATTRIBS = L_VS_COLORS + 1;
 /// number of float components in every stream
 const int L_VS_VEC_COMPONENTS[ L_VS_TOTAL_ATTRIBS ] = { 3, 2, 3, 4 };
 
-/// Container for vertex attribs (think about it like a mesh without internal hierarchy)
-class clVertexAttribs: public iObject
+/// Container for vertex attribs (think about it like a mesh without internal hierarchy), used by the rendering thread only
+class clVertexAttribs: public iSingleThreadObject
 {
 public:
 	clVertexAttribs();
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ProfilerOverlay.h"
+#include "Canvas.h"
+#include "Bitmap.h"
+#include "GLClasses.h"
+#include "TextRenderer.h"
+#include "Profiler.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+/// Frames between the updates of the zone list
+const size_t PROFILER_OVERLAY_TEXT_INTERVAL = 30;
+
+/// Frame time at the top of the graph, milliseconds
+const float PROFILER_OVERLAY_GRAPH_SCALE = 50.0f;
+
+const float PROFILER_OVERLAY_BUDGET_60 = 1000.0f / 60.0f;
+const float PROFILER_OVERLAY_BUDGET_30 = 1000.0f / 30.0f;
+
+clProfilerOverlay::clProfilerOverlay( const clPtr<clTextRenderer>& TR, int FontID )
+	: FTextRenderer( TR )
+	, FFontID( FontID )
+	, FMaxZones( 8 )
+	, FFramesSinceUpdate( PROFILER_OVERLAY_TEXT_INTERVAL )
+{
+}
+
+void clProfilerOverlay::UpdateText()
+{
+	std::vector<sProfilerZoneStats> Zones;
+	Profiler_Get().GetZoneStats( &Zones );
+
+	std::vector<std::string> Text;
+
+	for ( size_t i = 0; i != Zones.size() && i != FMaxZones; i++ )
+	{
+		char Buf[256];
+		snprintf( Buf, sizeof( Buf ), "%s: %.2f ms, %d calls, max %.2f ms", Zones[i].FName, Zones[i].FAverageTime, ( int )Zones[i].FCalls, Zones[i].FMaxTime );
+		Text.push_back( Buf );
+	}
+
+	FLines.clear();
+	FLineWidths.clear();
+
+	int MaxWidth = 1;
+
+	std::vector< clPtr<clBitmap> > Bitmaps;
+
+	for ( size_t i = 0; i != Text.size(); i++ )
+	{
+		clPtr<clBitmap> B = FTextRenderer->RenderTextWithFont( Text[i], FFontID, 16, 0xFFFFFFFF, true );
+
+		Bitmaps.push_back( B );
+		MaxWidth = std::max( MaxWidth, B ? B->GetWidth() : 0 );
+	}
+
+	for ( size_t i = 0; i != Bitmaps.size(); i++ )
+	{
+		if ( !Bitmaps[i] ) { continue; }
+
+		clPtr<clGLTexture> Texture = new clGLTexture();
+		Texture->LoadFromBitmap( Bitmaps[i] );
+
+		FLines.push_back( Texture );
+		FLineWidths.push_back( static_cast<float>( Bitmaps[i]->GetWidth() ) / static_cast<float>( MaxWidth ) );
+	}
+}
+
+void clProfilerOverlay::Render( const clPtr<clCanvas>& Canvas, float X1, float Y1, float X2, float Y2 )
+{
+	if ( ++FFramesSinceUpdate >= PROFILER_OVERLAY_TEXT_INTERVAL )
+	{
+		FFramesSinceUpdate = 0;
+		UpdateText();
+	}
+
+	Canvas->Rect2D( X1, Y1, X2, Y2, LVector4( 0.0f, 0.0f, 0.0f, 0.6f ) );
+
+	// the upper half is the frame time graph, the lower one is the zone list
+	float GraphBottom = Y1 + ( Y2 - Y1 ) * 0.5f;
+	float GraphHeight = GraphBottom - Y1;
+
+	std::vector<float> Times;
+	Profiler_Get().GetFrameTimes( &Times );
+
+	float BarWidth = ( X2 - X1 ) / static_cast<float>( PROFILER_FRAME_HISTORY );
+
+	for ( size_t i = 0; i != Times.size(); i++ )
+	{
+		float H = GraphHeight * std::min( Times[i] / PROFILER_OVERLAY_GRAPH_SCALE, 1.0f );
+
+		LVector4 Color = ( Times[i] <= PROFILER_OVERLAY_BUDGET_60 ) ? LVector4( 0.0f, 1.0f, 0.0f, 1.0f ) :
+		                 ( Times[i] <= PROFILER_OVERLAY_BUDGET_30 ) ? LVector4( 1.0f, 1.0f, 0.0f, 1.0f ) : LVector4( 1.0f, 0.0f, 0.0f, 1.0f );
+
+		float X = X1 + BarWidth * static_cast<float>( PROFILER_FRAME_HISTORY - Times.size() + i );
+
+		Canvas->Rect2D( X, GraphBottom - H, X + BarWidth, GraphBottom, Color );
+	}
+
+	// 60 FPS budget line
+	float BudgetY = GraphBottom - GraphHeight * PROFILER_OVERLAY_BUDGET_60 / PROFILER_OVERLAY_GRAPH_SCALE;
+
+	Canvas->Rect2D( X1, BudgetY, X2, BudgetY + 0.002f, LVector4( 1.0f, 1.0f, 1.0f, 0.5f ) );
+
+	if ( FLines.empty() ) { return; }
+
+	float LineHeight = ( Y2 - GraphBottom ) / static_cast<float>( FMaxZones );
+
+	for ( size_t i = 0; i != FLines.size(); i++ )
+	{
+		float Y = GraphBottom + LineHeight * static_cast<float>( i );
+
+		Canvas->TexturedRect2D( X1, Y, X1 + ( X2 - X1 ) * FLineWidths[i], Y + LineHeight, LVector4( 1.0f ), FLines[i] );
+	}
+}
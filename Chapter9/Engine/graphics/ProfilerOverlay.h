@@ -32,17 +32,43 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#pragma once
+
 #include "iObject.h"
+#include "iIntrusivePtr.h"
+
+#include <vector>
+#include <string>
+
+class clCanvas;
+class clGLTexture;
+class clTextRenderer;
 
-namespace LPtr
+/**
+   \brief Frame time graph and the most expensive profiler zones drawn over the scene
+
+   The text is re-rendered only every few frames, since every text texture costs a glFinish()
+*/
+class clProfilerOverlay: public iObject
 {
-	void IncRef( void* Obj )
-	{
-		if ( Obj ) { reinterpret_cast<iObject*>( Obj )->IncRefCount(); }
-	}
-
-	void DecRef( void* Obj )
-	{
-		if ( Obj ) { reinterpret_cast<iObject*>( Obj )->DecRefCount(); }
-	}
+public:
+	clProfilerOverlay( const clPtr<clTextRenderer>& TR, int FontID );
+
+	/// Draw into the rectangle given in normalized screen coordinates
+	void Render( const clPtr<clCanvas>& Canvas, float X1, float Y1, float X2, float Y2 );
+
+	void SetMaxZones( size_t MaxZones ) { FMaxZones = MaxZones; }
+
+private:
+	void UpdateText();
+
+private:
+	clPtr<clTextRenderer> FTextRenderer;
+	int    FFontID;
+	size_t FMaxZones;
+	size_t FFramesSinceUpdate;
+
+	/// One texture per line and the width of the line relative to the widest one
+	std::vector< clPtr<clGLTexture> > FLines;
+	std::vector<float> FLineWidths;
 };
@@ -168,18 +168,14 @@ void clTextRenderer::StopFreeType()
 {
 	FreeString();
 
-	// deallocate font handles and release font buffers
-	for ( std::map<std::string, void*>::iterator p = FAllocatedFonts.begin(); p != FAllocatedFonts.end() ; p++ )
-	{
-		// ? FT_FreeFace (FFontFaceHandles[p->first]);
-		delete[] ( char* )( p->second );
-	}
-
 	FFontFaces.clear();
 
 	if ( FManager ) { FTC_Manager_DonePTR( FManager ); }
 
 	if ( FLibrary ) { FT_Done_FreeTypePTR( FLibrary ); }
+
+	// release font buffers after the faces which refer to them are gone
+	FAllocatedFonts.clear();
 }
 
 #pragma endregion
@@ -191,22 +187,21 @@ FT_Error clTextRenderer::LoadFontFile( const std::string& FileName )
 
 	if ( FAllocatedFonts.count( FileName ) > 0 ) { return 0; }
 
-	clPtr<clBlob> DataBlob = g_FS->LoadFileAsBlob( FileName );
-	int DataSize = DataBlob->GetSize();
+	// FreeType reads the font directly from the file mapping
+	clPtr<clBlob> DataBlob = g_FS->LoadFileAsBlob( FileName, AccessHint_Random );
 
-	char* Data = new char[DataSize];
-	memcpy( Data, DataBlob->GetData(), DataSize );
+	if ( !DataBlob ) { return -1; }
 
 	FT_Face TheFace;
 
 	// 0 is the face index
-	FT_Error Result = FT_New_Memory_FacePTR( FLibrary, ( FT_Byte* )Data, ( FT_Long )DataSize, 0, &TheFace );
+	FT_Error Result = FT_New_Memory_FacePTR( FLibrary, ( const FT_Byte* )DataBlob->GetDataConst(), ( FT_Long )DataBlob->GetSize(), 0, &TheFace );
 
 	if ( Result == 0 )
 	{
 		FFontFaceHandles[FileName] = TheFace;
 
-		FAllocatedFonts[FileName] = ( void* )Data;
+		FAllocatedFonts[FileName] = DataBlob;
 
 		FFontFaces.push_back( FileName );
 	}
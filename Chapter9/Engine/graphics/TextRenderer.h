@@ -39,6 +39,7 @@
 #include "iObject.h"
 
 class clBitmap;
+class clBlob;
 
 #include <map>
 #include <cstring>
@@ -100,7 +101,7 @@ private:
 	FTC_CMapCache FCMapCache;
 
 	/// List of buffers with loaded font files. Map is used to prevent multiple file reads
-	std::map<std::string, void*> FAllocatedFonts;
+	std::map<std::string, clPtr<clBlob> > FAllocatedFonts;
 
 	/// List of initialized font face handles
 	std::map<std::string, FT_Face> FFontFaceHandles;
@@ -57,6 +57,7 @@ public:
 
 class clDownloadTask: public iTask
 {
+	L_POOLED_OBJECT( clDownloadTask )
 public:
 	// URL - URL of the resource to download
 	// TaskID - unique task ID
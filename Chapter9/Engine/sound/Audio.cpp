@@ -33,6 +33,7 @@
  */
 
 #include "Audio.h"
+#include "Profiler.h"
 
 extern clAudioThread g_Audio;
 
@@ -135,6 +136,23 @@ void clAudioSource::Play()
 	}
 
 	alSourcePlay( FSourceID );
+
+	// the audio thread might be sleeping without a deadline, it has to refill the stream buffers from now on
+	if ( FWaveDataProvider->IsStreaming() ) { g_Audio.WakeUp(); }
+}
+
+float clAudioSource::GetUpdateInterval() const
+{
+	if ( !FWaveDataProvider || !FWaveDataProvider->IsStreaming() ) { return -1.0f; }
+
+	if ( !IsPlaying() ) { return -1.0f; }
+
+	int BytesPerSecond = FWaveDataProvider->FSamplesPerSec * FWaveDataProvider->FChannels * ( FWaveDataProvider->FBitsPerSample >> 3 );
+
+	if ( BytesPerSecond <= 0 ) { return -1.0f; }
+
+	// one of the two buffers is being played, a processed buffer is refilled before the other one runs out
+	return 0.5f * static_cast<float>( BUFFER_SIZE ) / static_cast<float>( BytesPerSecond );
 }
 
 void clAudioSource::BindWaveform( clPtr<iWaveDataProvider> Wave )
@@ -185,7 +203,12 @@ void clAudioThread::UnRegisterSource( clAudioSource* Src )
 
 void clAudioThread::Run()
 {
-	if ( !LoadAL() ) { return; }
+	if ( !LoadAL() )
+	{
+		// there will be no sound, but do not leave Wait() hanging
+		FInitialized.Signal();
+		return;
+	}
 
 	// We should use actual device name if the default does not work
 	FDevice = alcOpenDevice( NULL );
@@ -194,28 +217,39 @@ void clAudioThread::Run()
 
 	alcMakeContextCurrent( FContext );
 
-	FInitialized = true;
+	FInitialized.Signal();
 
 	FPendingExit = false;
 
+	Profiler_Get().SetThreadName( "Audio" );
+
 	double Seconds = GetSeconds();
 
 	while ( !IsPendingExit() )
 	{
 		float DeltaSeconds = static_cast<float>( GetSeconds() - Seconds );
 
+		float Interval = -1.0f;
+
 		{
+			L_PROFILE_ZONE( "clAudioThread::Update" );
+
 			LMutex Lock( &FMutex );
 
 			for ( auto i = FActiveSources.begin(); i != FActiveSources.end(); i++ )
 			{
 				( *i )->Update( DeltaSeconds );
+
+				float SourceInterval = ( *i )->GetUpdateInterval();
+
+				if ( SourceInterval >= 0.0f && ( Interval < 0.0f || SourceInterval < Interval ) ) { Interval = SourceInterval; }
 			}
 		}
 
 		Seconds = GetSeconds();
 
-		Env_Sleep( 100 );
+		// sleep until the next stream buffer is due, a stream is started or Exit() is called
+		FWakeUp.Wait( ( Interval < 0.0f ) ? SYNC_INFINITE : static_cast<int>( Interval * 1000.0f ) );
 	}
 
 	alcDestroyContext( FContext );
@@ -224,7 +258,7 @@ void clAudioThread::Run()
 	UnloadAL();
 }
 
-void clAudioThread::Wait() const volatile
+void clAudioThread::Wait()
 {
-	while ( !FInitialized ) {};
+	FInitialized.Wait();
 }
@@ -39,6 +39,7 @@
 #include "LAL.h"
 #include "Thread.h"
 #include "Mutex.h"
+#include "Sync.h"
 
 #include <vector>
 #include <algorithm>
@@ -81,6 +82,9 @@ public:
 	int StreamBuffer( unsigned int BufferID, int Size );
 	void Update( float DeltaSeconds );
 
+	/// How soon Update() should be called again to refill the stream buffers in time, negative if it is not needed
+	float GetUpdateInterval() const;
+
 	void SetVolume( float Volume )
 	{
 		alSourcef( FSourceID, AL_GAIN, Volume );
@@ -112,7 +116,7 @@ private:
 class clAudioThread: public iThread
 {
 public:
-	clAudioThread(): FDevice( NULL ), FContext( NULL ), FInitialized( false ) {}
+	clAudioThread(): FDevice( NULL ), FContext( NULL ), FWakeUp( false ) {}
 	virtual ~clAudioThread() {}
 
 	virtual void Run();
@@ -120,11 +124,21 @@ public:
 	void RegisterSource( clAudioSource* Src );
 	void UnRegisterSource( clAudioSource* Src );
 
-	void Wait() const volatile;
+	/// Make the thread update the sources now, e.g. after a stream has been started
+	void WakeUp() { FWakeUp.Signal(); }
+
+	/// Block until the thread has initialized OpenAL
+	void Wait();
+
+protected:
+	virtual void NotifyExit() { FWakeUp.Signal(); }
+
 private:
-	volatile bool  FInitialized;
 	ALCdevice*     FDevice;
 	ALCcontext*    FContext;
+	clEvent        FInitialized;
+	/// auto-reset, the thread sleeps on it between the updates
+	clEvent        FWakeUp;
 	std::vector< clAudioSource* > FActiveSources;
 	clMutex        FMutex;
 };
@@ -91,6 +91,8 @@ protected:
 	virtual int ReadFromFile( int Size, int BytesRead ) = 0;
 
 	clPtr<clBlob> FRawData;
+	/// Source stream for the decoders which can read the compressed data sequentially
+	clPtr<iIStream> FRawStream;
 public:
 	bool              FLoop;
 	bool              FEof;
@@ -101,6 +103,12 @@ public:
 		FEof = false;
 	}
 
+	explicit clDecodingProvider( const clPtr<iIStream>& Stream )
+	{
+		FRawStream = Stream;
+		FEof = false;
+	}
+
 	virtual bool IsEOF() const { return FEof; }
 
 	virtual int StreamWaveData( int Size )
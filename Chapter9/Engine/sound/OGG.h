@@ -43,24 +43,20 @@ class clOggProvider: public clDecodingProvider
 public:
 	explicit clOggProvider( const clPtr<clBlob>& Blob ): clDecodingProvider( Blob )
 	{
-		FOGGRawPosition = 0;
+		ManagedMemRawFile* File = new ManagedMemRawFile();
+		File->SetBlob( Blob );
 
-		ov_callbacks Callbacks;
-		Callbacks.read_func  = OGG_ReadFunc;
-		Callbacks.seek_func  = OGG_SeekFunc;
-		Callbacks.close_func = OGG_CloseFunc;
-		Callbacks.tell_func  = OGG_TellFunc;
+		FRawStream = new FileMapper( File );
 
-		vorbis_info*      VorbisInfo;
-
-		// check for "< 0"
-		OGG_ov_open_callbacks( this, &FVorbisFile, NULL, -1, Callbacks );
+		Open();
+	}
 
-		VorbisInfo    = OGG_ov_info ( &FVorbisFile, -1 );
-		FChannels      = VorbisInfo->channels;
-		FSamplesPerSec = VorbisInfo->rate;
-		FBitsPerSample = 16;
+	/// Decode the data as it is read from the Stream, e.g. clFileSystem::CreateStreamReader() for a track inside .apk
+	explicit clOggProvider( const clPtr<iIStream>& Stream ): clDecodingProvider( Stream )
+	{
+		Open();
 	}
+
 	virtual ~clOggProvider() { OGG_ov_clear( &FVorbisFile ); }
 
 	virtual int ReadFromFile( int Size, int BytesRead )
@@ -71,52 +67,90 @@ public:
 	virtual void    Seek( float Time )
 	{
 		FEof = false;
-		OGG_ov_time_seek( &FVorbisFile, Time );
+
+		if ( FSeekable )
+		{
+			OGG_ov_time_seek( &FVorbisFile, Time );
+			return;
+		}
+
+		// restart the decoder from the beginning and drop the samples up to Time
+		OGG_ov_clear( &FVorbisFile );
+		FRawStream->Seek( 0 );
+		Open();
+
+		int BytesToSkip = static_cast<int>( Time * FSamplesPerSec ) * FChannels * ( FBitsPerSample >> 3 );
+
+		char Scratch[4096];
+
+		while ( BytesToSkip > 0 )
+		{
+			int Size = ( BytesToSkip < ( int )sizeof( Scratch ) ) ? BytesToSkip : ( int )sizeof( Scratch );
+
+			long Ret = OGG_ov_read( &FVorbisFile, Scratch, Size, 0, FBitsPerSample >> 3, 1, &FOGGCurrentSection );
+
+			if ( Ret <= 0 ) { break; }
+
+			BytesToSkip -= ( int )Ret;
+		}
 	}
 private:
-
-	static size_t OGG_ReadFunc( void* Ptr, size_t Size, size_t NMemB, void* DataSource )
+	void Open()
 	{
-		clOggProvider* OGG = static_cast<clOggProvider*>( DataSource );
+		/// A stream without a memory mapping (e.g. a deflated clArchiveEntryStream) restarts inflation on every backward seek.
+		/// Open it as non-seekable, so vorbisfile reads it front to back exactly once.
+		FSeekable = FRawStream->MapStream() != NULL;
 
-		size_t DataSize = OGG->FRawData->GetSize();
+		ov_callbacks Callbacks;
+		Callbacks.read_func  = OGG_ReadFunc;
+		Callbacks.seek_func  = FSeekable ? OGG_SeekFunc : NULL;
+		Callbacks.close_func = OGG_CloseFunc;
+		Callbacks.tell_func  = FSeekable ? OGG_TellFunc : NULL;
 
-		ogg_int64_t BytesRead = DataSize - OGG->FOGGRawPosition;
-		ogg_int64_t BytesSize = Size * NMemB;
+		vorbis_info*      VorbisInfo;
 
-		if ( BytesSize < BytesRead ) { BytesRead = BytesSize; }
+		// check for "< 0"
+		OGG_ov_open_callbacks( this, &FVorbisFile, NULL, -1, Callbacks );
 
-		memcpy( Ptr, ( ubyte* )OGG->FRawData->GetDataConst() + OGG->FOGGRawPosition, ( size_t )BytesRead );
+		VorbisInfo    = OGG_ov_info ( &FVorbisFile, -1 );
+		FChannels      = VorbisInfo->channels;
+		FSamplesPerSec = VorbisInfo->rate;
+		FBitsPerSample = 16;
+	}
 
-		OGG->FOGGRawPosition += BytesRead;
+	static size_t OGG_ReadFunc( void* Ptr, size_t Size, size_t NMemB, void* DataSource )
+	{
+		clOggProvider* OGG = static_cast<clOggProvider*>( DataSource );
 
-		return ( size_t )BytesRead;
+		return ( size_t )OGG->FRawStream->Read( Ptr, ( uint64 )Size * NMemB );
 	}
 	static int OGG_SeekFunc( void* DataSource, ogg_int64_t Offset, int Whence )
 	{
 		clOggProvider* OGG = static_cast<clOggProvider*>( DataSource );
 
-		size_t DataSize = OGG->FRawData->GetSize();
+		ogg_int64_t DataSize = ( ogg_int64_t )OGG->FRawStream->GetSize();
+		ogg_int64_t Position = ( ogg_int64_t )OGG->FRawStream->GetPos();
 
 		if ( Whence == SEEK_SET )
 		{
-			OGG->FOGGRawPosition = Offset;
+			Position = Offset;
 		}
 		else if ( Whence == SEEK_CUR )
 		{
-			OGG->FOGGRawPosition += Offset;
+			Position += Offset;
 		}
 		else if ( Whence == SEEK_END )
 		{
-			OGG->FOGGRawPosition = DataSize + Offset;
+			Position = DataSize + Offset;
 		}
 
-		if ( OGG->FOGGRawPosition > ( ogg_int64_t )DataSize )
-		{
-			OGG->FOGGRawPosition = ( ogg_int64_t )DataSize;
-		}
+		if ( Position > DataSize ) { Position = DataSize; }
+
+		if ( Position < 0 ) { Position = 0; }
+
+		OGG->FRawStream->Seek( ( uint64 )Position );
 
-		return static_cast<int>( OGG->FOGGRawPosition );
+		return static_cast<int>( Position );
 	}
 	static int OGG_CloseFunc( void* DataSource )
 	{
@@ -124,10 +158,10 @@ private:
 	}
 	static long OGG_TellFunc( void* DataSource )
 	{
-		return ( int )( ( ( clOggProvider* )DataSource )->FOGGRawPosition );
+		return ( long )( ( ( clOggProvider* )DataSource )->FRawStream->GetPos() );
 	}
 
 	OggVorbis_File         FVorbisFile;
-	ogg_int64_t            FOGGRawPosition;
 	int                    FOGGCurrentSection;
+	bool                   FSeekable;
 };
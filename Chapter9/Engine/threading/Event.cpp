@@ -33,39 +33,165 @@
  */
 
 #include "Event.h"
-#include <stdio.h>
+#include "Profiler.h"
+
+static double Queue_GetSeconds()
+{
+	return static_cast<double>( Trace_GetNanoseconds() ) * 1e-9;
+}
+
+/// Placeholder node, the queue is never empty so producers do not contend with the consumer
+class clStubCapsule: public iAsyncCapsule
+{
+public:
+	virtual void Invoke() {}
+};
 
 iAsyncQueue::iAsyncQueue()
-	: FDemultiplexerMutex()
-	, FCurrentQueue( 0 )
-	, FAsyncQueues( 2 )
-	, FAsyncQueue( &FAsyncQueues[0] )
+	: FStub( new clStubCapsule() )
+	, FDepth( 0 )
+	, FMaxDepth( 0 )
+	, FProcessed( 0 )
+	, FTotalLatency( 0.0 )
+	, FMaxLatency( 0.0 )
 {
+	FHead = FStub;
+	FTail = FStub;
 }
 
-void iAsyncQueue::EnqueueCapsule( const clPtr<iAsyncCapsule>& Capsule )
+iAsyncQueue::~iAsyncQueue()
+{
+	// drop the pending capsules without invoking them
+	while ( iAsyncCapsule* Capsule = Pop() ) { Capsule->DecRefCount(); }
+
+	delete( FStub );
+}
+
+void iAsyncQueue::Push( iAsyncCapsule* Capsule )
 {
-	LMutex Mutex( &FDemultiplexerMutex );
-	FAsyncQueue->push_back( Capsule );
+	Capsule->FNextCapsule = NULL;
+
+	iAsyncCapsule* Prev = Atomic::ExchangePtr( &FHead, Capsule );
+
+	// the consumer stops at Prev until this link is set
+	Prev->FNextCapsule = Capsule;
 }
 
-void iAsyncQueue::DemultiplexEvents()
+iAsyncCapsule* iAsyncQueue::Pop()
 {
-	CallQueue* LocalQueue = &FAsyncQueues[ FCurrentQueue ];
+	iAsyncCapsule* Tail = FTail;
+	iAsyncCapsule* Next = Tail->FNextCapsule;
+
+	if ( Tail == FStub )
+	{
+		if ( !Next ) { return NULL; }
 
-	// switch current queue
+		Atomic::Barrier();
+
+		FTail = Next;
+		Tail  = Next;
+		Next  = Next->FNextCapsule;
+	}
+
+	if ( Next )
+	{
+		Atomic::Barrier();
+
+		FTail = Next;
+		return Tail;
+	}
+
+	// a producer has exchanged the head but has not linked the node yet
+	if ( Tail != FHead ) { return NULL; }
+
+	// Tail is the last node, put the stub behind it so it can be detached
+	Push( FStub );
+
+	Next = Tail->FNextCapsule;
+
+	if ( Next )
 	{
-		LMutex Lock( &FDemultiplexerMutex );
+		Atomic::Barrier();
 
-		FCurrentQueue = ( FCurrentQueue + 1 ) % 2;
-		FAsyncQueue = &FAsyncQueues[ FCurrentQueue ];
+		FTail = Next;
+		return Tail;
 	}
 
-	// invoke callbacks
-	for ( CallQueue::iterator i = LocalQueue->begin(); i != LocalQueue->end(); ++i )
+	return NULL;
+}
+
+void iAsyncQueue::EnqueueCapsule( const clPtr<iAsyncCapsule>& Capsule )
+{
+	// the queue holds a reference until the capsule is invoked
+	Capsule->IncRefCount();
+	Capsule->FEnqueueTime = Queue_GetSeconds();
+
+	// count the capsule before it becomes visible, otherwise the consumer can pop it first and FDepth goes negative
+	Atomic::Inc( &FDepth );
+
+	Push( Capsule.GetInternalPtr() );
+}
+
+size_t iAsyncQueue::DemultiplexEvents( size_t MaxEvents, double MaxSeconds )
+{
+	L_PROFILE_ZONE( "iAsyncQueue::DemultiplexEvents" );
+
+	// only the capsules enqueued before this call, so a capsule enqueueing another one can not loop forever
+	size_t Budget = GetQueueDepth();
+
+	if ( Budget > FMaxDepth ) { FMaxDepth = Budget; }
+
+	if ( MaxEvents && MaxEvents < Budget ) { Budget = MaxEvents; }
+
+	double Start = ( MaxSeconds > 0.0 ) ? Queue_GetSeconds() : 0.0;
+
+	size_t Count = 0;
+
+	while ( Count < Budget )
 	{
-		( *i )->Invoke();
+		iAsyncCapsule* Capsule = Pop();
+
+		// the remaining capsules are still being linked by the producers
+		if ( !Capsule ) { break; }
+
+		Atomic::Dec( &FDepth );
+
+		double Latency = Queue_GetSeconds() - Capsule->FEnqueueTime;
+
+		FTotalLatency += Latency;
+
+		if ( Latency > FMaxLatency ) { FMaxLatency = Latency; }
+
+		Capsule->Invoke();
+		Capsule->DecRefCount();
+
+		Count++;
+
+		if ( MaxSeconds > 0.0 && Queue_GetSeconds() - Start > MaxSeconds ) { break; }
 	}
 
-	LocalQueue->clear();
+	FProcessed += Count;
+
+	return Count;
+}
+
+sAsyncQueueStats iAsyncQueue::GetStats() const
+{
+	sAsyncQueueStats Stats;
+
+	Stats.FDepth          = GetQueueDepth();
+	Stats.FMaxDepth       = FMaxDepth;
+	Stats.FProcessed      = FProcessed;
+	Stats.FAverageLatency = FProcessed ? FTotalLatency / static_cast<double>( FProcessed ) : 0.0;
+	Stats.FMaxLatency     = FMaxLatency;
+
+	return Stats;
+}
+
+void iAsyncQueue::ResetStats()
+{
+	FMaxDepth     = 0;
+	FProcessed    = 0;
+	FTotalLatency = 0.0;
+	FMaxLatency   = 0.0;
 }
@@ -37,36 +37,84 @@
 
 #include "Mutex.h"
 #include "iObject.h"
+#include "ObjectPool.h"
 #include "iIntrusivePtr.h"
 #include <vector>
 
 class iAsyncCapsule: public iObject
 {
 public:
+	iAsyncCapsule(): FNextCapsule( NULL ), FEnqueueTime( 0.0 ) {}
+
 	/// Run the method
 	virtual void Invoke() = 0;
+
+private:
+	friend class iAsyncQueue;
+
+	/// intrusive link, a capsule can sit in one queue at a time
+	iAsyncCapsule* volatile FNextCapsule;
+	double                  FEnqueueTime;
 };
 
-class iAsyncQueue
+struct sAsyncQueueStats
+{
+	/// number of capsules waiting in the queue
+	size_t FDepth;
+	/// the largest depth seen by DemultiplexEvents()
+	size_t FMaxDepth;
+	size_t FProcessed;
+	/// time between EnqueueCapsule() and Invoke(), in seconds
+	double FAverageLatency;
+	double FMaxLatency;
+};
+
+/**
+   Events queue
+
+   Any thread can enqueue capsules, only one thread demultiplexes them. The queue is an intrusive lock-free
+   multi-producer single-consumer list (Vyukov), the capsules are referenced while they are queued.
+*/
+class iAsyncQueue: public iObject
 {
 public:
 	iAsyncQueue();
+	virtual ~iAsyncQueue();
 
 	/// Put the event into the events queue
 	virtual void    EnqueueCapsule( const clPtr<iAsyncCapsule>& Capsule );
 
-	/// Events demultiplexer as described in Reactor pattern
-	virtual void    DemultiplexEvents();
+	/**
+	   Events demultiplexer as described in Reactor pattern
+
+	   Invokes the capsules which were enqueued before the call. MaxEvents and MaxSeconds limit the work per call
+	   (0 means unlimited), the rest stays in the queue for the next call. Returns the number of invoked capsules.
+	**/
+	virtual size_t  DemultiplexEvents( size_t MaxEvents = 0, double MaxSeconds = 0.0 );
+
+	size_t          GetQueueDepth() const { return static_cast<size_t>( FDepth ); }
+
+	/// Should be called from the demultiplexing thread
+	sAsyncQueueStats GetStats() const;
+	void             ResetStats();
+
+private:
+	void            Push( iAsyncCapsule* Capsule );
+	iAsyncCapsule*  Pop();
 
 private:
-	size_t          FCurrentQueue;
+	/// producers exchange the head, the consumer owns the tail
+	iAsyncCapsule* volatile FHead;
+	iAsyncCapsule*          FTail;
+	iAsyncCapsule*          FStub;
 
-	typedef std::vector< clPtr<iAsyncCapsule> > CallQueue;
-	std::vector<CallQueue> FAsyncQueues;
+	volatile long   FDepth;
 
-	/// switched for shared non-locked access
-	CallQueue*   FAsyncQueue;
-	clMutex      FDemultiplexerMutex;
+	/// statistics, updated by the consumer only
+	size_t          FMaxDepth;
+	size_t          FProcessed;
+	double          FTotalLatency;
+	double          FMaxLatency;
 };
 
 #endif
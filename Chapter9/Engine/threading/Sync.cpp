@@ -0,0 +1,383 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Sync.h"
+#include "iObject.h"
+
+#if defined( _WIN32 )
+// GetTickCount64(), CONDITION_VARIABLE: Windows Vista or newer
+#elif defined( __linux__ )
+#  include <errno.h>
+#  include <limits.h>
+#  include <time.h>
+#  include <unistd.h>
+#  include <sys/syscall.h>
+#  include <linux/futex.h>
+#else
+#  include <limits.h>
+#  include <sys/time.h>
+#endif
+
+#if defined( __linux__ )
+// older NDK headers lack the private futex operations
+#  if !defined( FUTEX_PRIVATE_FLAG )
+#     define FUTEX_PRIVATE_FLAG 128
+#  endif
+#  if !defined( FUTEX_WAIT_PRIVATE )
+#     define FUTEX_WAIT_PRIVATE ( FUTEX_WAIT | FUTEX_PRIVATE_FLAG )
+#     define FUTEX_WAKE_PRIVATE ( FUTEX_WAKE | FUTEX_PRIVATE_FLAG )
+#  endif
+#  if !defined( SYS_futex )
+#     define SYS_futex __NR_futex
+#  endif
+#endif
+
+namespace
+{
+	inline sync_word_t Sync_CompareExchange( volatile sync_word_t* Ptr, sync_word_t Expected, sync_word_t Value )
+	{
+#if defined( _WIN32 )
+		return InterlockedCompareExchange( Ptr, Value, Expected );
+#else
+		return __sync_val_compare_and_swap( Ptr, Expected, Value );
+#endif
+	}
+
+	inline sync_word_t Sync_Add( volatile sync_word_t* Ptr, sync_word_t Delta )
+	{
+#if defined( _WIN32 )
+		return InterlockedExchangeAdd( Ptr, Delta ) + Delta;
+#else
+		return __sync_add_and_fetch( Ptr, Delta );
+#endif
+	}
+
+	/// Monotonic clock for the timeouts
+	int64 Sync_GetMilliseconds()
+	{
+#if defined( _WIN32 )
+		return static_cast<int64>( GetTickCount64() );
+#elif defined( __linux__ )
+		timespec Now;
+		clock_gettime( CLOCK_MONOTONIC, &Now );
+
+		return static_cast<int64>( Now.tv_sec ) * 1000 + Now.tv_nsec / 1000000;
+#else
+		timeval Now;
+		gettimeofday( &Now, NULL );
+
+		return static_cast<int64>( Now.tv_sec ) * 1000 + Now.tv_usec / 1000;
+#endif
+	}
+
+	/// -1 stands for no deadline
+	int64 Sync_GetDeadline( int Milliseconds )
+	{
+		return ( Milliseconds < 0 ) ? -1 : Sync_GetMilliseconds() + Milliseconds;
+	}
+
+	/// Milliseconds until the Deadline, SYNC_INFINITE if there is no deadline
+	int Sync_GetTimeLeft( int64 Deadline )
+	{
+		if ( Deadline < 0 ) { return SYNC_INFINITE; }
+
+		int64 TimeLeft = Deadline - Sync_GetMilliseconds();
+
+		return ( TimeLeft > 0 ) ? static_cast<int>( TimeLeft ) : 0;
+	}
+} // namespace
+
+clWaitWord::clWaitWord( sync_word_t Value )
+	: FValue( Value )
+{
+#if defined( _WIN32 )
+	InitializeCriticalSection( &FLock );
+	InitializeConditionVariable( &FCondition );
+#elif !defined( __linux__ )
+	pthread_mutex_init( &FLock, NULL );
+	pthread_cond_init( &FCondition, NULL );
+#endif
+}
+
+clWaitWord::~clWaitWord()
+{
+#if defined( _WIN32 )
+	DeleteCriticalSection( &FLock );
+#elif !defined( __linux__ )
+	pthread_cond_destroy( &FCondition );
+	pthread_mutex_destroy( &FLock );
+#endif
+}
+
+void clWaitWord::Set( sync_word_t Value )
+{
+#if defined( _WIN32 )
+	InterlockedExchange( &FValue, Value );
+#else
+	__sync_synchronize();
+	FValue = Value;
+	__sync_synchronize();
+#endif
+}
+
+sync_word_t clWaitWord::CompareExchange( sync_word_t Expected, sync_word_t Value )
+{
+	return Sync_CompareExchange( &FValue, Expected, Value );
+}
+
+sync_word_t clWaitWord::Add( sync_word_t Delta )
+{
+	return Sync_Add( &FValue, Delta );
+}
+
+bool clWaitWord::WaitWhile( sync_word_t Expected, int Milliseconds )
+{
+#if defined( __linux__ )
+	timespec Timeout;
+	timespec* TimeoutPtr = NULL;
+
+	if ( Milliseconds >= 0 )
+	{
+		Timeout.tv_sec  = Milliseconds / 1000;
+		Timeout.tv_nsec = static_cast<long>( Milliseconds % 1000 ) * 1000000;
+		TimeoutPtr = &Timeout;
+	}
+
+	// the kernel compares the word with Expected and goes to sleep atomically, EAGAIN means it has already changed
+	if ( syscall( SYS_futex, const_cast<sync_word_t*>( &FValue ), FUTEX_WAIT_PRIVATE, Expected, TimeoutPtr, NULL, 0 ) == 0 ) { return true; }
+
+	return errno != ETIMEDOUT;
+#elif defined( _WIN32 )
+	bool Result = true;
+
+	EnterCriticalSection( &FLock );
+
+	if ( Get() == Expected )
+	{
+		DWORD Timeout = ( Milliseconds < 0 ) ? INFINITE : static_cast<DWORD>( Milliseconds );
+
+		Result = SleepConditionVariableCS( &FCondition, &FLock, Timeout ) || GetLastError() != ERROR_TIMEOUT;
+	}
+
+	LeaveCriticalSection( &FLock );
+
+	return Result;
+#else
+	int Error = 0;
+
+	pthread_mutex_lock( &FLock );
+
+	if ( Get() == Expected )
+	{
+		if ( Milliseconds < 0 )
+		{
+			Error = pthread_cond_wait( &FCondition, &FLock );
+		}
+		else
+		{
+			// pthread_cond_timedwait() wants the absolute wall clock time
+			timeval Now;
+			gettimeofday( &Now, NULL );
+
+			int64 Nanoseconds = static_cast<int64>( Now.tv_usec ) * 1000 + static_cast<int64>( Milliseconds % 1000 ) * 1000000;
+
+			timespec Deadline;
+			Deadline.tv_sec  = Now.tv_sec + Milliseconds / 1000 + static_cast<time_t>( Nanoseconds / 1000000000 );
+			Deadline.tv_nsec = static_cast<long>( Nanoseconds % 1000000000 );
+
+			Error = pthread_cond_timedwait( &FCondition, &FLock, &Deadline );
+		}
+	}
+
+	pthread_mutex_unlock( &FLock );
+
+	return Error == 0;
+#endif
+}
+
+void clWaitWord::Wake( int Count )
+{
+#if defined( __linux__ )
+	syscall( SYS_futex, const_cast<sync_word_t*>( &FValue ), FUTEX_WAKE_PRIVATE, Count, NULL, NULL, 0 );
+#elif defined( _WIN32 )
+	// the lock orders the wake-up after the check in WaitWhile(), so it can not be lost
+	EnterCriticalSection( &FLock );
+
+	if ( Count == 1 )
+	{
+		WakeConditionVariable( &FCondition );
+	}
+	else
+	{
+		// a condition variable can not wake exactly Count threads, the extra ones wake up spuriously
+		WakeAllConditionVariable( &FCondition );
+	}
+
+	LeaveCriticalSection( &FLock );
+#else
+	pthread_mutex_lock( &FLock );
+
+	if ( Count == 1 )
+	{
+		pthread_cond_signal( &FCondition );
+	}
+	else
+	{
+		pthread_cond_broadcast( &FCondition );
+	}
+
+	pthread_mutex_unlock( &FLock );
+#endif
+}
+
+void clWaitWord::WakeAll()
+{
+	Wake( INT_MAX );
+}
+
+void clEvent::Signal()
+{
+	// nobody can be waiting on an already signaled event
+	if ( FState.CompareExchange( 0, 1 ) != 0 ) { return; }
+
+	if ( FManualReset )
+	{
+		FState.WakeAll();
+	}
+	else
+	{
+		FState.Wake( 1 );
+	}
+}
+
+void clEvent::Reset()
+{
+	FState.Set( 0 );
+}
+
+bool clEvent::Wait( int Milliseconds )
+{
+	int64 Deadline = Sync_GetDeadline( Milliseconds );
+
+	for ( ;; )
+	{
+		if ( FManualReset )
+		{
+			if ( FState.Get() != 0 ) { return true; }
+		}
+		else
+		{
+			// consume the signal
+			if ( FState.CompareExchange( 1, 0 ) != 0 ) { return true; }
+		}
+
+		int TimeLeft = Sync_GetTimeLeft( Deadline );
+
+		if ( TimeLeft == 0 ) { return false; }
+
+		FState.WaitWhile( 0, TimeLeft );
+	}
+}
+
+void clSemaphore::Post( int Count )
+{
+	FCount.Add( Count );
+
+	// both Add()s are full barriers: either we see the waiter here or it sees the new count before going to sleep
+	if ( Sync_Add( &FNumWaiters, 0 ) > 0 ) { FCount.Wake( Count ); }
+}
+
+bool clSemaphore::TryWait()
+{
+	for ( ;; )
+	{
+		sync_word_t Count = FCount.Get();
+
+		if ( Count <= 0 ) { return false; }
+
+		if ( FCount.CompareExchange( Count, Count - 1 ) == Count ) { return true; }
+	}
+}
+
+bool clSemaphore::Wait( int Milliseconds )
+{
+	if ( TryWait() ) { return true; }
+
+	int64 Deadline = Sync_GetDeadline( Milliseconds );
+
+	Sync_Add( &FNumWaiters, 1 );
+
+	bool Result = false;
+
+	for ( ;; )
+	{
+		if ( TryWait() ) { Result = true; break; }
+
+		int TimeLeft = Sync_GetTimeLeft( Deadline );
+
+		if ( TimeLeft == 0 ) { break; }
+
+		FCount.WaitWhile( 0, TimeLeft );
+	}
+
+	Sync_Add( &FNumWaiters, -1 );
+
+	return Result;
+}
+
+void clLatch::CountDown( int Count )
+{
+	sync_word_t Value = FCount.Add( -Count );
+
+	// wake up the waiters only once, when the counter crosses zero
+	if ( Value <= 0 && Value + Count > 0 ) { FCount.WakeAll(); }
+}
+
+bool clLatch::Wait( int Milliseconds )
+{
+	int64 Deadline = Sync_GetDeadline( Milliseconds );
+
+	for ( ;; )
+	{
+		sync_word_t Count = FCount.Get();
+
+		if ( Count <= 0 ) { return true; }
+
+		int TimeLeft = Sync_GetTimeLeft( Deadline );
+
+		if ( TimeLeft == 0 ) { return false; }
+
+		FCount.WaitWhile( Count, TimeLeft );
+	}
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __Sync__h__included__
+#define __Sync__h__included__
+
+#if defined( _WIN32 )
+#  include <windows.h>
+#elif !defined( __linux__ )
+#  include <pthread.h>
+#endif
+
+/// Pass it as a timeout to wait forever
+const int SYNC_INFINITE = -1;
+
+#if defined( _WIN32 )
+typedef long sync_word_t;
+#else
+typedef int  sync_word_t;
+#endif
+
+/**
+   A 32-bit word threads can sleep on
+
+   This is the building block for the primitives below. On Linux and Android it is a bare futex, so the
+   uncontended paths of the primitives never enter the kernel. Other platforms emulate it with a lock and
+   a condition variable (Windows Vista or newer, pthreads elsewhere).
+   Spurious wake-ups are possible, waiters re-check their condition in a loop.
+*/
+class clWaitWord
+{
+public:
+	explicit clWaitWord( sync_word_t Value );
+	~clWaitWord();
+
+	/// Sleep while the word equals Expected, false if Milliseconds have passed
+	bool WaitWhile( sync_word_t Expected, int Milliseconds );
+	/// Wake up to Count sleeping threads, call it after the word has been changed
+	void Wake( int Count );
+	void WakeAll();
+
+	sync_word_t Get() const
+	{
+#if defined( _WIN32 )
+		sync_word_t Value = FValue;
+		MemoryBarrier();
+		return Value;
+#else
+		return __atomic_load_n( &FValue, __ATOMIC_ACQUIRE );
+#endif
+	}
+
+	void        Set( sync_word_t Value );
+	/// Atomically replace the word if it equals Expected, return the previous value
+	sync_word_t CompareExchange( sync_word_t Expected, sync_word_t Value );
+	/// Atomically add Delta and return the new value
+	sync_word_t Add( sync_word_t Delta );
+
+private:
+	clWaitWord( const clWaitWord& );
+	clWaitWord& operator = ( const clWaitWord& );
+
+private:
+	volatile sync_word_t FValue;
+#if defined( _WIN32 )
+	CRITICAL_SECTION   FLock;
+	CONDITION_VARIABLE FCondition;
+#elif !defined( __linux__ )
+	pthread_mutex_t   FLock;
+	pthread_cond_t    FCondition;
+#endif
+};
+
+/**
+   Binary event
+
+   A manual-reset event stays signaled and releases all waiters until Reset() is called.
+   An auto-reset event releases a single waiter and becomes non-signaled again.
+*/
+class clEvent
+{
+public:
+	explicit clEvent( bool ManualReset = true ): FState( 0 ), FManualReset( ManualReset ) {}
+
+	void Signal();
+	void Reset();
+	bool IsSignaled() const { return FState.Get() != 0; }
+
+	void Wait() { Wait( SYNC_INFINITE ); }
+	/// false on timeout
+	bool Wait( int Milliseconds );
+
+private:
+	clWaitWord FState;
+	bool       FManualReset;
+};
+
+/// Counting semaphore
+class clSemaphore
+{
+public:
+	explicit clSemaphore( int Count = 0 ): FCount( Count ), FNumWaiters( 0 ) {}
+
+	void Post( int Count = 1 );
+	bool TryWait();
+
+	void Wait() { Wait( SYNC_INFINITE ); }
+	/// false on timeout
+	bool Wait( int Milliseconds );
+
+private:
+	clWaitWord           FCount;
+	/// Post() skips the system call while nobody sleeps
+	volatile sync_word_t FNumWaiters;
+};
+
+/**
+   Single-use countdown latch
+
+   Wait() blocks until CountDown() has been called Count times, e.g. until all the workers have been initialized.
+*/
+class clLatch
+{
+public:
+	explicit clLatch( int Count ): FCount( Count ) {}
+
+	void CountDown( int Count = 1 );
+	bool IsReady() const { return FCount.Get() <= 0; }
+
+	void Wait() { Wait( SYNC_INFINITE ); }
+	/// false on timeout
+	bool Wait( int Milliseconds );
+
+private:
+	clWaitWord FCount;
+};
+
+#endif
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TaskGraph.h"
+
+/// Runs a node from iAsyncQueue::DemultiplexEvents()
+class clTaskNodeCapsule: public iAsyncCapsule
+{
+public:
+	explicit clTaskNodeCapsule( const clPtr<clTaskNode>& Node ): FNode( Node ) {}
+
+	virtual void Invoke() { FNode->Run(); }
+
+private:
+	clPtr<clTaskNode> FNode;
+};
+
+clTaskNode::clTaskNode( const clPtr<clTaskGraph>& Graph, const clPtr<iTask>& Task, iAsyncQueue* Queue )
+	: FGraph( Graph ),
+	  FTask( Task ),
+	  FQueue( Queue ),
+	  FState( State_Waiting ),
+	  FPendingInputs( 0 )
+{
+	// so the node can be cancelled and re-prioritized through the pool like the task itself
+	SetTaskID( Task->GetTaskID() );
+	SetPriority( Task->GetPriority() );
+}
+
+clPtr<clTaskNode> clTaskNode::Then( const clPtr<iTask>& Task, iAsyncQueue* Queue )
+{
+	return FGraph->Add( Task, std::vector< clPtr<clTaskNode> >( 1, this ), Queue );
+}
+
+void clTaskNode::Exit()
+{
+	FGraph->CancelNode( this );
+}
+
+void clTaskNode::Run()
+{
+	bool Cancelled = false;
+
+	FGraph->NodeStarted( this, &Cancelled );
+
+	if ( Cancelled ) { return; }
+
+	if ( !FTask->IsPendingExit() ) { FTask->Run(); }
+
+	FGraph->NodeCompleted( this );
+}
+
+bool clTaskNode::IsDone() const
+{
+	tthread::lock_guard<tthread::mutex> Lock( FGraph->FMutex );
+
+	return FState == State_Done;
+}
+
+bool clTaskNode::IsCancelled() const
+{
+	tthread::lock_guard<tthread::mutex> Lock( FGraph->FMutex );
+
+	return FState == State_Cancelled;
+}
+
+clTaskGraph::clTaskGraph( const clPtr<clThreadPool>& Pool )
+	: FPool( Pool )
+{
+}
+
+clPtr<clTaskNode> clTaskGraph::Add( const clPtr<iTask>& Task, iAsyncQueue* Queue )
+{
+	return Add( Task, std::vector< clPtr<clTaskNode> >(), Queue );
+}
+
+clPtr<clTaskNode> clTaskGraph::Add( const clPtr<iTask>& Task, const std::vector< clPtr<clTaskNode> >& Dependencies, iAsyncQueue* Queue )
+{
+	clPtr<clTaskNode> Node = new clTaskNode( this, Task, Queue );
+
+	{
+		tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+		FActive[ Node.GetInternalPtr() ] = Node;
+
+		bool Cancelled = false;
+
+		for ( size_t i = 0; i != Dependencies.size(); i++ )
+		{
+			clTaskNode* Dep = Dependencies[i].GetInternalPtr();
+
+			if ( Dep->FState == clTaskNode::State_Done ) { continue; }
+
+			if ( Dep->FState == clTaskNode::State_Cancelled ) { Cancelled = true; continue; }
+
+			Dep->FContinuations.push_back( Node );
+			Node->FPendingInputs++;
+		}
+
+		// the node depends on something that will never complete
+		if ( Cancelled ) { CancelLocked( Node.GetInternalPtr() ); }
+
+		if ( Node->FState != clTaskNode::State_Waiting || Node->FPendingInputs > 0 ) { return Node; }
+
+		Node->FState = clTaskNode::State_Scheduled;
+	}
+
+	Schedule( std::vector< clPtr<clTaskNode> >( 1, Node ) );
+
+	return Node;
+}
+
+void clTaskGraph::Schedule( const std::vector< clPtr<clTaskNode> >& Ready )
+{
+	for ( size_t i = 0; i != Ready.size(); i++ )
+	{
+		if ( Ready[i]->FQueue )
+		{
+			Ready[i]->FQueue->EnqueueCapsule( new clTaskNodeCapsule( Ready[i] ) );
+		}
+		else
+		{
+			FPool->AddTask( Ready[i] );
+		}
+	}
+}
+
+void clTaskGraph::NodeStarted( clTaskNode* Node, bool* Cancelled )
+{
+	tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+	*Cancelled = Node->FState == clTaskNode::State_Cancelled;
+
+	if ( !*Cancelled ) { Node->FState = clTaskNode::State_Running; }
+}
+
+void clTaskGraph::NodeCompleted( clTaskNode* Node )
+{
+	std::vector< clPtr<clTaskNode> > Ready;
+
+	// the last reference to the node can be the one in FActive
+	clPtr<clTaskNode> Guard( Node );
+
+	{
+		tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+		// cancelled while running, the continuations have been cancelled already
+		if ( Node->FState == clTaskNode::State_Cancelled ) { return; }
+
+		Node->FState = clTaskNode::State_Done;
+
+		for ( size_t i = 0; i != Node->FContinuations.size(); i++ )
+		{
+			clTaskNode* Next = Node->FContinuations[i].GetInternalPtr();
+
+			if ( --Next->FPendingInputs > 0 || Next->FState != clTaskNode::State_Waiting ) { continue; }
+
+			Next->FState = clTaskNode::State_Scheduled;
+
+			Ready.push_back( Node->FContinuations[i] );
+		}
+
+		Node->FContinuations.clear();
+
+		FActive.erase( Node );
+	}
+
+	Schedule( Ready );
+}
+
+void clTaskGraph::CancelNode( clTaskNode* Node )
+{
+	clPtr<clTaskNode> Guard( Node );
+
+	tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+	CancelLocked( Node );
+}
+
+void clTaskGraph::CancelLocked( clTaskNode* Node )
+{
+	if ( Node->FState == clTaskNode::State_Done || Node->FState == clTaskNode::State_Cancelled ) { return; }
+
+	Node->FState = clTaskNode::State_Cancelled;
+
+	// the pool skips the node, a running task notices the flag
+	Node->iTask::Exit();
+	Node->FTask->Exit();
+
+	std::vector< clPtr<clTaskNode> > Continuations;
+	Continuations.swap( Node->FContinuations );
+
+	FActive.erase( Node );
+
+	for ( size_t i = 0; i != Continuations.size(); i++ )
+	{
+		CancelLocked( Continuations[i].GetInternalPtr() );
+	}
+}
+
+void clTaskGraph::Cancel()
+{
+	tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+	std::vector< clPtr<clTaskNode> > Active;
+
+	for ( std::unordered_map< clTaskNode*, clPtr<clTaskNode> >::iterator i = FActive.begin(); i != FActive.end(); ++i )
+	{
+		Active.push_back( i->second );
+	}
+
+	for ( size_t i = 0; i != Active.size(); i++ )
+	{
+		CancelLocked( Active[i].GetInternalPtr() );
+	}
+}
+
+size_t clTaskGraph::GetNumActive() const
+{
+	tthread::lock_guard<tthread::mutex> Lock( FMutex );
+
+	return FActive.size();
+}
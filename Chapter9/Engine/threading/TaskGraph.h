@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _TaskGraph_
+#define _TaskGraph_
+
+#include "ThreadPool.h"
+#include "Event.h"
+
+#include <unordered_map>
+#include <vector>
+
+class clTaskGraph;
+
+/// A task in clTaskGraph, it is scheduled when all its dependencies have completed
+class clTaskNode: public iTask
+{
+	L_POOLED_OBJECT( clTaskNode )
+public:
+	/// Add a task which runs after this one (fan-out if called several times)
+	clPtr<clTaskNode> Then( const clPtr<iTask>& Task, iAsyncQueue* Queue = NULL );
+
+	/// Cancel this node and everything that depends on it
+	virtual void Exit();
+
+	virtual void Run();
+
+	bool IsDone() const;
+	bool IsCancelled() const;
+
+	clPtr<iTask> GetTask() const { return FTask; }
+
+private:
+	friend class clTaskGraph;
+
+	enum LState
+	{
+	   State_Waiting,
+	   State_Scheduled,
+	   State_Running,
+	   State_Done,
+	   State_Cancelled
+	};
+
+	clTaskNode( const clPtr<clTaskGraph>& Graph, const clPtr<iTask>& Task, iAsyncQueue* Queue );
+
+private:
+	clPtr<clTaskGraph> FGraph;
+	clPtr<iTask>       FTask;
+	/// run the task from DemultiplexEvents() of this queue instead of the pool
+	iAsyncQueue*       FQueue;
+
+	/// the fields below are guarded by the graph mutex
+	LState             FState;
+	size_t             FPendingInputs;
+	std::vector< clPtr<clTaskNode> > FContinuations;
+};
+
+/**
+   Tasks with dependencies
+
+   A node runs on the thread pool (or on an async queue, e.g. to touch GL objects on the rendering thread)
+   as soon as all its inputs have completed. Nodes can be added at any time, a node without pending inputs
+   is scheduled right away. Cancelling a node cancels everything downstream of it.
+*/
+class clTaskGraph: public iObject
+{
+public:
+	explicit clTaskGraph( const clPtr<clThreadPool>& Pool );
+
+	/// Add a task without dependencies
+	clPtr<clTaskNode> Add( const clPtr<iTask>& Task, iAsyncQueue* Queue = NULL );
+	/// Add a task which runs after all Dependencies of this graph have completed (fan-in)
+	clPtr<clTaskNode> Add( const clPtr<iTask>& Task, const std::vector< clPtr<clTaskNode> >& Dependencies, iAsyncQueue* Queue = NULL );
+
+	/// Cancel all nodes which have not completed yet
+	void   Cancel();
+
+	/// Number of nodes which are not done and not cancelled
+	size_t GetNumActive() const;
+	bool   IsFinished() const { return GetNumActive() == 0; }
+
+private:
+	friend class clTaskNode;
+
+	void Schedule( const std::vector< clPtr<clTaskNode> >& Ready );
+	void NodeStarted( clTaskNode* Node, bool* Cancelled );
+	void NodeCompleted( clTaskNode* Node );
+	void CancelNode( clTaskNode* Node );
+	void CancelLocked( clTaskNode* Node );
+
+private:
+	clPtr<clThreadPool>    FPool;
+
+	/// nodes which are not done yet, they keep the graph alive through clTaskNode::FGraph
+	std::unordered_map< clTaskNode*, clPtr<clTaskNode> > FActive;
+	mutable tthread::mutex FMutex;
+};
+
+#endif
@@ -43,12 +43,18 @@
 
 iThread::iThread()
 	: FThreadHandle( 0 ),
-	  FPendingExit( false )
+	  FPendingExit( false ),
+	  FJoinable( false )
 {
 }
 
 iThread::~iThread()
 {
+#ifndef _WIN32
+
+	if ( FJoinable ) { pthread_detach( FThreadHandle ); }
+
+#endif
 }
 
 THREAD_CALL iThread::ThreadStaticEntryPoint( void* Ptr )
@@ -93,8 +99,8 @@ void iThread::Start( LPriority Priority )
 
 	SetThreadPriority( ( HANDLE )FThreadHandle, P );
 #else
-	pthread_create( &FThreadHandle, NULL, ThreadStaticEntryPoint, ThreadParam );
-	pthread_detach( FThreadHandle );
+	// the thread stays joinable so Exit( true ) can wait for it, it is detached in the destructor otherwise
+	FJoinable = pthread_create( &FThreadHandle, NULL, ThreadStaticEntryPoint, ThreadParam ) == 0;
 
 	int SchedPolicy = SCHED_OTHER;
 
@@ -116,15 +122,24 @@ void iThread::Exit( bool Wait )
 
 	if ( !Wait ) { return; }
 
+#ifdef _WIN32
+
 	if ( GetCurrentThread() != FThreadHandle )
 	{
-#ifdef _WIN32
 		WaitForSingleObject( ( HANDLE )FThreadHandle, INFINITE );
 		CloseHandle( ( HANDLE )FThreadHandle );
+	}
+
 #else
+
+	// GetCurrentThread() returns a kernel tid on Android, so compare the pthread handles directly
+	if ( FJoinable && !pthread_equal( pthread_self(), FThreadHandle ) )
+	{
 		pthread_join( FThreadHandle, NULL );
-#endif
+		FJoinable = false;
 	}
+
+#endif
 }
 
 native_thread_handle_t iThread::GetCurrentThread()
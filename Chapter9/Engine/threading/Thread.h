@@ -35,6 +35,8 @@
 #ifndef __iThread__h__included__
 #define __iThread__h__included__
 
+#include "iObject.h"
+
 #ifndef _WIN32
 #include <pthread.h>
 typedef pthread_t thread_handle_t;
@@ -50,7 +52,7 @@ typedef uintptr_t native_thread_handle_t;
 
    Linux implementation uses pthreads and win32/64 uses WinAPI to avoid external dependancies
 */
-class iThread
+class iThread: public iObject
 {
 public:
 	enum LPriority
@@ -93,6 +95,8 @@ private:
 protected:
 	volatile bool FPendingExit;
 	thread_handle_t FThreadHandle;
+	/// The thread has been started and not yet joined or detached
+	bool FJoinable;
 };
 
 #endif
@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+class clThreadPool::clPoolWorker: public iThread
+{
+public:
+	clPoolWorker( clThreadPool* Pool, size_t Index )
+		: FPool( Pool ),
+		  FIndex( Index ) {}
+
+protected:
+	virtual void Run() { FPool->WorkerLoop( FIndex ); }
+
+private:
+	clThreadPool* FPool;
+	size_t        FIndex;
+};
+
+clThreadPool::clThreadPool()
+	: FNextQueue( 0 ),
+	  FNumAnonymous( 0 ),
+	  FCancelGeneration( 0 ),
+	  FNumQueued( 0 ),
+	  FNumSleeping( 0 ),
+	  FPendingExit( false )
+{
+}
+
+clThreadPool::~clThreadPool()
+{
+	Exit( true );
+}
+
+void clThreadPool::Start( iThread::LPriority Priority, size_t NumThreads )
+{
+	if ( !NumThreads ) { NumThreads = tthread::thread::hardware_concurrency(); }
+
+	if ( !NumThreads ) { NumThreads = 1; }
+
+	FPendingExit = false;
+
+	for ( size_t i = 0; i != NumThreads; i++ )
+	{
+		FQueues.push_back( new sTaskQueue() );
+	}
+
+	FRunning.resize( NumThreads );
+
+	// all queues should exist before any worker starts stealing from them
+	for ( size_t i = 0; i != NumThreads; i++ )
+	{
+		FWorkers.push_back( new clPoolWorker( this, i ) );
+	}
+
+	for ( size_t i = 0; i != NumThreads; i++ )
+	{
+		FWorkers[i]->Start( Priority );
+	}
+}
+
+void clThreadPool::Exit( bool Wait )
+{
+	CancelAll();
+
+	{
+		tthread::lock_guard<tthread::mutex> Lock( FSleepMutex );
+
+		FPendingExit = true;
+
+		FWakeUp.notify_all();
+	}
+
+	for ( size_t i = 0; i != FWorkers.size(); i++ )
+	{
+		FWorkers[i]->Exit( Wait );
+	}
+
+	// the workers can be destroyed only after they are joined
+	if ( !Wait ) { return; }
+
+	for ( size_t i = 0; i != FWorkers.size(); i++ )
+	{
+		delete( FWorkers[i] );
+	}
+
+	for ( size_t i = 0; i != FQueues.size(); i++ )
+	{
+		delete( FQueues[i] );
+	}
+
+	FWorkers.clear();
+	FQueues.clear();
+	FRunning.clear();
+}
+
+void clThreadPool::AddTask( const clPtr<iTask>& Task )
+{
+	if ( !Task || FQueues.empty() ) { return; }
+
+	{
+		tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+		size_t Queue = FNextQueue++ % FQueues.size();
+
+		// the task is indexed before it becomes visible to the workers, so TaskFinished() always finds it
+		if ( size_t ID = Task->GetTaskID() )
+		{
+			sIndexEntry Entry;
+			Entry.FTask  = Task;
+			Entry.FQueue = Queue;
+
+			FTaskIndex.insert( std::make_pair( ID, Entry ) );
+		}
+		else
+		{
+			FNumAnonymous++;
+		}
+
+		// queued under the index lock, so a concurrent CancelAll() either removes the task or does not count it
+		tthread::lock_guard<tthread::mutex> QueueLock( FQueues[Queue]->FMutex );
+
+		FQueues[Queue]->FTasks.Push( Task );
+		FQueues[Queue]->UpdateTopPriority();
+	}
+
+	Atomic::Inc( &FNumQueued );
+
+	// a worker announces itself before it checks FNumQueued, so it either sees the task or gets woken up
+	if ( FNumSleeping <= 0 ) { return; }
+
+	// take the lock so the wake-up can not slip in between the check and the wait in ExtractTask()
+	tthread::lock_guard<tthread::mutex> Lock( FSleepMutex );
+
+	FWakeUp.notify_one();
+}
+
+bool clThreadPool::CancelTask( size_t ID )
+{
+	if ( !ID ) { return false; }
+
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	std::pair<clTaskIndex::iterator, clTaskIndex::iterator> Range = FTaskIndex.equal_range( ID );
+
+	if ( Range.first == Range.second ) { return false; }
+
+	for ( clTaskIndex::iterator i = Range.first; i != Range.second; ++i )
+	{
+		// a running or an already extracted task will notice the flag, a pending one is dropped right away
+		i->second.FTask->Exit();
+
+		sTaskQueue* Queue = FQueues[ i->second.FQueue ];
+
+		tthread::lock_guard<tthread::mutex> QueueLock( Queue->FMutex );
+
+		for ( size_t Removed = Queue->FTasks.Cancel( ID ); Removed; Removed-- ) { Atomic::Dec( &FNumQueued ); }
+
+		Queue->UpdateTopPriority();
+	}
+
+	FTaskIndex.erase( Range.first, Range.second );
+
+	return true;
+}
+
+bool clThreadPool::SetTaskPriority( size_t ID, int Priority )
+{
+	if ( !ID ) { return false; }
+
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	std::pair<clTaskIndex::iterator, clTaskIndex::iterator> Range = FTaskIndex.equal_range( ID );
+
+	bool Changed = false;
+
+	for ( clTaskIndex::iterator i = Range.first; i != Range.second; ++i )
+	{
+		sTaskQueue* Queue = FQueues[ i->second.FQueue ];
+
+		tthread::lock_guard<tthread::mutex> QueueLock( Queue->FMutex );
+
+		// tasks which are already running are not affected
+		if ( Queue->FTasks.SetPriority( ID, Priority ) ) { Changed = true; }
+
+		Queue->UpdateTopPriority();
+	}
+
+	return Changed;
+}
+
+void clThreadPool::CancelAll()
+{
+	// we have to ensure no callbacks will be invoked after this call
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	for ( clTaskIndex::iterator i = FTaskIndex.begin(); i != FTaskIndex.end(); ++i )
+	{
+		i->second.FTask->Exit();
+	}
+
+	FTaskIndex.clear();
+
+	for ( size_t i = 0; i != FRunning.size(); i++ )
+	{
+		if ( FRunning[i] ) { FRunning[i]->Exit(); }
+	}
+
+	for ( size_t i = 0; i != FQueues.size(); i++ )
+	{
+		tthread::lock_guard<tthread::mutex> QueueLock( FQueues[i]->FMutex );
+
+		for ( size_t Removed = FQueues[i]->FTasks.CancelAll(); Removed; Removed-- ) { Atomic::Dec( &FNumQueued ); }
+
+		FQueues[i]->UpdateTopPriority();
+	}
+
+	// the queues are empty now, whatever a worker has extracted before this point belongs to the old generation
+	FNumAnonymous = 0;
+
+	Atomic::Inc( &FCancelGeneration );
+}
+
+size_t clThreadPool::GetQueueSize() const
+{
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	return FTaskIndex.size() + FNumAnonymous;
+}
+
+bool clThreadPool::PopTask( size_t Queue, clPtr<iTask>* Task, long* Generation )
+{
+	sTaskQueue* Q = FQueues[Queue];
+
+	tthread::lock_guard<tthread::mutex> Lock( Q->FMutex );
+
+	if ( Q->FTasks.IsEmpty() ) { return false; }
+
+	*Task = Q->FTasks.Pop();
+
+	Q->UpdateTopPriority();
+	*Generation = FCancelGeneration;
+
+	Atomic::Dec( &FNumQueued );
+
+	return true;
+}
+
+clPtr<iTask> clThreadPool::ExtractTask( size_t Worker, long* Generation )
+{
+	const size_t NumQueues = FQueues.size();
+
+	while ( !FPendingExit )
+	{
+		clPtr<iTask> Task;
+
+		// the queue with the best task, the own queue wins the ties
+		size_t Best = Worker % NumQueues;
+		int    BestPriority = FQueues[ Best ]->FTopPriority;
+
+		for ( size_t i = 1; i != NumQueues; i++ )
+		{
+			size_t Queue = ( Worker + i ) % NumQueues;
+
+			if ( FQueues[ Queue ]->FTopPriority > BestPriority )
+			{
+				Best = Queue;
+				BestPriority = FQueues[ Queue ]->FTopPriority;
+			}
+		}
+
+		if ( PopTask( Best, &Task, Generation ) ) { return Task; }
+
+		// the priorities were read without the locks and could be stale, take whatever is there
+		for ( size_t i = 0; i != NumQueues; i++ )
+		{
+			if ( PopTask( ( Worker + i ) % NumQueues, &Task, Generation ) ) { return Task; }
+		}
+
+		tthread::lock_guard<tthread::mutex> Lock( FSleepMutex );
+
+		Atomic::Inc( &FNumSleeping );
+
+		while ( FNumQueued <= 0 && !FPendingExit )
+		{
+			FWakeUp.wait( FSleepMutex );
+		}
+
+		Atomic::Dec( &FNumSleeping );
+	}
+
+	return clPtr<iTask>();
+}
+
+void clThreadPool::TaskStarted( size_t Worker, const clPtr<iTask>& Task, long Generation )
+{
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	FRunning[Worker] = Task;
+
+	// CancelAll() was called after the task left the queue
+	if ( Generation != FCancelGeneration ) { Task->Exit(); }
+}
+
+void clThreadPool::TaskFinished( size_t Worker, const clPtr<iTask>& Task, long Generation )
+{
+	tthread::lock_guard<tthread::mutex> Lock( FIndexMutex );
+
+	FRunning[Worker] = NULL;
+
+	if ( !Task->GetTaskID() )
+	{
+		// CancelAll() has already stopped counting this task
+		if ( Generation == FCancelGeneration ) { FNumAnonymous--; }
+
+		return;
+	}
+
+	std::pair<clTaskIndex::iterator, clTaskIndex::iterator> Range = FTaskIndex.equal_range( Task->GetTaskID() );
+
+	for ( clTaskIndex::iterator i = Range.first; i != Range.second; ++i )
+	{
+		if ( i->second.FTask == Task )
+		{
+			FTaskIndex.erase( i );
+			return;
+		}
+	}
+}
+
+void clThreadPool::WorkerLoop( size_t Worker )
+{
+	Profiler_Get().SetThreadName( "Pool" );
+
+	while ( !FPendingExit )
+	{
+		long Generation = 0;
+
+		clPtr<iTask> Task = ExtractTask( Worker, &Generation );
+
+		if ( !Task ) { continue; }
+
+		TaskStarted( Worker, Task, Generation );
+
+		if ( !Task->IsPendingExit() )
+		{
+			L_PROFILE_ZONE( "clThreadPool::Task" );
+
+			Task->Run();
+		}
+
+		TaskFinished( Worker, Task, Generation );
+	}
+}
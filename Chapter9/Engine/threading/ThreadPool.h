@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2013 Sergey Kosarevsky (sk@linderdaum.com)
+ * Copyright (C) 2013 Viktor Latypov (vl@linderdaum.com)
+ * Based on Linderdaum Engine http://www.linderdaum.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must display the names 'Sergey Kosarevsky' and
+ *    'Viktor Latypov'in the credits of the application, if such credits exist.
+ *    The authors of this work must be notified via email (sk@linderdaum.com) in
+ *    this case of redistribution.
+ *
+ * 3. Neither the name of copyright holders nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS ``AS
+ * IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL COPYRIGHT HOLDERS OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _ThreadPool_
+#define _ThreadPool_
+
+#include "WorkerThread.h"
+
+#include <limits.h>
+#include <unordered_map>
+#include <vector>
+
+/**
+   A pool of worker threads running iTask-s
+
+   Every worker owns a clTaskQueue (by priority, FIFO inside the same priority). Tasks added from outside
+   are spread round-robin between the workers. A worker takes the task with the highest priority among all
+   the queues, preferring its own queue when the priorities are equal. So the priorities are respected across
+   the pool, but the tasks of the same priority in different queues may run in any order.
+   The API mirrors clWorkerThread, so the pool can be used wherever a single worker thread was used.
+*/
+class clThreadPool: public iObject
+{
+public:
+	clThreadPool();
+	virtual ~clThreadPool();
+
+	/// Start NumThreads workers, 0 means one worker per hardware thread
+	virtual void   Start( iThread::LPriority Priority, size_t NumThreads = 0 );
+	/// Stop all workers, pending tasks are cancelled
+	virtual void   Exit( bool Wait );
+
+	/// Start() should be called before the first task is added
+	virtual void   AddTask( const clPtr<iTask>& Task );
+	/// Cancel pending and running tasks with this ID
+	virtual bool   CancelTask( size_t ID );
+	/// Change the priority of a pending task
+	virtual bool   SetTaskPriority( size_t ID, int Priority );
+	virtual void   CancelAll();
+	/// Number of pending and running tasks
+	virtual size_t GetQueueSize() const;
+
+	size_t GetNumThreads() const { return FWorkers.size(); }
+
+private:
+	class clPoolWorker;
+	friend class clPoolWorker;
+
+	struct sTaskQueue
+	{
+		sTaskQueue(): FTopPriority( INT_MIN ) {}
+
+		/// Call with FMutex locked after FTasks has changed
+		void UpdateTopPriority() { FTopPriority = FTasks.IsEmpty() ? INT_MIN : FTasks.GetTopPriority(); }
+
+		tthread::mutex FMutex;
+		clTaskQueue    FTasks;
+		/// the priority of the best task or INT_MIN, read by the idle workers without locking FMutex
+		volatile int   FTopPriority;
+	};
+
+	struct sIndexEntry
+	{
+		clPtr<iTask> FTask;
+		/// the queue the task was added to, the task might have been stolen from it already
+		size_t       FQueue;
+	};
+
+	typedef std::unordered_multimap<size_t, sIndexEntry> clTaskIndex;
+
+	void         WorkerLoop( size_t Worker );
+	clPtr<iTask> ExtractTask( size_t Worker, long* Generation );
+	bool         PopTask( size_t Queue, clPtr<iTask>* Task, long* Generation );
+	void         TaskStarted( size_t Worker, const clPtr<iTask>& Task, long Generation );
+	void         TaskFinished( size_t Worker, const clPtr<iTask>& Task, long Generation );
+
+private:
+	std::vector<clPoolWorker*> FWorkers;
+	std::vector<sTaskQueue*>   FQueues;
+
+	/// round-robin counter for AddTask()
+	size_t                     FNextQueue;
+
+	/// pending and running tasks with an ID
+	clTaskIndex                FTaskIndex;
+	/// the tasks without ID are only counted, they would all share a single bucket of FTaskIndex
+	size_t                     FNumAnonymous;
+	/// the task each worker is running, so CancelAll() can stop the tasks without ID
+	std::vector< clPtr<iTask> > FRunning;
+	/// incremented by CancelAll(), a task extracted before that is cancelled when it is started
+	volatile long              FCancelGeneration;
+	mutable tthread::mutex     FIndexMutex;
+
+	/// number of tasks sitting in the queues, idle workers sleep while it is zero
+	volatile long              FNumQueued;
+	/// number of workers in ExtractTask() which are about to wait or are waiting for FWakeUp
+	volatile long              FNumSleeping;
+	volatile bool              FPendingExit;
+	tthread::mutex             FSleepMutex;
+	tthread::condition_variable FWakeUp;
+};
+
+#endif
@@ -33,122 +33,290 @@
  */
 
 #include "WorkerThread.h"
+#include "Profiler.h"
 
 #include <algorithm>
 
 void clWorkerThread::NotifyExit()
 {
+	// take the lock so the wake-up can not slip in between the check and the wait in ExtractTask()
+	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
+
 	FCondition.notify_all();
 }
 
-void clWorkerThread::AddTask( const clPtr<iTask>& Task )
+bool clTaskQueue::IsBefore( size_t A, size_t B ) const
 {
-	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
+	const sSlot& SA = FSlots[ FHeap[A] ];
+	const sSlot& SB = FSlots[ FHeap[B] ];
+
+	if ( SA.FPriority != SB.FPriority ) { return SA.FPriority > SB.FPriority; }
+
+	return SA.FSequence < SB.FSequence;
+}
+
+void clTaskQueue::SwapHeap( size_t A, size_t B )
+{
+	std::swap( FHeap[A], FHeap[B] );
+
+	FSlots[ FHeap[A] ].FHeapPos = A;
+	FSlots[ FHeap[B] ].FHeapPos = B;
+}
+
+void clTaskQueue::SiftUp( size_t Pos )
+{
+	while ( Pos > 0 )
+	{
+		size_t Parent = ( Pos - 1 ) / 2;
+
+		if ( !IsBefore( Pos, Parent ) ) { break; }
+
+		SwapHeap( Pos, Parent );
+
+		Pos = Parent;
+	}
+}
+
+void clTaskQueue::SiftDown( size_t Pos )
+{
+	const size_t Size = FHeap.size();
+
+	for ( ;; )
+	{
+		size_t Best  = Pos;
+		size_t Left  = 2 * Pos + 1;
+		size_t Right = Left + 1;
+
+		if ( Left  < Size && IsBefore( Left,  Best ) ) { Best = Left; }
+
+		if ( Right < Size && IsBefore( Right, Best ) ) { Best = Right; }
+
+		if ( Best == Pos ) { break; }
+
+		SwapHeap( Pos, Best );
+
+		Pos = Best;
+	}
+}
+
+void clTaskQueue::Push( const clPtr<iTask>& Task )
+{
+	size_t Slot = FSlots.size();
+
+	if ( FFreeSlots.empty() )
+	{
+		FSlots.push_back( sSlot() );
+	}
+	else
+	{
+		Slot = FFreeSlots.back();
+		FFreeSlots.pop_back();
+	}
+
+	sSlot& S = FSlots[Slot];
+
+	S.FTask     = Task;
+	S.FPriority = Task->GetPriority();
+	S.FSequence = FSequence++;
+	S.FHeapPos  = FHeap.size();
+
+	FHeap.push_back( Slot );
+
+	if ( size_t ID = Task->GetTaskID() ) { FIndex.insert( std::make_pair( ID, Slot ) ); }
+
+	SiftUp( S.FHeapPos );
+}
+
+void clTaskQueue::Unindex( size_t Slot )
+{
+	size_t ID = FSlots[Slot].FTask->GetTaskID();
+
+	if ( !ID ) { return; }
+
+	std::pair<clIndex::iterator, clIndex::iterator> Range = FIndex.equal_range( ID );
 
-	// non-zero IDs should be unique
-	if ( size_t ID = Task->GetTaskID() )
+	for ( clIndex::iterator i = Range.first; i != Range.second; ++i )
 	{
-		for ( std::list< clPtr<iTask> >::iterator i = FPendingTasks.begin(); i != FPendingTasks.end(); ++i )
+		if ( i->second == Slot )
 		{
-			// LASSERT( (*i)->GetTaskID() != ID );
+			FIndex.erase( i );
+			return;
 		}
 	}
+}
 
-	FPendingTasks.push_back( Task );
+void clTaskQueue::RemoveSlot( size_t Slot )
+{
+	size_t Pos  = FSlots[Slot].FHeapPos;
+	size_t Last = FHeap.size() - 1;
 
-	FCondition.notify_all();
+	if ( Pos != Last )
+	{
+		SwapHeap( Pos, Last );
+	}
+
+	FHeap.pop_back();
+
+	// the former last element may have to go either way
+	if ( Pos != Last )
+	{
+		SiftDown( Pos );
+		SiftUp( Pos );
+	}
+
+	FSlots[Slot].FTask = NULL;
+	FFreeSlots.push_back( Slot );
 }
 
-void clWorkerThread::CancelAll()
+clPtr<iTask> clTaskQueue::Pop()
 {
-	// we have to ensure no callbacks will be invoked after this call
-	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
+	if ( FHeap.empty() ) { return clPtr<iTask>(); }
 
-	if ( FCurrentTask ) { FCurrentTask->Exit(); }
+	size_t Slot = FHeap[0];
+
+	clPtr<iTask> Task = FSlots[Slot].FTask;
 
-	// Clear pending tasks
-	for ( std::list< clPtr<iTask> > ::iterator i = FPendingTasks.begin() ; i != FPendingTasks.end() ; i++ )
+	Unindex( Slot );
+	RemoveSlot( Slot );
+
+	return Task;
+}
+
+size_t clTaskQueue::Cancel( size_t ID )
+{
+	if ( !ID ) { return 0; }
+
+	std::pair<clIndex::iterator, clIndex::iterator> Range = FIndex.equal_range( ID );
+
+	size_t Count = 0;
+
+	for ( clIndex::iterator i = Range.first; i != Range.second; ++i, ++Count )
 	{
-		( *i )->Exit();
+		FSlots[ i->second ].FTask->Exit();
+
+		RemoveSlot( i->second );
 	}
 
-	FPendingTasks.clear();
+	FIndex.erase( Range.first, Range.second );
 
-	FCondition.notify_all();
+	return Count;
 }
 
-bool ShouldRemove( const clPtr<iTask> T, size_t ID )
+size_t clTaskQueue::CancelAll()
 {
-	if ( T->GetTaskID() == ID )
+	size_t Count = FHeap.size();
+
+	for ( size_t i = 0; i != FHeap.size(); i++ )
 	{
-		T->Exit();
-		return true;
+		FSlots[ FHeap[i] ].FTask->Exit();
 	}
 
-	return false;
+	FSlots.clear();
+	FFreeSlots.clear();
+	FHeap.clear();
+	FIndex.clear();
+
+	return Count;
 }
 
-bool clWorkerThread::CancelTask( size_t ID )
+bool clTaskQueue::SetPriority( size_t ID, int Priority )
 {
 	if ( !ID ) { return false; }
 
+	std::pair<clIndex::iterator, clIndex::iterator> Range = FIndex.equal_range( ID );
+
+	if ( Range.first == Range.second ) { return false; }
+
+	for ( clIndex::iterator i = Range.first; i != Range.second; ++i )
+	{
+		sSlot& S = FSlots[ i->second ];
+
+		S.FPriority = Priority;
+		S.FTask->SetPriority( Priority );
+
+		SiftDown( S.FHeapPos );
+		SiftUp( S.FHeapPos );
+	}
+
+	return true;
+}
+
+void clWorkerThread::AddTask( const clPtr<iTask>& Task )
+{
 	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
 
-	if ( FCurrentTask && FCurrentTask->GetTaskID() == ID ) { FCurrentTask->Exit(); }
+	FPendingTasks.Push( Task );
 
-	std::list< clPtr<iTask> >::iterator first = FPendingTasks.begin();
-	std::list< clPtr<iTask> >::iterator result = first;
+	FCondition.notify_all();
+}
 
-	for ( ; first != FPendingTasks.end() ; ++first )
-		if ( !ShouldRemove( *first, ID ) ) { *result++ = *first; }
+void clWorkerThread::CancelAll()
+{
+	// we have to ensure no callbacks will be invoked after this call
+	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
 
-	FPendingTasks.erase ( result, FPendingTasks.end( ) );
+	if ( FCurrentTask ) { FCurrentTask->Exit(); }
+
+	FPendingTasks.CancelAll();
+
+	FCondition.notify_all();
+}
+
+bool clWorkerThread::CancelTask( size_t ID )
+{
+	if ( !ID ) { return false; }
+
+	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
+
+	if ( FCurrentTask && FCurrentTask->GetTaskID() == ID ) { FCurrentTask->Exit(); }
+
+	FPendingTasks.Cancel( ID );
 
 	FCondition.notify_all();
 
 	return true;
 }
 
-clPtr<iTask> clWorkerThread::ExtractTask()
+bool clWorkerThread::SetTaskPriority( size_t ID, int Priority )
 {
-	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
+	if ( !ID ) { return false; }
 
-	while ( FPendingTasks.empty() && !IsPendingExit() )
-	{
-		FCondition.wait( FTasksMutex );
-	}
+	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
 
-	if ( FPendingTasks.empty() ) { return clPtr<iTask>(); }
+	return FPendingTasks.SetPriority( ID, Priority );
+}
 
-	std::list< clPtr<iTask> >::iterator Best = FPendingTasks.begin();
+clPtr<iTask> clWorkerThread::ExtractTask()
+{
+	tthread::lock_guard<tthread::mutex> Lock( FTasksMutex );
 
-	for ( std::list< clPtr<iTask> >::iterator i = FPendingTasks.begin(); i != FPendingTasks.end(); ++i )
+	while ( FPendingTasks.IsEmpty() && !IsPendingExit() )
 	{
-		if ( ( *i )->GetPriority() > ( *Best )->GetPriority() ) { Best = i; }
+		FCondition.wait( FTasksMutex );
 	}
 
-	clPtr<iTask> T = *Best;
-
-	FPendingTasks.erase( Best );
-
-	return T;
+	return FPendingTasks.Pop();
 }
 
 size_t clWorkerThread::GetQueueSize() const
 {
-	return FPendingTasks.size() + ( FCurrentTask ? 1 : 0 );
+	return FPendingTasks.GetSize() + ( FCurrentTask ? 1 : 0 );
 }
 
 void clWorkerThread::Run()
 {
 	FPendingExit = false;
 
+	Profiler_Get().SetThreadName( "Worker" );
+
 	while ( !IsPendingExit() )
 	{
 		FCurrentTask = ExtractTask();
 
 		if ( FCurrentTask && !FCurrentTask->IsPendingExit() )
 		{
+			L_PROFILE_ZONE( "clWorkerThread::Task" );
+
 			FCurrentTask->Run();
 		}
 
@@ -36,13 +36,15 @@
 #define _WorkerThread_
 
 #include "iObject.h"
+#include "ObjectPool.h"
 #include "Thread.h"
 #include "tinythread.h"
 
 #include "iIntrusivePtr.h"
 
-#include <list>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class iTask: public iObject
 {
@@ -68,11 +70,70 @@ private:
 	int                     FPriority;
 };
 
+/**
+   Priority queue of tasks
+
+   A binary heap ordered by priority and by insertion order inside the same priority. Non-zero task IDs are
+   indexed, so cancellation and re-prioritization do not scan the queue. Not thread-safe, the owner locks it.
+*/
+class clTaskQueue
+{
+public:
+	clTaskQueue(): FSequence( 0 ) {}
+
+	/// O(log n)
+	void         Push( const clPtr<iTask>& Task );
+	/// Extract the task with the highest priority, O(log n)
+	clPtr<iTask> Pop();
+	/// Exit() and remove all pending tasks with this ID, returns the number of removed tasks
+	size_t       Cancel( size_t ID );
+	/// Exit() and remove everything
+	size_t       CancelAll();
+	/// Change the priority of pending tasks with this ID
+	bool         SetPriority( size_t ID, int Priority );
+
+	size_t       GetSize() const { return FHeap.size(); }
+	bool         IsEmpty() const { return FHeap.empty(); }
+	/// Priority of the task Pop() would return, the queue should not be empty
+	int          GetTopPriority() const { return FSlots[ FHeap[0] ].FPriority; }
+
+private:
+	struct sSlot
+	{
+		clPtr<iTask> FTask;
+		int          FPriority;
+		/// FIFO order inside the same priority
+		uint64       FSequence;
+		/// position of this slot in FHeap
+		size_t       FHeapPos;
+	};
+
+	bool   IsBefore( size_t A, size_t B ) const;
+	void   SwapHeap( size_t A, size_t B );
+	void   SiftUp( size_t Pos );
+	void   SiftDown( size_t Pos );
+	/// Remove the slot from the heap and the index
+	void   RemoveSlot( size_t Slot );
+	void   Unindex( size_t Slot );
+
+private:
+	/// slots are reused through FFreeSlots, so the heap and the index can refer to them by number
+	std::vector<sSlot>  FSlots;
+	std::vector<size_t> FFreeSlots;
+	/// heap of slot numbers
+	std::vector<size_t> FHeap;
+	typedef std::unordered_multimap<size_t, size_t> clIndex;
+	clIndex             FIndex;
+	uint64              FSequence;
+};
+
 class clWorkerThread: public iThread
 {
 public:
 	virtual void   AddTask( const clPtr<iTask>& Task );
 	virtual bool   CancelTask( size_t ID );
+	/// Change the priority of a pending task
+	virtual bool   SetTaskPriority( size_t ID, int Priority );
 	virtual void   CancelAll();
 	virtual size_t GetQueueSize() const;
 
@@ -85,7 +146,7 @@ private:
 	clPtr<iTask> FCurrentTask;
 
 private:
-	std::list< clPtr<iTask> >   FPendingTasks;
+	clTaskQueue                 FPendingTasks;
 	tthread::mutex              FTasksMutex;
 	tthread::condition_variable FCondition;
 };